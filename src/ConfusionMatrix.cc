@@ -0,0 +1,282 @@
+// Copyright 2010 University of Helsinki
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+
+#include "ConfusionMatrix.h"
+
+namespace hfst_ol
+{
+
+typedef std::map<std::pair<SymbolNumber, SymbolNumber>, Weight> PairWeightMap;
+
+static const Weight NO_EDIT = std::numeric_limits<Weight>::infinity();
+
+const SymbolNumber ConfusionMatrix::EPSILON;
+const SymbolNumber ConfusionMatrix::UNKNOWN;
+
+ConfusionMatrix::ConfusionMatrix(uint32_t distance) :
+    distance_(distance),
+    size_(0),
+    has_swaps_(false)
+{
+    symbols_.push_back("");
+    symbols_.push_back("@_UNKNOWN_SYMBOL_@");
+    resize(2);
+}
+
+//! @brief split @a line at each @a separator
+static std::vector<std::string>
+split(const std::string& line, char separator)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+    size_t end;
+    while ((end = line.find(separator, start)) != std::string::npos)
+    {
+        parts.push_back(line.substr(start, end - start));
+        start = end + 1;
+    }
+    parts.push_back(line.substr(start));
+    return parts;
+}
+
+//! @brief number of @a symbol in @a matrix, adding it if it is new.
+//!
+//! Like editdist.py, a symbol first seen in an edit gets the weight of
+//! that edit as its own weight.
+static SymbolNumber
+edit_symbol(ConfusionMatrix& matrix, const std::string& symbol,
+            Weight weight, std::vector<Weight>& symbol_weights)
+{
+    if (symbol == "" || symbol == "@0@" || symbol == "@_EPSILON_SYMBOL_@")
+    {
+        return ConfusionMatrix::EPSILON;
+    }
+    SymbolNumber number = matrix.find(symbol);
+    if (number == ConfusionMatrix::UNKNOWN)
+    {
+        number = matrix.add_symbol(symbol);
+        symbol_weights.resize(matrix.size(), 0.0);
+        symbol_weights[number] = weight;
+    }
+    return number;
+}
+
+//! @brief the weight given for @a pair or for it reversed, or @a fallback
+static Weight
+given_weight(const PairWeightMap& given, SymbolNumber first,
+             SymbolNumber second, Weight fallback)
+{
+    PairWeightMap::const_iterator it = given.find(std::make_pair(first, second));
+    if (it == given.end())
+    {
+        it = given.find(std::make_pair(second, first));
+    }
+    return (it == given.end()) ? fallback : it->second;
+}
+
+ConfusionMatrix
+ConfusionMatrix::from_file(const std::string& filename, uint32_t distance,
+                           Weight default_weight)
+{
+    std::ifstream in(filename.c_str());
+    if (!in)
+    {
+        HFST_THROW_MESSAGE(ConfusionMatrixReadError,
+                           "the file '" + filename + "' could not be read.\n");
+    }
+    ConfusionMatrix matrix(distance);
+    std::vector<Weight> symbol_weights(matrix.size(), 0.0);
+    PairWeightMap edits;
+    PairWeightMap swaps;
+    bool reading_pairs = false;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line[line.size() - 1] == '\r')
+        {
+            line.erase(line.size() - 1);
+        }
+        if (line.empty() || line.compare(0, 2, "##") == 0)
+        {
+            continue;
+        }
+        if (!reading_pairs)
+        {
+            if (line == "@@")
+            {
+                reading_pairs = true;
+            }
+            // exclusions only matter when the alphabet is induced
+            else if (line[0] != '~')
+            {
+                std::vector<std::string> parts = split(line, '\t');
+                SymbolNumber symbol = edit_symbol(matrix, parts[0], 0.0,
+                                                  symbol_weights);
+                if (parts.size() > 1 && symbol != EPSILON)
+                {
+                    symbol_weights[symbol] = strtod(parts[1].c_str(), 0);
+                }
+            }
+            continue;
+        }
+        std::vector<std::string> parts = split(line, '\t');
+        if (parts.size() != 3)
+        {
+            HFST_THROW_MESSAGE(ConfusionMatrixReadError,
+                               "expected FROM, TO and WEIGHT in '" + line +
+                               "' of '" + filename + "'.\n");
+        }
+        Weight weight = strtod(parts[2].c_str(), 0);
+        if (parts[0].find(',') == std::string::npos)
+        {
+            SymbolNumber from = edit_symbol(matrix, parts[0], weight,
+                                            symbol_weights);
+            SymbolNumber to = edit_symbol(matrix, parts[1], weight,
+                                          symbol_weights);
+            // the first weight given for an edit counts
+            edits.insert(std::make_pair(std::make_pair(from, to), weight));
+            continue;
+        }
+        std::vector<std::string> from = split(parts[0], ',');
+        std::vector<std::string> to = split(parts[1], ',');
+        if (from.size() != 2 || to.size() != 2 ||
+            from[0] != to[1] || from[1] != to[0])
+        {
+            HFST_THROW_MESSAGE(ConfusionMatrixReadError,
+                               "expected a swap A,B and B,A in '" + line +
+                               "' of '" + filename + "'.\n");
+        }
+        SymbolNumber first = edit_symbol(matrix, from[0], weight,
+                                         symbol_weights);
+        SymbolNumber second = edit_symbol(matrix, from[1], weight,
+                                          symbol_weights);
+        swaps.insert(std::make_pair(std::make_pair(first, second), weight));
+    }
+
+    // everything not given is generated as editdist.py does it
+    SymbolNumber size = matrix.size();
+    bool with_swaps = !swaps.empty();
+    matrix.set_edit(UNKNOWN, EPSILON,
+                    given_weight(edits, UNKNOWN, EPSILON, default_weight));
+    for (SymbolNumber symbol = UNKNOWN + 1; symbol < size; ++symbol)
+    {
+        Weight weight = default_weight + symbol_weights[symbol];
+        PairWeightMap::const_iterator it;
+        it = edits.find(std::make_pair(EPSILON, symbol));
+        matrix.set_edit(EPSILON, symbol, it == edits.end() ? weight : it->second);
+        it = edits.find(std::make_pair(symbol, EPSILON));
+        matrix.set_edit(symbol, EPSILON, it == edits.end() ? weight : it->second);
+        matrix.set_edit(UNKNOWN, symbol, weight);
+        for (SymbolNumber other = UNKNOWN + 1; other < size; ++other)
+        {
+            if (other == symbol)
+            {
+                continue;
+            }
+            Weight pair_weight = weight + symbol_weights[other];
+            matrix.set_edit(symbol, other,
+                            given_weight(edits, symbol, other, pair_weight));
+            if (with_swaps)
+            {
+                matrix.set_swap(symbol, other,
+                                given_weight(swaps, symbol, other, pair_weight));
+            }
+        }
+    }
+    return matrix;
+}
+
+void ConfusionMatrix::resize(SymbolNumber size)
+{
+    std::vector<Weight> edits(size * size, NO_EDIT);
+    std::vector<Weight> swaps(has_swaps_ ? size * size : 0, NO_EDIT);
+    for (SymbolNumber from = 0; from < size_; ++from)
+    {
+        for (SymbolNumber to = 0; to < size_; ++to)
+        {
+            edits[from * size + to] = edits_[from * size_ + to];
+            if (has_swaps_)
+            {
+                swaps[from * size + to] = swaps_[from * size_ + to];
+            }
+        }
+    }
+    edits_.swap(edits);
+    swaps_.swap(swaps);
+    size_ = size;
+}
+
+SymbolNumber ConfusionMatrix::add_symbol(const std::string& symbol)
+{
+    SymbolNumber number = size_;
+    symbols_.push_back(symbol);
+    numbers_[symbol] = number;
+    resize(size_ + 1);
+    // keeping a symbol is no edit
+    edits_[number * size_ + number] = 0.0;
+    return number;
+}
+
+SymbolNumber ConfusionMatrix::find(const std::string& symbol) const
+{
+    std::map<std::string, SymbolNumber>::const_iterator it = numbers_.find(symbol);
+    return (it == numbers_.end()) ? UNKNOWN : it->second;
+}
+
+const std::string& ConfusionMatrix::get_symbol(SymbolNumber symbol) const
+{
+    return symbols_[symbol];
+}
+
+SymbolNumber ConfusionMatrix::size(void) const
+{
+    return size_;
+}
+
+uint32_t ConfusionMatrix::get_distance(void) const
+{
+    return distance_;
+}
+
+bool ConfusionMatrix::has_swaps(void) const
+{
+    return has_swaps_;
+}
+
+void ConfusionMatrix::set_edit(SymbolNumber from, SymbolNumber to,
+                               Weight weight)
+{
+    edits_[from * size_ + to] = weight;
+}
+
+void ConfusionMatrix::set_swap(SymbolNumber first, SymbolNumber second,
+                               Weight weight)
+{
+    if (!has_swaps_)
+    {
+        has_swaps_ = true;
+        swaps_.assign(size_ * size_, NO_EDIT);
+    }
+    swaps_[first * size_ + second] = weight;
+}
+
+} // namespace hfst_ol
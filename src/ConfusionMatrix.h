@@ -0,0 +1,107 @@
+/* -*- Mode: C++ -*- */
+// Copyright 2010 University of Helsinki
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef HFST_OSPELL_CONFUSIONMATRIX_H_
+#define HFST_OSPELL_CONFUSIONMATRIX_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "hfst-ol.h"
+
+namespace hfst_ol
+{
+//! @brief Error model given as weights of single symbol edits.
+//!
+//! Instead of an error model automaton, the weights of substituting,
+//! inserting, deleting and swapping symbols are kept in dense tables over
+//! the alphabet of the model, and a correction may make up to
+//! @c distance edits. Symbol 0 stands for the empty string and symbol 1
+//! for input symbols outside the alphabet, which can be substituted or
+//! deleted but not kept.
+class ConfusionMatrix
+{
+public:
+    static const SymbolNumber EPSILON = 0; //!< the empty string
+    static const SymbolNumber UNKNOWN = 1; //!< any symbol not listed
+
+    //! @brief create a model of @a distance edits with no symbols
+    explicit ConfusionMatrix(uint32_t distance=1);
+
+    //! @brief read a model of @a distance edits from @a filename.
+    //!
+    //! The file is in the specification format of editdist.py: first
+    //! the symbols, one per line, optionally followed by a tab and a
+    //! weight added to every edit of that symbol; then a line @c @@ and
+    //! lines @c FROM, tab, @c TO, tab, @c WEIGHT where an empty side or
+    //! @c @0@ is the empty string, and @c A,B, tab, @c B,A, tab,
+    //! @c WEIGHT for swaps. Lines starting with @c ## are comments.
+    //! Unlike editdist.py, @c @0@ in an edit is always the empty string
+    //! and never a weighted symbol of its own.
+    //! Edits that are not given cost @a default_weight plus the weights
+    //! of their symbols, or the weight of the same edit reversed if that
+    //! is given. Swaps are only made if the file gives some.
+    //! Throws ConfusionMatrixReadError if the file cannot be read.
+    static ConfusionMatrix from_file(const std::string& filename,
+                                     uint32_t distance=1,
+                                     Weight default_weight=1.0);
+
+    //! @brief add @a symbol to the alphabet, unable to edit for now
+    SymbolNumber add_symbol(const std::string& symbol);
+    //! @brief number of @a symbol, or @c UNKNOWN if it is not listed
+    SymbolNumber find(const std::string& symbol) const;
+    //! @brief string of @a symbol
+    const std::string& get_symbol(SymbolNumber symbol) const;
+    //! @brief number of symbols, including @c EPSILON and @c UNKNOWN
+    SymbolNumber size(void) const;
+    //! @brief most edits in one correction
+    uint32_t get_distance(void) const;
+    //! @brief whether any swap can be made
+    bool has_swaps(void) const;
+
+    //! @brief let @a from be replaced with @a to at @a weight
+    void set_edit(SymbolNumber from, SymbolNumber to, Weight weight);
+    //! @brief let @a first @a second be swapped at @a weight
+    void set_swap(SymbolNumber first, SymbolNumber second, Weight weight);
+
+    //! @brief weight of replacing @a from with @a to, infinite if it can't
+    Weight edit(SymbolNumber from, SymbolNumber to) const
+    {
+        return edits_[from * size_ + to];
+    }
+    //! @brief weight of swapping @a first @a second, infinite if it can't;
+    //!        only if has_swaps()
+    Weight swap(SymbolNumber first, SymbolNumber second) const
+    {
+        return swaps_[first * size_ + second];
+    }
+
+private:
+    //! @brief lay the tables out for @a size symbols
+    void resize(SymbolNumber size);
+
+    uint32_t distance_;
+    SymbolNumber size_;
+    std::vector<std::string> symbols_;
+    std::map<std::string, SymbolNumber> numbers_;
+    std::vector<Weight> edits_; //!< from * size_ + to
+    std::vector<Weight> swaps_; //!< first * size_ + second
+    bool has_swaps_;
+};
+
+} // namespace hfst_ol
+
+#endif // HFST_OSPELL_CONFUSIONMATRIX_H_
@@ -0,0 +1,469 @@
+// Copyright 2010 University of Helsinki
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <set>
+
+#include "SymmetricDeleteIndex.h"
+#include "ospell.h"
+
+namespace hfst_ol
+{
+
+//! the first bytes of an index file, ending in the version of the layout
+static const char MAGIC[8] = { 'H', 'F', 'S', 'T', 'S', 'D', 'I', '1' };
+
+// The index is one block: the header, the hash table of buckets, the
+// words, the word numbers each bucket points to and the symbols of the
+// words. Each part is a multiple of the alignment the next one needs.
+
+struct SymmetricDeleteIndex::Header
+{
+    char magic[8];
+    uint32_t distance;
+    uint32_t word_count;
+    uint32_t posting_count;
+    uint32_t symbol_count; //!< symbols of all words together
+    uint64_t bucket_count; //!< a power of two
+    // the lexicon the index was built from, as far as it can be told
+    uint32_t lexicon_symbols;
+    uint32_t lexicon_indices;
+    uint32_t lexicon_transitions;
+    uint32_t reserved;
+};
+
+//! @brief the words under one hash of a string left after deletions
+struct SymmetricDeleteIndex::Bucket
+{
+    uint64_t hash;
+    uint32_t first; //!< first posting
+    uint32_t count; //!< postings, zero for an empty bucket
+};
+
+struct SymmetricDeleteIndex::Word
+{
+    uint32_t first; //!< first symbol
+    uint32_t length;
+    Weight weight;
+};
+
+//! @brief FNV-1a hash of @a length symbols at @a symbols
+static uint64_t
+hash_symbols(const SymbolNumber* symbols, size_t length)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash = (hash ^ symbols[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+//! @brief add to @a deletes @a word and every string made by deleting up
+//!        to @a distance of its symbols
+static void
+collect_deletes(const SymbolVector& word, uint32_t distance,
+                std::set<SymbolVector>& deletes)
+{
+    if (!deletes.insert(word).second || distance == 0)
+    {
+        return;
+    }
+    for (size_t i = 0; i < word.size(); ++i)
+    {
+        SymbolVector shorter(word);
+        shorter.erase(shorter.begin() + i);
+        collect_deletes(shorter, distance - 1, deletes);
+    }
+}
+
+//! @brief what enumerating the language of a lexicon needs to carry
+struct WordCollector
+{
+    Transducer* lexicon;
+    SymbolNumber symbols; //!< input symbols of the lexicon
+    size_t max_words;
+    SymbolVector path;
+    FlagDiacriticState flags;
+    std::map<SymbolVector, Weight> words; //!< with their least weights
+};
+
+//! @brief add the words reached from state @a i at @a weight; the lexicon
+//!        is acyclic, so every path ends
+static void
+collect_words(WordCollector& collector, TransitionTableIndex i, Weight weight)
+{
+    Transducer* lexicon = collector.lexicon;
+    if (lexicon->is_final(i))
+    {
+        Weight final = weight + lexicon->final_weight(i);
+        std::map<SymbolVector, Weight>::iterator it =
+            collector.words.find(collector.path);
+        if (it == collector.words.end())
+        {
+            if (collector.max_words > 0 &&
+                collector.words.size() >= collector.max_words)
+            {
+                HFST_THROW_MESSAGE(SymmetricDeleteIndexError,
+                                   "the lexicon has too many words.\n");
+            }
+            collector.words[collector.path] = final;
+        }
+        else if (it->second > final)
+        {
+            it->second = final;
+        }
+    }
+    if (lexicon->has_epsilons_or_flags(i + 1))
+    {
+        TransitionTableIndex next = lexicon->next(i, 0);
+        STransition i_s = lexicon->take_epsilons_and_flags(next);
+        while (i_s.symbol != NO_SYMBOL)
+        {
+            SymbolNumber input_sym = lexicon->transitions.input_symbol(next);
+            if (input_sym == 0)
+            {
+                collect_words(collector, i_s.index, weight + i_s.weight);
+            }
+            else
+            {
+                FlagDiacriticOperation op =
+                    lexicon->get_operations()->operator[](input_sym);
+                ValueNumber old_value = collector.flags[op.Feature()];
+                if (try_compatible_with(collector.flags, op))
+                {
+                    collect_words(collector, i_s.index, weight + i_s.weight);
+                }
+                collector.flags[op.Feature()] = old_value;
+            }
+            ++next;
+            i_s = lexicon->take_epsilons_and_flags(next);
+        }
+    }
+    for (SymbolNumber sym = 1; sym < collector.symbols; ++sym)
+    {
+        if (lexicon->is_flag(sym) || !lexicon->has_transitions(i + 1, sym))
+        {
+            continue;
+        }
+        TransitionTableIndex next = lexicon->next(i, sym);
+        STransition i_s = lexicon->take_non_epsilons(next, sym);
+        collector.path.push_back(sym);
+        while (i_s.symbol != NO_SYMBOL)
+        {
+            collect_words(collector, i_s.index, weight + i_s.weight);
+            ++next;
+            i_s = lexicon->take_non_epsilons(next, sym);
+        }
+        collector.path.pop_back();
+    }
+}
+
+SymmetricDeleteIndex::SymmetricDeleteIndex(const TransducerStoragePtr& storage) :
+    storage_(storage)
+{
+    const int8_t* data = storage_->data();
+    header_ = reinterpret_cast<const Header*>(data);
+    data += sizeof(Header);
+    buckets_ = reinterpret_cast<const Bucket*>(data);
+    data += header_->bucket_count * sizeof(Bucket);
+    words_ = reinterpret_cast<const Word*>(data);
+    data += header_->word_count * sizeof(Word);
+    postings_ = reinterpret_cast<const uint32_t*>(data);
+    data += header_->posting_count * sizeof(uint32_t);
+    symbols_ = reinterpret_cast<const SymbolNumber*>(data);
+}
+
+SymmetricDeleteIndex
+SymmetricDeleteIndex::build(Transducer& lexicon, uint32_t distance,
+                            size_t max_words)
+{
+    if (lexicon.get_header()->probe_flag(Cyclic))
+    {
+        HFST_THROW_MESSAGE(SymmetricDeleteIndexError,
+                           "the lexicon is cyclic.\n");
+    }
+    if (lexicon.get_unknown() != NO_SYMBOL ||
+        lexicon.get_identity() != NO_SYMBOL)
+    {
+        HFST_THROW_MESSAGE(SymmetricDeleteIndexError,
+                           "the lexicon has unknown or identity symbols.\n");
+    }
+    WordCollector collector;
+    collector.lexicon = &lexicon;
+    collector.symbols = lexicon.get_header()->input_symbol_count();
+    collector.max_words = max_words;
+    collector.flags = FlagDiacriticState(lexicon.get_state_size(), 0);
+    collect_words(collector, 0, 0.0);
+
+    // hash every string left after deletions with the words under it
+    std::vector<std::pair<uint64_t, uint32_t> > keys;
+    std::vector<Word> words;
+    std::vector<SymbolNumber> symbols;
+    for (std::map<SymbolVector, Weight>::iterator it = collector.words.begin();
+         it != collector.words.end(); ++it)
+    {
+        uint32_t number = words.size();
+        Word word = { (uint32_t) symbols.size(), (uint32_t) it->first.size(),
+                      it->second };
+        words.push_back(word);
+        symbols.insert(symbols.end(), it->first.begin(), it->first.end());
+        std::set<SymbolVector> deletes;
+        collect_deletes(it->first, distance, deletes);
+        for (std::set<SymbolVector>::iterator d = deletes.begin();
+             d != deletes.end(); ++d)
+        {
+            keys.push_back(std::make_pair(
+                hash_symbols(d->empty() ? 0 : &d->at(0), d->size()), number));
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    uint64_t hashes = 0;
+    for (size_t k = 0; k < keys.size(); ++k)
+    {
+        if (k == 0 || keys[k].first != keys[k - 1].first)
+        {
+            ++hashes;
+        }
+    }
+    // at most half full, so that misses end soon
+    uint64_t bucket_count = 2;
+    while (bucket_count < 2 * hashes)
+    {
+        bucket_count *= 2;
+    }
+
+    size_t len = sizeof(Header) + bucket_count * sizeof(Bucket) +
+        words.size() * sizeof(Word) + keys.size() * sizeof(uint32_t) +
+        symbols.size() * sizeof(SymbolNumber);
+    int8_t* data = new int8_t[len];
+    memset(data, 0, len);
+    TransducerStoragePtr storage(
+        new TransducerStorage(data, len, TransducerStorage::Allocated));
+    Header* header = reinterpret_cast<Header*>(data);
+    memcpy(header->magic, MAGIC, sizeof(MAGIC));
+    header->distance = distance;
+    header->word_count = words.size();
+    header->posting_count = keys.size();
+    header->symbol_count = symbols.size();
+    header->bucket_count = bucket_count;
+    header->lexicon_symbols = lexicon.get_header()->symbol_count();
+    header->lexicon_indices = lexicon.get_header()->index_table_size();
+    header->lexicon_transitions = lexicon.get_header()->target_table_size();
+    SymmetricDeleteIndex index(storage);
+
+    Bucket* buckets = const_cast<Bucket*>(index.buckets_);
+    uint32_t* postings = const_cast<uint32_t*>(index.postings_);
+    for (size_t k = 0; k < keys.size(); ++k)
+    {
+        postings[k] = keys[k].second;
+        if (k > 0 && keys[k].first == keys[k - 1].first)
+        {
+            continue;
+        }
+        uint64_t slot = keys[k].first & (bucket_count - 1);
+        while (buckets[slot].count != 0)
+        {
+            slot = (slot + 1) & (bucket_count - 1);
+        }
+        buckets[slot].hash = keys[k].first;
+        buckets[slot].first = k;
+        size_t end = k;
+        while (end < keys.size() && keys[end].first == keys[k].first)
+        {
+            ++end;
+        }
+        buckets[slot].count = end - k;
+    }
+    if (!words.empty())
+    {
+        memcpy(const_cast<Word*>(index.words_), &words[0],
+               words.size() * sizeof(Word));
+    }
+    if (!symbols.empty())
+    {
+        memcpy(const_cast<SymbolNumber*>(index.symbols_), &symbols[0],
+               symbols.size() * sizeof(SymbolNumber));
+    }
+    return index;
+}
+
+SymmetricDeleteIndex
+SymmetricDeleteIndex::from_file(const std::string& filename,
+                                Transducer& lexicon, uint32_t distance,
+                                int mapping)
+{
+    TransducerStoragePtr storage = TransducerStorage::from_file(filename,
+                                                                mapping);
+    const Header* header = reinterpret_cast<const Header*>(storage->data());
+    if (storage->size() < sizeof(Header) ||
+        memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        HFST_THROW_MESSAGE(SymmetricDeleteIndexError,
+                           "the file '" + filename +
+                           "' is not a symmetric delete index.\n");
+    }
+    // a bucket count this large would wrap the size computed below
+    if (header->bucket_count == 0 ||
+        (header->bucket_count & (header->bucket_count - 1)) != 0 ||
+        header->bucket_count > storage->size() / sizeof(Bucket) ||
+        storage->size() != sizeof(Header) +
+        header->bucket_count * sizeof(Bucket) +
+        uint64_t(header->word_count) * sizeof(Word) +
+        uint64_t(header->posting_count) * sizeof(uint32_t) +
+        uint64_t(header->symbol_count) * sizeof(SymbolNumber))
+    {
+        HFST_THROW_MESSAGE(SymmetricDeleteIndexError,
+                           "the file '" + filename + "' is truncated.\n");
+    }
+    if (header->lexicon_symbols != lexicon.get_header()->symbol_count() ||
+        header->lexicon_indices != lexicon.get_header()->index_table_size() ||
+        header->lexicon_transitions !=
+        lexicon.get_header()->target_table_size())
+    {
+        HFST_THROW_MESSAGE(SymmetricDeleteIndexError,
+                           "the file '" + filename +
+                           "' was built from another lexicon.\n");
+    }
+    // fewer deletions would miss words the caller expects to find
+    if (header->distance < distance)
+    {
+        HFST_THROW_MESSAGE(SymmetricDeleteIndexError,
+                           "the file '" + filename +
+                           "' was built for fewer edits.\n");
+    }
+    SymmetricDeleteIndex index(storage);
+    if (!index.is_consistent())
+    {
+        HFST_THROW_MESSAGE(SymmetricDeleteIndexError,
+                           "the file '" + filename + "' is damaged.\n");
+    }
+    return index;
+}
+
+bool SymmetricDeleteIndex::is_consistent(void) const
+{
+    bool empty_bucket = false;
+    for (uint64_t slot = 0; slot < header_->bucket_count; ++slot)
+    {
+        if (buckets_[slot].count == 0)
+        {
+            empty_bucket = true;
+        }
+        else if (buckets_[slot].first > header_->posting_count ||
+                 buckets_[slot].count >
+                 header_->posting_count - buckets_[slot].first)
+        {
+            return false;
+        }
+    }
+    if (!empty_bucket)
+    {
+        return false;
+    }
+    for (uint32_t k = 0; k < header_->posting_count; ++k)
+    {
+        if (postings_[k] >= header_->word_count)
+        {
+            return false;
+        }
+    }
+    for (uint32_t w = 0; w < header_->word_count; ++w)
+    {
+        if (words_[w].first > header_->symbol_count ||
+            words_[w].length > header_->symbol_count - words_[w].first)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SymmetricDeleteIndex::write(const std::string& filename) const
+{
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    out.write(reinterpret_cast<const char*>(storage_->data()),
+              storage_->size());
+    out.close();
+    if (!out)
+    {
+        HFST_THROW_MESSAGE(SymmetricDeleteIndexError,
+                           "the file '" + filename +
+                           "' could not be written.\n");
+    }
+}
+
+uint32_t SymmetricDeleteIndex::get_distance(void) const
+{
+    return header_->distance;
+}
+
+uint32_t SymmetricDeleteIndex::word_count(void) const
+{
+    return header_->word_count;
+}
+
+const SymbolNumber*
+SymmetricDeleteIndex::word(uint32_t word, uint32_t& length) const
+{
+    length = words_[word].length;
+    return symbols_ + words_[word].first;
+}
+
+Weight SymmetricDeleteIndex::word_weight(uint32_t word) const
+{
+    return words_[word].weight;
+}
+
+size_t SymmetricDeleteIndex::size(void) const
+{
+    return storage_->size();
+}
+
+void SymmetricDeleteIndex::lookup(const SymbolVector& query,
+                                  std::vector<uint32_t>& words) const
+{
+    words.clear();
+    std::set<SymbolVector> deletes;
+    collect_deletes(query, header_->distance, deletes);
+    uint64_t mask = header_->bucket_count - 1;
+    for (std::set<SymbolVector>::iterator d = deletes.begin();
+         d != deletes.end(); ++d)
+    {
+        uint64_t hash = hash_symbols(d->empty() ? 0 : &d->at(0), d->size());
+        for (uint64_t slot = hash & mask; buckets_[slot].count != 0;
+             slot = (slot + 1) & mask)
+        {
+            if (buckets_[slot].hash == hash)
+            {
+                words.insert(words.end(),
+                             postings_ + buckets_[slot].first,
+                             postings_ + buckets_[slot].first +
+                             buckets_[slot].count);
+                break;
+            }
+        }
+    }
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+}
+
+} // namespace hfst_ol
@@ -0,0 +1,106 @@
+/* -*- Mode: C++ -*- */
+// Copyright 2010 University of Helsinki
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef HFST_OSPELL_SYMMETRICDELETEINDEX_H_
+#define HFST_OSPELL_SYMMETRICDELETEINDEX_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hfst-ol.h"
+
+namespace hfst_ol
+{
+class Transducer;
+class TransducerStorage;
+
+//! @brief Words of a finite lexicon, found by the strings left after
+//!        deleting symbols from them.
+//!
+//! Every word is stored under each string made by deleting up to
+//! @c distance of its symbols. Deleting up to as many symbols from a
+//! misspelling then finds every word within @c distance insertions,
+//! deletions, substitutions and swaps of it, and some more, with a few
+//! hash lookups instead of a search of the lexicon. The index is laid
+//! out in one block of memory that can be written to a file and mapped
+//! back; it is only valid with the lexicon it was built from, whose
+//! symbol numbers it stores.
+class SymmetricDeleteIndex
+{
+public:
+    //! @brief index the words of @a lexicon under up to @a distance
+    //!        deletions.
+    //!
+    //! Throws SymmetricDeleteIndexError if the header of @a lexicon says it
+    //! is cyclic, if it has unknown or identity symbols, or if it has more
+    //! than @a max_words words, unless that is zero.
+    static SymmetricDeleteIndex build(Transducer& lexicon,
+                                      uint32_t distance=2,
+                                      size_t max_words=0);
+    //! @brief map the index written to @a filename for @a lexicon and at
+    //!        least @a distance deletions, as the MappingFlags @a mapping
+    //!        say
+    //!
+    //! Throws SymmetricDeleteIndexError if the file is not such an index,
+    //! is damaged, was built from another lexicon or for fewer deletions.
+    static SymmetricDeleteIndex from_file(const std::string& filename,
+                                          Transducer& lexicon,
+                                          uint32_t distance,
+                                          int mapping=0);
+    //! @brief write the index to @a filename
+    void write(const std::string& filename) const;
+
+    //! @brief most deletions the words are stored under
+    uint32_t get_distance(void) const;
+    //! @brief number of words
+    uint32_t word_count(void) const;
+    //! @brief lexicon symbols of word @a word, @a length of them
+    const SymbolNumber* word(uint32_t word, uint32_t& length) const;
+    //! @brief least weight of word @a word in the lexicon
+    Weight word_weight(uint32_t word) const;
+    //! @brief bytes taken by the index
+    size_t size(void) const;
+
+    //! @brief set @a words to the words that share a string left after
+    //!        deletions with @a query, in order and each once.
+    //!
+    //! Hash collisions may add words further away, so candidates must
+    //! still be weighted against @a query.
+    void lookup(const SymbolVector& query,
+                std::vector<uint32_t>& words) const;
+
+private:
+    explicit SymmetricDeleteIndex(
+        const std::shared_ptr<const TransducerStorage>& storage);
+    //! @brief whether the buckets, postings and words only point inside
+    //!        the index, and a probe for a missing string ends
+    bool is_consistent(void) const;
+
+    struct Header;
+    struct Bucket;
+    struct Word;
+
+    std::shared_ptr<const TransducerStorage> storage_;
+    const Header* header_;
+    const Bucket* buckets_;
+    const Word* words_;
+    const uint32_t* postings_;
+    const SymbolNumber* symbols_;
+};
+
+} // namespace hfst_ol
+
+#endif // HFST_OSPELL_SYMMETRICDELETEINDEX_H_
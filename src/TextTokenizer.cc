@@ -0,0 +1,213 @@
+// Copyright 2010 University of Helsinki
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "TextTokenizer.h"
+#include "ospell.h"
+
+namespace hfst_ol
+{
+
+//! @brief code point of the @a bytes long utf-8 character at @a p
+static int32_t
+decode_utf8(const char* p, size_t bytes)
+{
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    switch (bytes)
+    {
+    case 2:
+        return ((u[0] & 0x1F) << 6) | (u[1] & 0x3F);
+    case 3:
+        return ((u[0] & 0x0F) << 12) | ((u[1] & 0x3F) << 6) | (u[2] & 0x3F);
+    case 4:
+        return ((u[0] & 0x07) << 18) | ((u[1] & 0x3F) << 12) |
+            ((u[2] & 0x3F) << 6) | (u[3] & 0x3F);
+    default:
+        return u[0];
+    }
+}
+
+//! @brief whether @a code is a space, a symbol or punctuation rather than
+//!        a letter, by the blocks of the characters that are
+static bool
+is_nonletter(int32_t code)
+{
+    if (code < 0xC0)
+    {
+        // Latin-1 punctuation, but ª, µ and º are letters
+        return code != 0xAA && code != 0xB5 && code != 0xBA;
+    }
+    return code == 0xD7 || code == 0xF7 ||
+        (code >= 0x2000 && code <= 0x206F) ||  // general punctuation
+        (code >= 0x20A0 && code <= 0x20CF) ||  // currency symbols
+        (code >= 0x2190 && code <= 0x2BFF) ||  // arrows to symbols
+        (code >= 0x3000 && code <= 0x303F) ||  // CJK punctuation
+        (code >= 0xFE30 && code <= 0xFE4F) ||  // CJK compatibility forms
+        (code >= 0xFF00 && code <= 0xFF0F) ||  // fullwidth punctuation
+        (code >= 0xFF1A && code <= 0xFF20) ||
+        (code >= 0xFF3B && code <= 0xFF40) ||
+        (code >= 0xFF5B && code <= 0xFF65) ||
+        code == 0xFEFF;                        // byte order mark
+}
+
+//! @brief whether @a code, beyond ASCII, is a space
+static bool
+is_space(int32_t code)
+{
+    return code == 0x85 || code == 0xA0 || (code >= 0x2000 && code <= 0x200A) ||
+        code == 0x2028 || code == 0x2029 || code == 0x202F ||
+        code == 0x205F || code == 0x3000;
+}
+
+TextTokenizer::TextTokenizer()
+{
+    for (int c = 0; c < 128; ++c)
+    {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+        {
+            ascii_[c] = LETTER;
+        }
+        else if (c >= '0' && c <= '9')
+        {
+            ascii_[c] = DIGIT;
+        }
+        else
+        {
+            ascii_[c] = SEPARATOR;
+        }
+    }
+}
+
+TextTokenizer::TextTokenizer(const KeyTable& symbols) :
+    TextTokenizer()
+{
+    for (KeyTable::const_iterator it = symbols.begin();
+         it != symbols.end(); ++it)
+    {
+        if (it->empty() ||
+            static_cast<size_t>(nByte_utf8(static_cast<uint8_t>((*it)[0])))
+            != it->size())
+        {
+            // multicharacter symbols and flags don't make words
+            continue;
+        }
+        int32_t code = decode_utf8(it->data(), it->size());
+        if (code < 128)
+        {
+            // spaces and controls always separate words
+            if (ascii_[code] == SEPARATOR && code > ' ' && code != 0x7F)
+            {
+                ascii_[code] = PUNCTUATION;
+            }
+        }
+        else if (is_nonletter(code) && !is_space(code))
+        {
+            punctuation_.insert(code);
+        }
+    }
+}
+
+TextTokenizer::CharacterClass
+TextTokenizer::classify(const char* p, const char* end, size_t& bytes) const
+{
+    unsigned char c = static_cast<unsigned char>(*p);
+    if (c < 128)
+    {
+        bytes = 1;
+        return static_cast<CharacterClass>(ascii_[c]);
+    }
+    int32_t n = nByte_utf8(c);
+    if (n == 0 || n > end - p)
+    {
+        // broken utf-8 is taken a byte at a time as part of a word, for
+        // the speller to reject
+        bytes = 1;
+        return LETTER;
+    }
+    bytes = n;
+    int32_t code = decode_utf8(p, bytes);
+    if (!is_nonletter(code))
+    {
+        return LETTER;
+    }
+    return punctuation_.count(code) > 0 ? PUNCTUATION : SEPARATOR;
+}
+
+void
+TextTokenizer::split(const char* text, size_t length,
+                     std::vector<TextSpan>& words) const
+{
+    const char* end = text + length;
+    const char* p = text;
+    while (p < end)
+    {
+        size_t bytes;
+        CharacterClass c = classify(p, end, bytes);
+        if (c == SEPARATOR)
+        {
+            p += bytes;
+            continue;
+        }
+        const char* start = p;
+        bool has_letter = false;
+        while (c != SEPARATOR)
+        {
+            has_letter = has_letter || c == LETTER;
+            p += bytes;
+            if (p >= end)
+            {
+                break;
+            }
+            c = classify(p, end, bytes);
+        }
+        if (has_letter)
+        {
+            words.push_back(TextSpan(start - text, p - start));
+        }
+    }
+}
+
+TextSpan
+TextTokenizer::trim(const char* text, const TextSpan& word) const
+{
+    const char* begin = text + word.offset;
+    const char* end = begin + word.length;
+    size_t bytes;
+    while (begin < end && classify(begin, end, bytes) == PUNCTUATION)
+    {
+        begin += bytes;
+    }
+    while (end > begin)
+    {
+        // back to the first byte of the last character
+        const char* last = end - 1;
+        while (last > begin &&
+               (static_cast<unsigned char>(*last) & 0xC0) == 0x80)
+        {
+            --last;
+        }
+        if (classify(last, end, bytes) != PUNCTUATION ||
+            last + bytes != end)
+        {
+            break;
+        }
+        end = last;
+    }
+    return TextSpan(begin - text, end - begin);
+}
+
+} // namespace hfst_ol
@@ -0,0 +1,77 @@
+/* -*- Mode: C++ -*- */
+// Copyright 2010 University of Helsinki
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef HFST_OSPELL_TEXTTOKENIZER_H_
+#define HFST_OSPELL_TEXTTOKENIZER_H_
+
+#include <set>
+#include <vector>
+
+#include "hfst-ol.h"
+
+namespace hfst_ol
+{
+//! @brief A stretch of a text, in bytes.
+struct TextSpan
+{
+    size_t offset; //!< bytes before the span
+    size_t length; //!< bytes in the span
+
+    TextSpan(size_t offset_=0, size_t length_=0) :
+        offset(offset_), length(length_)
+    {
+    }
+};
+
+//! @brief Splits running utf-8 text into words for a speller.
+//!
+//! ASCII bytes are classified by a table: letters and digits are parts of
+//! words and everything else separates them, except punctuation that the
+//! speller has as a symbol of its own, such as an apostrophe or a hyphen.
+//! Characters beyond ASCII are letters unless they are spaces, symbols or
+//! punctuation, which again are parts of words if the speller has them.
+//! Words without letters are left out. Nothing is copied; words are spans
+//! of the text.
+class TextTokenizer
+{
+public:
+    //! @brief split words at everything but letters and digits
+    TextTokenizer();
+    //! @brief also keep within words the punctuation of @a symbols, the
+    //!        input symbols of a speller
+    explicit TextTokenizer(const KeyTable& symbols);
+
+    //! @brief append the words of the @a length bytes of @a text to
+    //!        @a words
+    void split(const char* text, size_t length,
+               std::vector<TextSpan>& words) const;
+    //! @brief @a word of @a text without the punctuation at its edges
+    TextSpan trim(const char* text, const TextSpan& word) const;
+
+private:
+    enum CharacterClass { SEPARATOR, LETTER, DIGIT, PUNCTUATION };
+
+    //! @brief class of the character at @a p, @a bytes long, before @a end
+    CharacterClass classify(const char* p, const char* end,
+                            size_t& bytes) const;
+
+    unsigned char ascii_[128]; //!< CharacterClass of each ASCII byte
+    //! punctuation beyond ASCII that the speller has as symbols
+    std::set<int32_t> punctuation_;
+};
+
+} // namespace hfst_ol
+
+#endif // HFST_OSPELL_TEXTTOKENIZER_H_
@@ -32,6 +32,8 @@
 #endif
 #include <string>
 #include <map>
+#include <algorithm>
+#include <set>
 
 using std::string;
 using std::map;
@@ -151,10 +153,12 @@ ZHfstOspeller::load_errmodel(struct archive* ar, struct archive_entry* entry,
     char* descr = hfst_strndup(p, descr_len);
     Transducer* trans;
 #if ZHFST_EXTRACT_TO_TMPDIR
-    trans = Transducer::new_from_file(temporary);
+    trans = Transducer::new_from_file(temporary, mapping_);
 #elif ZHFST_EXTRACT_TO_MEM
-    trans = new Transducer(full_data);
-    delete[] full_data;
+    // the tables point into the extracted bytes, so they must stay
+    trans = new Transducer(TransducerStoragePtr(
+        new TransducerStorage(full_data, total_length,
+                              TransducerStorage::Allocated)));
 #endif
     errmodels_[descr] = trans;
     free(descr);
@@ -189,27 +193,85 @@ ZHfstOspeller::load_acceptor(struct archive* ar, struct archive_entry* entry,
     char* descr = hfst_strndup(p, descr_len);
     Transducer* trans;
 #if ZHFST_EXTRACT_TO_TMPDIR
-    trans = Transducer::new_from_file(temporary);
+    trans = Transducer::new_from_file(temporary, mapping_);
 #elif ZHFST_EXTRACT_TO_MEM
-    trans = new Transducer(full_data);
-    delete[] full_data;
+    // the tables point into the extracted bytes, so they must stay
+    trans = new Transducer(TransducerStoragePtr(
+        new TransducerStorage(full_data, total_length,
+                              TransducerStorage::Allocated)));
 #endif
     acceptors_[descr] = trans;
     free(descr);
 
     return trans;
 }
+
+Transducer*
+ZHfstOspeller::load_hyphenator(struct archive* ar, struct archive_entry* entry,
+    const char* filename, const std::string& tempdir)
+{
+#if ZHFST_EXTRACT_TO_TMPDIR
+    (void) entry;
+    std::string temporary = extract_to_tmp_dir(ar, filename, tempdir);
+#elif ZHFST_EXTRACT_TO_MEM
+    (void) tempdir;
+    size_t total_length = 0;
+    int8_t* full_data = extract_to_mem(ar, entry, &total_length);
+#endif
+    const char* p = filename;
+    p += strlen("hyphenator.");
+    size_t descr_len = 0;
+    for (const char* q = p; *q != '\0'; q++)
+    {
+        if (*q == '.')
+        {
+            break;
+        }
+        else
+        {
+            descr_len++;
+        }
+    }
+    char* descr = hfst_strndup(p, descr_len);
+    Transducer* trans;
+#if ZHFST_EXTRACT_TO_TMPDIR
+    trans = Transducer::new_from_file(temporary, mapping_);
+#elif ZHFST_EXTRACT_TO_MEM
+    // the tables point into the extracted bytes, so they must stay
+    trans = new Transducer(TransducerStoragePtr(
+        new TransducerStorage(full_data, total_length,
+                              TransducerStorage::Allocated)));
+#endif
+    hyphenators_[descr] = trans;
+    free(descr);
+
+    return trans;
+}
 #endif // HAVE_LIBARCHIVE
 
 ZHfstOspeller::ZHfstOspeller() :
     suggestions_maximum_(0),
     maximum_weight_(-1.0),
     beam_(-1.0),
+    deepening_weight_(0.0),
+    cascade_minimum_(0),
+    node_limit_(0),
+    arc_limit_(0),
+    time_limit_(0.0),
+    partial_(false),
+    mapping_(MapDefault),
+    delete_distance_(0),
+    delete_index_(0),
+    completion_table_(false),
+    edit_distance_(false),
+    case_folding_(false),
     can_spell_(false),
     can_correct_(false),
     can_analyse_(true),
+    can_hyphenate_(false),
     current_speller_(0),
     current_sugger_(0),
+    current_hyphenator_(0),
     tmp_prefix_("/tmp")
 {
 }
@@ -218,30 +280,59 @@ ZHfstOspeller::ZHfstOspeller(const std::string& filename) :
     suggestions_maximum_(0),
     maximum_weight_(-1.0),
     beam_(-1.0),
+    deepening_weight_(0.0),
+    cascade_minimum_(0),
+    node_limit_(0),
+    arc_limit_(0),
+    time_limit_(0.0),
+    partial_(false),
+    mapping_(MapDefault),
+    delete_distance_(0),
+    delete_index_(0),
+    completion_table_(false),
+    edit_distance_(false),
+    case_folding_(false),
     can_spell_(false),
     can_correct_(false),
     can_analyse_(true),
+    can_hyphenate_(false),
     current_speller_(0),
     current_sugger_(0),
+    current_hyphenator_(0),
     tmp_prefix_("/tmp")
 {
     read_zhfst(filename);
 }
 
 ZHfstOspeller::ZHfstOspeller(const std::string& acceptorFn,
-                             const std::string& errmodelFn) :
+                             const std::string& errmodelFn,
+                             int mapping) :
     suggestions_maximum_(0),
     maximum_weight_(-1.0),
     beam_(-1.0),
+    deepening_weight_(0.0),
+    cascade_minimum_(0),
+    node_limit_(0),
+    arc_limit_(0),
+    time_limit_(0.0),
+    partial_(false),
+    mapping_(mapping),
+    delete_distance_(0),
+    delete_index_(0),
+    completion_table_(false),
+    edit_distance_(false),
+    case_folding_(false),
     can_spell_(false),
     can_correct_(false),
     can_analyse_(true),
+    can_hyphenate_(false),
     current_speller_(0),
     current_sugger_(0),
+    current_hyphenator_(0),
     tmp_prefix_("/tmp")
 {
-    Transducer* acceptor = Transducer::new_from_file(acceptorFn);
-    Transducer* errmodel = Transducer::new_from_file(errmodelFn);
+    Transducer* acceptor = Transducer::new_from_file(acceptorFn, mapping_);
+    Transducer* errmodel = Transducer::new_from_file(errmodelFn, mapping_);
 
     acceptors_["default"] = acceptor;
     errmodels_["default"] = errmodel;
@@ -252,6 +343,13 @@ ZHfstOspeller::ZHfstOspeller(const std::string& acceptorFn,
 
 ZHfstOspeller::~ZHfstOspeller()
 {
+    for (std::vector<Speller*>::iterator tier = cascade_.begin();
+         tier != cascade_.end();
+         ++tier)
+    {
+        delete *tier;
+    }
+    cascade_.clear();
     if ((current_speller_ != NULL) && (current_sugger_ != NULL))
     {
         if (current_speller_ != current_sugger_)
@@ -278,8 +376,19 @@ ZHfstOspeller::~ZHfstOspeller()
     {
         delete errmodel->second;
     }
+    delete delete_index_;
+    delete_index_ = 0;
+    delete current_hyphenator_;
+    current_hyphenator_ = 0;
+    for (map<string, Transducer*>::iterator hyphenator = hyphenators_.begin();
+         hyphenator != hyphenators_.end();
+         ++hyphenator)
+    {
+        delete hyphenator->second;
+    }
     can_spell_ = false;
     can_correct_ = false;
+    can_hyphenate_ = false;
 }
 
 void
@@ -289,6 +398,138 @@ ZHfstOspeller::inject_speller(Speller* s)
     current_sugger_ = s;
     can_spell_ = true;
     can_correct_ = true;
+    build_edit_distance();
+    build_case_folding();
+    build_tokenizer();
+}
+
+//! @brief add a twin of each automaton of @a from to @a to over the same
+//!        storage, remembering it in @a twins
+static void
+share_automata(const map<string, Transducer*>& from,
+               map<string, Transducer*>& to,
+               map<const Transducer*, Transducer*>& twins)
+{
+    for (map<string, Transducer*>::const_iterator it = from.begin();
+         it != from.end();
+         ++it)
+    {
+        Transducer* twin = new Transducer(it->second->get_storage());
+        to[it->first] = twin;
+        twins[it->second] = twin;
+    }
+}
+
+//! @brief a speller like @a speller over the twins of its automata, or 0
+//!        if they have none
+static Speller*
+share_speller(const Speller* speller,
+              const map<const Transducer*, Transducer*>& twins)
+{
+    map<const Transducer*, Transducer*>::const_iterator lexicon =
+        twins.find(speller->lexicon);
+    if (lexicon == twins.end())
+    {
+        return 0;
+    }
+    if (speller->mutator == 0)
+    {
+        return new Speller(0, lexicon->second);
+    }
+    map<const Transducer*, Transducer*>::const_iterator mutator =
+        twins.find(speller->mutator);
+    if (mutator == twins.end())
+    {
+        return 0;
+    }
+    return new Speller(mutator->second, lexicon->second);
+}
+
+ZHfstOspeller*
+ZHfstOspeller::share() const
+{
+    ZHfstOspeller* shared = new ZHfstOspeller;
+    shared->filename_ = filename_;
+    shared->suggestions_maximum_ = suggestions_maximum_;
+    shared->maximum_weight_ = maximum_weight_;
+    shared->beam_ = beam_;
+    shared->deepening_weight_ = deepening_weight_;
+    shared->cascade_minimum_ = cascade_minimum_;
+    shared->node_limit_ = node_limit_;
+    shared->arc_limit_ = arc_limit_;
+    shared->time_limit_ = time_limit_;
+    shared->mapping_ = mapping_;
+    shared->delete_distance_ = delete_distance_;
+    shared->completion_table_ = completion_table_;
+    shared->edit_distance_ = edit_distance_;
+    shared->case_folding_ = case_folding_;
+    shared->metadata_ = metadata_;
+    shared->tmp_prefix_ = tmp_prefix_;
+
+    map<const Transducer*, Transducer*> twins;
+    share_automata(acceptors_, shared->acceptors_, twins);
+    share_automata(errmodels_, shared->errmodels_, twins);
+    share_automata(hyphenators_, shared->hyphenators_, twins);
+    if (current_speller_ != 0)
+    {
+        shared->current_speller_ = share_speller(current_speller_, twins);
+    }
+    if ((current_sugger_ != 0) && (current_sugger_ != current_speller_))
+    {
+        shared->current_sugger_ = share_speller(current_sugger_, twins);
+    }
+    else
+    {
+        shared->current_sugger_ = shared->current_speller_;
+    }
+    if (((current_speller_ != 0) && (shared->current_speller_ == 0)) ||
+        ((current_sugger_ != 0) && (shared->current_sugger_ == 0)))
+    {
+        // injected spellers have automata this one doesn't own
+        delete shared;
+        throw ZHfstException("An injected speller can't be shared");
+    }
+    for (std::vector<Speller*>::const_iterator tier = cascade_.begin();
+         tier != cascade_.end();
+         ++tier)
+    {
+        Speller* twin = share_speller(*tier, twins);
+        if (twin != 0)
+        {
+            shared->cascade_.push_back(twin);
+        }
+    }
+    shared->can_spell_ = can_spell_;
+    shared->can_correct_ = can_correct_;
+    shared->can_analyse_ = can_analyse_;
+    if (current_hyphenator_ != 0)
+    {
+        shared->current_hyphenator_ =
+            new Hyphenator(twins[current_hyphenator_->hyphenator]);
+    }
+    shared->can_hyphenate_ = (shared->current_hyphenator_ != 0);
+
+    // the index shares its storage, the completion table is copied
+    if (delete_index_ != 0)
+    {
+        shared->delete_index_ = new SymmetricDeleteIndex(*delete_index_);
+        shared->current_sugger_->use_delete_index(*shared->delete_index_);
+        for (std::vector<Speller*>::iterator tier = shared->cascade_.begin();
+             tier != shared->cascade_.end();
+             ++tier)
+        {
+            (*tier)->use_delete_index(*shared->delete_index_);
+        }
+    }
+    if (current_speller_ != 0)
+    {
+        shared->current_speller_->completion_table =
+            current_speller_->completion_table;
+    }
+    shared->build_edit_distance();
+    shared->build_case_folding();
+    shared->build_tokenizer();
+    return shared;
 }
 
 void
@@ -309,86 +550,558 @@ ZHfstOspeller::set_beam(Weight beam)
     beam_ = beam;
 }
 
+void
+ZHfstOspeller::set_deepening_weight(Weight weight)
+{
+    deepening_weight_ = weight;
+}
+
+void
+ZHfstOspeller::set_cascade_minimum(uint64_t minimum)
+{
+    cascade_minimum_ = minimum;
+}
+
+void
+ZHfstOspeller::set_node_limit(uint64_t limit)
+{
+    node_limit_ = limit;
+}
+
+void
+ZHfstOspeller::set_arc_limit(uint64_t limit)
+{
+    arc_limit_ = limit;
+}
+
+void
+ZHfstOspeller::set_time_limit(double seconds)
+{
+    time_limit_ = seconds;
+}
+
+size_t
+ZHfstOspeller::automata_size() const
+{
+    size_t size = 0;
+    for (map<string, Transducer*>::const_iterator acceptor = acceptors_.begin();
+         acceptor != acceptors_.end();
+         ++acceptor)
+    {
+        size += acceptor->second->get_table_size();
+    }
+    for (map<string, Transducer*>::const_iterator errmodel = errmodels_.begin();
+         errmodel != errmodels_.end();
+         ++errmodel)
+    {
+        size += errmodel->second->get_table_size();
+    }
+    for (map<string, Transducer*>::const_iterator hyphenator = hyphenators_.begin();
+         hyphenator != hyphenators_.end();
+         ++hyphenator)
+    {
+        size += hyphenator->second->get_table_size();
+    }
+    if (delete_index_ != 0)
+    {
+        size += delete_index_->size();
+    }
+    if (current_speller_ != 0)
+    {
+        size += current_speller_->completion_table.size() *
+            sizeof(std::pair<TransitionTableIndex, Weight>);
+    }
+    return size;
+}
+
+void
+ZHfstOspeller::set_delete_index(uint32_t distance)
+{
+    delete_distance_ = distance;
+    build_delete_index();
+}
+
+void
+ZHfstOspeller::set_completion_table(bool completion_table)
+{
+    completion_table_ = completion_table;
+    build_completion_table();
+}
+
+void
+ZHfstOspeller::set_edit_distance(bool edit_distance)
+{
+    edit_distance_ = edit_distance;
+    build_edit_distance();
+}
+
+void
+ZHfstOspeller::set_case_folding(bool case_folding)
+{
+    case_folding_ = case_folding;
+    build_case_folding();
+}
+
+void
+ZHfstOspeller::set_mapping(int mapping)
+{
+    mapping_ = mapping;
+}
+
+bool
+ZHfstOspeller::suggestions_partial() const
+{
+    return partial_;
+}
+
+void
+ZHfstOspeller::set_budget(Speller* speller,
+                          std::chrono::steady_clock::time_point start)
+{
+    double seconds = 0.0;
+    if (time_limit_ > 0.0)
+    {
+        // the cascade shares one deadline
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        seconds = std::max(time_limit_ - elapsed.count(), 1e-9);
+    }
+    speller->set_budget(node_limit_, arc_limit_, seconds);
+}
+
 bool
-ZHfstOspeller::spell(const string& wordform)
+ZHfstOspeller::spell(const string& wordform, SearchStatistics* stats)
 {
+    if (stats != 0)
+    {
+        stats->clear();
+    }
     if (can_spell_ && (current_speller_ != 0))
     {
-        char* wf = strdup(wordform.c_str());
-        bool rv = current_speller_->check((int8_t*) wf);
-        free(wf);
-        return rv;
+        const char* wf = wordform.c_str();
+        return current_speller_->check(wf, wf + wordform.size(), stats);
+    }
+    return false;
+}
+
+bool
+ZHfstOspeller::spell(const std::u16string& wordform, SearchStatistics* stats)
+{
+    if (stats != 0)
+    {
+        stats->clear();
+    }
+    if (can_spell_ && (current_speller_ != 0))
+    {
+        const char16_t* wf = wordform.data();
+        return current_speller_->check(wf, wf + wordform.size(), stats);
+    }
+    return false;
+}
+
+bool
+ZHfstOspeller::spell(const std::u32string& wordform, SearchStatistics* stats)
+{
+    if (stats != 0)
+    {
+        stats->clear();
+    }
+    if (can_spell_ && (current_speller_ != 0))
+    {
+        const char32_t* wf = wordform.data();
+        return current_speller_->check(wf, wf + wordform.size(), stats);
     }
     return false;
 }
 
+std::vector<TextSpan>
+ZHfstOspeller::check_text(const string& text, SearchStatistics* stats)
+{
+    if (stats != 0)
+    {
+        stats->clear();
+    }
+    std::vector<TextSpan> misspelt;
+    if (!can_spell_ || (current_speller_ == 0))
+    {
+        return misspelt;
+    }
+    const char* begin = text.c_str();
+    std::vector<TextSpan> words;
+    tokenizer_.split(begin, text.size(), words);
+    for (std::vector<TextSpan>::const_iterator word = words.begin();
+         word != words.end();
+         ++word)
+    {
+        const char* start = begin + word->offset;
+        if (current_speller_->check(start, start + word->length, stats))
+        {
+            continue;
+        }
+        TextSpan trimmed = tokenizer_.trim(begin, *word);
+        if (trimmed.length != word->length)
+        {
+            start = begin + trimmed.offset;
+            if (current_speller_->check(start, start + trimmed.length,
+                                        stats))
+            {
+                continue;
+            }
+        }
+        misspelt.push_back(trimmed);
+    }
+    return misspelt;
+}
+
 CorrectionQueue
-ZHfstOspeller::suggest_queue(const string& wordform)
+ZHfstOspeller::suggest_queue(const string& wordform, SearchStatistics* stats)
 {
     CorrectionQueue rv;
+    partial_ = false;
     if ((can_correct_) && (current_sugger_ != 0))
     {
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
         char* wf = strdup(wordform.c_str());
+        uint64_t wanted = cascade_minimum_;
+        if (wanted == 0)
+        {
+            wanted = (suggestions_maximum_ > 0) ? suggestions_maximum_ : 1;
+        }
+        for (std::vector<Speller*>::iterator tier = cascade_.begin();
+             tier != cascade_.end();
+             ++tier)
+        {
+            set_budget(*tier, start);
+            (*tier)->set_deepening(deepening_weight_);
+            rv = (*tier)->correct((int8_t*) wf,
+                                  suggestions_maximum_,
+                                  maximum_weight_,
+                                  beam_,
+                                  stats);
+            partial_ = (*tier)->partial;
+            if (rv.size() >= wanted)
+            {
+                free(wf);
+                return rv;
+            }
+        }
+        set_budget(current_sugger_, start);
+        current_sugger_->set_deepening(deepening_weight_);
         rv = current_sugger_->correct((int8_t*) wf,
                                       suggestions_maximum_,
                                       maximum_weight_,
-                                      beam_);
+                                      beam_,
+                                      stats);
+        partial_ = current_sugger_->partial;
         free(wf);
         return rv;
     }
     return rv;
 }
 
+//! @brief @a corrections in capitals if @a wordform has two or more and
+//!        no small letters, or capitalised if it is, keeping the first of
+//!        those that come out the same
+static std::vector<StringWeightPair>
+match_case(const string& wordform,
+           const std::vector<StringWeightPair>& corrections)
+{
+    size_t capitals = 0;
+    bool small = false;
+    bool capitalised = false;
+    for (size_t i = 0; i < wordform.size(); )
+    {
+        uint8_t lead = static_cast<uint8_t>(wordform[i]);
+        size_t bytes = std::max(nByte_utf8(lead), 1);
+        string letter = wordform.substr(i, bytes);
+        i += bytes;
+        if (utf8_to_lower(letter) != letter)
+        {
+            capitalised = capitalised || (capitals == 0 && !small);
+            ++capitals;
+        }
+        else if (utf8_to_upper(letter) != letter)
+        {
+            small = true;
+        }
+    }
+    bool all_capitals = (capitals > 1) && !small;
+    if (!all_capitals && !capitalised)
+    {
+        return corrections;
+    }
+    std::vector<StringWeightPair> matched;
+    std::set<string> seen;
+    for (std::vector<StringWeightPair>::const_iterator it = corrections.begin();
+         it != corrections.end();
+         ++it)
+    {
+        string correction = it->first;
+        if (all_capitals)
+        {
+            correction = utf8_to_upper(correction);
+        }
+        else if (!correction.empty())
+        {
+            uint8_t lead = static_cast<uint8_t>(correction[0]);
+            size_t bytes = std::max(nByte_utf8(lead), 1);
+            correction.replace(0, bytes,
+                               utf8_to_upper(correction.substr(0, bytes)));
+        }
+        if (seen.insert(correction).second)
+        {
+            matched.push_back(StringWeightPair(correction, it->second));
+        }
+    }
+    return matched;
+}
+
+std::vector<StringWeightPair>
+ZHfstOspeller::suggest(const string& wordform, SearchStatistics* stats)
+{
+    if (stats != 0)
+    {
+        stats->clear();
+    }
+    std::vector<StringWeightPair> rv =
+        suggest_queue(wordform, stats).clone_container();
+    return case_folding_ ? match_case(wordform, rv) : rv;
+}
+
+//! @brief @a corrections with each string changed by @a recode
+template <typename S>
+static std::vector<std::pair<S, Weight> >
+recode_corrections(const std::vector<StringWeightPair>& corrections,
+                   S (*recode)(const string&))
+{
+    std::vector<std::pair<S, Weight> > recoded;
+    recoded.reserve(corrections.size());
+    for (std::vector<StringWeightPair>::const_iterator it =
+             corrections.begin();
+         it != corrections.end();
+         ++it)
+    {
+        recoded.push_back(std::make_pair(recode(it->first), it->second));
+    }
+    return recoded;
+}
+
+std::vector<U16StringWeightPair>
+ZHfstOspeller::suggest(const std::u16string& wordform,
+                       SearchStatistics* stats)
+{
+    return recode_corrections(suggest(utf16_to_utf8(wordform), stats),
+                              utf8_to_utf16);
+}
+
+std::vector<U32StringWeightPair>
+ZHfstOspeller::suggest(const std::u32string& wordform,
+                       SearchStatistics* stats)
+{
+    return recode_corrections(suggest(utf32_to_utf8(wordform), stats),
+                              utf8_to_utf32);
+}
+
+std::vector<StringWeightPair>
+ZHfstOspeller::complete(const string& prefix, size_t n, SearchStatistics* stats)
+{
+    if (stats != 0)
+    {
+        stats->clear();
+    }
+    partial_ = false;
+    if ((!can_spell_) || (current_speller_ == 0))
+    {
+        return std::vector<StringWeightPair>();
+    }
+    set_budget(current_speller_, std::chrono::steady_clock::now());
+    char* wf = strdup(prefix.c_str());
+    CorrectionQueue rv = current_speller_->complete((int8_t*) wf, n,
+                                                    maximum_weight_, stats);
+    partial_ = current_speller_->partial;
+    free(wf);
+    return rv.clone_container();
+}
+
+std::vector<StringWeightPair>
+ZHfstOspeller::suggest_completions(const string& prefix, size_t n,
+                                   Weight symbol_weight,
+                                   SearchStatistics* stats)
+{
+    if (stats != 0)
+    {
+        stats->clear();
+    }
+    partial_ = false;
+    if ((!can_correct_) || (current_sugger_ == 0))
+    {
+        return std::vector<StringWeightPair>();
+    }
+    set_budget(current_sugger_, std::chrono::steady_clock::now());
+    char* wf = strdup(prefix.c_str());
+    CorrectionQueue rv = current_sugger_->correct_prefix((int8_t*) wf, n,
+                                                         maximum_weight_,
+                                                         symbol_weight,
+                                                         stats);
+    partial_ = current_sugger_->partial;
+    free(wf);
+    return case_folding_ ? match_case(prefix, rv.clone_container()) :
+        rv.clone_container();
+}
+
+CorrectionSession
+ZHfstOspeller::start_session(void)
+{
+    return CorrectionSession(can_correct_ ? current_sugger_ : 0);
+}
+
 std::vector<StringWeightPair>
-ZHfstOspeller::suggest(const string& wordform)
+ZHfstOspeller::suggest(CorrectionSession& session, const string& wordform,
+                       SearchStatistics* stats)
 {
-    return suggest_queue(wordform).clone_container();
+    if (stats != 0)
+    {
+        stats->clear();
+    }
+    partial_ = false;
+    if ((!can_correct_) || (current_sugger_ == 0))
+    {
+        return std::vector<StringWeightPair>();
+    }
+    set_budget(current_sugger_, std::chrono::steady_clock::now());
+    char* wf = strdup(wordform.c_str());
+    CorrectionQueue rv = session.correct((int8_t*) wf,
+                                         suggestions_maximum_,
+                                         maximum_weight_,
+                                         beam_,
+                                         stats);
+    partial_ = current_sugger_->partial;
+    free(wf);
+    return case_folding_ ? match_case(wordform, rv.clone_container()) :
+        rv.clone_container();
 }
 
 AnalysisQueue
-ZHfstOspeller::analyse_queue(const string& wordform, bool ask_sugger)
+ZHfstOspeller::analyse_queue(const string& wordform, bool ask_sugger,
+                             SearchStatistics* stats)
 {
     AnalysisQueue rv;
     char* wf = strdup(wordform.c_str());
     if ((can_analyse_) && (!ask_sugger) && (current_speller_ != 0))
     {
-        rv = current_speller_->analyse((int8_t*) wf);
+        rv = current_speller_->analyse((int8_t*) wf, stats);
     }
     else if ((can_analyse_) && (ask_sugger) && (current_sugger_ != 0))
     {
-        rv = current_sugger_->analyse((int8_t*) wf);
+        rv = current_sugger_->analyse((int8_t*) wf, stats);
     }
     free(wf);
     return rv;
 }
 
 std::vector<StringWeightPair>
-ZHfstOspeller::analyse(const string& wordform, bool ask_sugger)
+ZHfstOspeller::analyse(const string& wordform, bool ask_sugger,
+                       SearchStatistics* stats)
 {
-    return analyse_queue(wordform, ask_sugger).clone_container();
+    if (stats != 0)
+    {
+        stats->clear();
+    }
+    return analyse_queue(wordform, ask_sugger, stats).clone_container();
 }
 
 std::vector<StringPairWeightPair>
-ZHfstOspeller::suggest_analyses(const string& wordform)
+ZHfstOspeller::suggest_analyses(const string& wordform,
+                                SearchStatistics* stats)
 {
+    if (stats != 0)
+    {
+        stats->clear();
+    }
     AnalysisCorrectionQueue rv;
-    // FIXME: should be atomic
-    CorrectionQueue cq = suggest_queue(wordform);
-    while (cq.size() > 0)
+    partial_ = false;
+    if ((can_correct_) && (can_analyse_) && (current_sugger_ != 0))
     {
-        AnalysisQueue aq = analyse_queue(cq.top().first, true);
-        while (aq.size() > 0)
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        char* wf = strdup(wordform.c_str());
+        uint64_t wanted = cascade_minimum_;
+        if (wanted == 0)
+        {
+            wanted = (suggestions_maximum_ > 0) ? suggestions_maximum_ : 1;
+        }
+        for (std::vector<Speller*>::iterator tier = cascade_.begin();
+             tier != cascade_.end();
+             ++tier)
         {
-            StringPair sp(cq.top().first, aq.top().first);
-            StringPairWeightPair spwp(sp, aq.top().second);
-            rv.push(spwp);
-            aq.pop();
+            set_budget(*tier, start);
+            rv = (*tier)->correct_analyse((int8_t*) wf,
+                                          suggestions_maximum_,
+                                          maximum_weight_,
+                                          beam_,
+                                          stats);
+            partial_ = (*tier)->partial;
+            // count corrections, not analyses
+            std::set<std::string> corrections;
+            std::vector<StringPairWeightPair> pairs = rv.clone_container();
+            for (std::vector<StringPairWeightPair>::iterator it = pairs.begin();
+                 it != pairs.end();
+                 ++it)
+            {
+                corrections.insert(it->first.first);
+            }
+            if (corrections.size() >= wanted)
+            {
+                free(wf);
+                return pairs;
+            }
         }
-        cq.pop();
+        set_budget(current_sugger_, start);
+        rv = current_sugger_->correct_analyse((int8_t*) wf,
+                                              suggestions_maximum_,
+                                              maximum_weight_,
+                                              beam_,
+                                              stats);
+        partial_ = current_sugger_->partial;
+        free(wf);
     }
     return rv.clone_container();
 }
 
+HyphenationQueue
+ZHfstOspeller::hyphenate_queue(const string& wordform)
+{
+    HyphenationQueue rv;
+    if ((can_hyphenate_) && (current_hyphenator_ != 0))
+    {
+        char* wf = strdup(wordform.c_str());
+        rv = current_hyphenator_->hyphenate((int8_t*) wf);
+        free(wf);
+    }
+    return rv;
+}
+
+std::vector<StringWeightPair>
+ZHfstOspeller::hyphenate(const string& wordform)
+{
+    return hyphenate_queue(wordform).clone_container();
+}
+
+std::vector<std::vector<StringWeightPair> >
+ZHfstOspeller::hyphenate(const std::vector<std::string>& wordforms)
+{
+    std::vector<std::vector<StringWeightPair> > rv;
+    rv.reserve(wordforms.size());
+    for (std::vector<std::string>::const_iterator wordform = wordforms.begin();
+         wordform != wordforms.end();
+         ++wordform)
+    {
+        rv.push_back(hyphenate_queue(*wordform).clone_container());
+    }
+    return rv;
+}
+
 void
 ZHfstOspeller::set_temporary_dir(const string& tempdir)
 {
@@ -400,6 +1113,12 @@ void
 ZHfstOspeller::clear_suggestion_cache(void)
 {
     current_sugger_->clear_cache();
+    for (std::vector<Speller*>::iterator tier = cascade_.begin();
+         tier != cascade_.end();
+         ++tier)
+    {
+        (*tier)->clear_cache();
+    }
 }
 #endif
 
@@ -447,6 +1166,10 @@ ZHfstOspeller::read_zhfst(const string& filename)
         {
             trans = load_errmodel(ar, entry, filename, tempdir);
         }
+        else if (strncmp(filename, "hyphenator.", strlen("hyphenator.")) == 0)
+        {
+            trans = load_hyphenator(ar, entry, filename, tempdir);
+        }
         else if (strcmp(filename, "index.xml") == 0)
         {
         #if ZHFST_EXTRACT_TO_TMPDIR
@@ -513,6 +1236,22 @@ ZHfstOspeller::read_zhfst(const string& filename)
         throw ZHfstZipReadingError("No automata found in zip");
     }
     can_analyse_ = can_spell_ | can_correct_;
+    build_cascade();
+    build_edit_distance();
+    build_delete_index();
+    build_completion_table();
+    build_case_folding();
+    build_tokenizer();
+
+    if (hyphenators_.find("default") != hyphenators_.end())
+    {
+        current_hyphenator_ = new Hyphenator(hyphenators_["default"]);
+    }
+    else if (hyphenators_.size() > 0)
+    {
+        current_hyphenator_ = new Hyphenator(hyphenators_.begin()->second);
+    }
+    can_hyphenate_ = (current_hyphenator_ != 0);
 
     return tempdir;
 #else
@@ -520,6 +1259,152 @@ ZHfstOspeller::read_zhfst(const string& filename)
 #endif // HAVE_LIBARCHIVE
 }
 
+void
+ZHfstOspeller::build_cascade()
+{
+    // Error models typed "cascade" in index.xml are cheap first passes over
+    // the same lexicon, e.g. edit distance 1 or a keyboard model; the
+    // default model is only searched when they don't give enough results.
+    if (!can_correct_ || (current_sugger_ == 0))
+    {
+        return;
+    }
+    for (std::vector<ZHfstOspellerErrModelMetadata>::const_iterator errm =
+             metadata_.errmodel_.begin();
+         errm != metadata_.errmodel_.end();
+         ++errm)
+    {
+        if (std::find(errm->type_.begin(), errm->type_.end(), "cascade") ==
+            errm->type_.end())
+        {
+            continue;
+        }
+        // id is errmodel.DESCR.hfst, errmodels_ is keyed by the DESCR
+        size_t first_dot = errm->id_.find('.');
+        size_t second_dot = errm->id_.find('.', first_dot + 1);
+        if ((first_dot == string::npos) || (second_dot == string::npos))
+        {
+            continue;
+        }
+        string descr = errm->id_.substr(first_dot + 1,
+                                        second_dot - first_dot - 1);
+        map<string, Transducer*>::iterator errmodel = errmodels_.find(descr);
+        if ((errmodel == errmodels_.end()) ||
+            (errmodel->second == current_sugger_->mutator))
+        {
+            continue;
+        }
+        cascade_.push_back(new Speller(errmodel->second,
+                                       current_sugger_->lexicon));
+    }
+}
+
+void
+ZHfstOspeller::build_delete_index()
+{
+    // the spellers only point to the index, so detach them first
+    if (current_sugger_ != 0)
+    {
+        current_sugger_->delete_index = 0;
+    }
+    for (std::vector<Speller*>::iterator tier = cascade_.begin();
+         tier != cascade_.end();
+         ++tier)
+    {
+        (*tier)->delete_index = 0;
+    }
+    delete delete_index_;
+    delete_index_ = 0;
+    // cyclic acceptors have no finite list of words to index
+    if ((delete_distance_ == 0) || !can_correct_ || (current_sugger_ == 0) ||
+        current_sugger_->lexicon->get_header()->probe_flag(Cyclic))
+    {
+        return;
+    }
+    try
+    {
+        delete_index_ = new SymmetricDeleteIndex(
+            SymmetricDeleteIndex::build(*current_sugger_->lexicon,
+                                        delete_distance_));
+    }
+    catch (SymmetricDeleteIndexError& e)
+    {
+        // e.g. unknown symbols; the acceptor is searched as before
+        return;
+    }
+    current_sugger_->use_delete_index(*delete_index_);
+    for (std::vector<Speller*>::iterator tier = cascade_.begin();
+         tier != cascade_.end();
+         ++tier)
+    {
+        (*tier)->use_delete_index(*delete_index_);
+    }
+}
+
+void
+ZHfstOspeller::build_completion_table()
+{
+    if (current_speller_ == 0)
+    {
+        return;
+    }
+    if (completion_table_)
+    {
+        current_speller_->build_completion_table();
+    }
+    else
+    {
+        std::vector<std::pair<TransitionTableIndex, Weight> >().swap(
+            current_speller_->completion_table);
+    }
+}
+
+void
+ZHfstOspeller::build_edit_distance()
+{
+    if (current_sugger_ != 0)
+    {
+        current_sugger_->use_edit_distance(edit_distance_);
+    }
+    for (std::vector<Speller*>::iterator tier = cascade_.begin();
+         tier != cascade_.end();
+         ++tier)
+    {
+        (*tier)->use_edit_distance(edit_distance_);
+    }
+}
+
+void
+ZHfstOspeller::build_case_folding()
+{
+    if (current_speller_ != 0)
+    {
+        current_speller_->set_case_folding(case_folding_);
+    }
+    if ((current_sugger_ != 0) && (current_sugger_ != current_speller_))
+    {
+        current_sugger_->set_case_folding(case_folding_);
+    }
+    for (std::vector<Speller*>::iterator tier = cascade_.begin();
+         tier != cascade_.end();
+         ++tier)
+    {
+        (*tier)->set_case_folding(case_folding_);
+    }
+}
+
+void
+ZHfstOspeller::build_tokenizer()
+{
+    if (current_speller_ == 0)
+    {
+        tokenizer_ = TextTokenizer();
+        return;
+    }
+    Transducer* input = (current_speller_->mutator != 0) ?
+        current_speller_->mutator : current_speller_->lexicon;
+    tokenizer_ = TextTokenizer(*input->get_key_table());
+}
 
 const ZHfstOspellerXmlMetadata&
 ZHfstOspeller::get_metadata() const
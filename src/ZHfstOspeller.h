@@ -37,6 +37,7 @@
 
 #include "ospell.h"
 #include "hfst-ol.h"
+#include "TextTokenizer.h"
 #include "ZHfstOspellerXmlMetadata.h"
 
 namespace hfst_ol
@@ -56,9 +57,11 @@ public:
     //!        zhfst archive.
     ZHfstOspeller(const std::string& filename);
 
-    //! @brief construct speller from acceptor and error model files.
+    //! @brief construct speller from acceptor and error model files,
+    //!        mapped into memory as @a mapping says.
     ZHfstOspeller(const std::string& acceptorFn,
-                  const std::string& errmodelFn);
+                  const std::string& errmodelFn,
+                  int mapping=MapDefault);
 
     //! @brief destroy all automata used by the speller.
     ~ZHfstOspeller();
@@ -72,36 +75,155 @@ public:
     void set_weight_limit(Weight limit);
     //! @brief set search beam
     void set_beam(Weight beam);
+    //! @brief without a weight limit or beam, search up to @a weight
+    //!        first and double it until the queue limit is reached.
+    //!
+    //! The suggestions stay the same; zero turns this off.
+    void set_deepening_weight(Weight weight);
+    //! @brief set how many suggestions a cascade error model must give
+    //!        before the more expensive models are skipped.
+    //!
+    //! Zero means the queue limit, or one if there is no queue limit.
+    void set_cascade_minimum(uint64_t minimum);
+    //! @brief set how many search nodes one suggestion may expand,
+    //!        zero for no limit
+    void set_node_limit(uint64_t limit);
+    //! @brief set how many arcs one suggestion may scan, zero for no limit
+    void set_arc_limit(uint64_t limit);
+    //! @brief set how many seconds one suggestion may take over all
+    //!        error models, zero for no limit
+    void set_time_limit(double seconds);
+    //! @brief whether the last suggestion ran out of its node, arc or
+    //!        time limit and gave only the best results found by then
+    bool suggestions_partial() const;
+    //! @brief set how automata read later are mapped into memory,
+    //!        a combination of MappingFlags
+    //!
+    //! Only automata extracted to files are mapped, so this does nothing
+    //! when archives are extracted to memory.
+    void set_mapping(int mapping);
+    //! @brief look corrections up in an index of the words of the
+    //!        acceptor under up to @a distance deletions, if its header
+    //!        says it is acyclic; zero to search it as usual.
+    //!
+    //! The index is built for the automata loaded now and later, and the
+    //! words found are weighted with the error models as before; only
+    //! words within @a distance edits can be found.
+    void set_delete_index(uint32_t distance);
+    //! @brief whether complete() searches by a table of the least weight
+    //!        from each state of the acceptor to a word.
+    //!
+    //! The table is built for the acceptor loaded now and later.
+    void set_completion_table(bool completion_table);
+    //! @brief whether error models that are a plain edit distance are
+    //!        searched as edit weights instead of as automata, as in
+    //!        Speller::use_edit_distance(), for the automata loaded now
+    //!        and later.
+    void set_edit_distance(bool edit_distance);
+    //! @brief whether spell() and suggest() read capitals as their small
+    //!        letters too, in one search of the automata loaded now and
+    //!        later.
+    //!
+    //! Suggestions for a word form in capitals are given in capitals and
+    //! for a capitalised one capitalised.
+    void set_case_folding(bool case_folding);
     //! @brief construct speller from named file containing valid
     //!        zhfst archive. Returns temp directory.
     std::string read_zhfst(const std::string& filename);
+    //! @brief a new speller over the automata of this one, with the same
+    //!        settings and search state of its own.
+    //!
+    //! The tables of the automata are shared and only their alphabets are
+    //! copied, so one archive read can serve a speller per thread. The
+    //! automata of inject_speller() are not known here, so sharing a
+    //! speller given one throws ZHfstException. The caller deletes the new
+    //! speller; the tables live until the last speller using them is
+    //! deleted.
+    ZHfstOspeller* share() const;
 
     void set_temporary_dir(const std::string& tempdir);
 
     //! @brief  check if the given word is spelled correctly
-    bool spell(const std::string& wordform);
+    //!
+    //! If @a stats is given, it is cleared and filled with the work done
+    //! by this call; the same holds for the other queries below.
+    bool spell(const std::string& wordform, SearchStatistics* stats=0);
+    //! @brief check a utf-16 word form, tokenized as it is
+    bool spell(const std::u16string& wordform, SearchStatistics* stats=0);
+    //! @brief check a utf-32 word form, tokenized as it is
+    bool spell(const std::u32string& wordform, SearchStatistics* stats=0);
+    //! @brief check every word of the running utf-8 @a text and give the
+    //!        misspelt ones as spans of it, in order.
+    //!
+    //! Words are split at spaces and at punctuation the automata don't
+    //! have as symbols, and checked where they lie in @a text. A word that
+    //! is not accepted is checked again without punctuation at its edges,
+    //! and the span given is that of the trimmed word.
+    std::vector<TextSpan> check_text(const std::string& text,
+                                     SearchStatistics* stats=0);
     //! @brief construct an ordered set of corrections for misspelled
     //!        word form.
     std::vector<StringWeightPair>
-    suggest(const std::string& wordform);
+    suggest(const std::string& wordform, SearchStatistics* stats=0);
+    //! @brief suggest() for a utf-16 word form, with utf-16 corrections
+    std::vector<U16StringWeightPair>
+    suggest(const std::u16string& wordform, SearchStatistics* stats=0);
+    //! @brief suggest() for a utf-32 word form, with utf-32 corrections
+    std::vector<U32StringWeightPair>
+    suggest(const std::u32string& wordform, SearchStatistics* stats=0);
+    //! @brief start correcting a word as it is typed, valid until other
+    //!        automata are loaded
+    CorrectionSession start_session(void);
+    //! @brief construct corrections for @a wordform as suggest() does,
+    //!        reusing the search @a session kept for its previous word.
+    //!
+    //! Only the last correction model is searched, not the cascade.
+    std::vector<StringWeightPair>
+    suggest(CorrectionSession& session, const std::string& wordform,
+            SearchStatistics* stats=0);
+    //! @brief complete @a prefix into the @a n lightest words of the
+    //!        acceptor, or all of them if @a n is 0.
+    //!
+    //! The weight limit and the node, arc and time limits apply.
+    std::vector<StringWeightPair>
+    complete(const std::string& prefix, size_t n, SearchStatistics* stats=0);
+    //! @brief complete corrections of @a prefix into the @a n lightest
+    //!        words, each symbol completed weighing @a symbol_weight.
+    //!
+    //! The last correction model is used with the limits of suggest().
+    std::vector<StringWeightPair>
+    suggest_completions(const std::string& prefix, size_t n,
+                        Weight symbol_weight=0.0, SearchStatistics* stats=0);
     //! @brief analyse word form morphologically
     //! @param wordform   the string to analyse
     //! @param ask_sugger whether to use the spelling correction model
     //                    instead of the detection model
+    //! @param stats      counters for the search, or 0
     std::vector<StringWeightPair>
-    analyse(const std::string& wordform, bool ask_sugger=false);
+    analyse(const std::string& wordform, bool ask_sugger=false,
+            SearchStatistics* stats=0);
     //! @brief construct an ordered set of corrections with analyses
+    //!
+    //! Corrections and analyses come from one search over the error model
+    //! and the two-tape language model, weighted by the whole path.
     std::vector<StringPairWeightPair>
-    suggest_analyses(const std::string& wordform);
+    suggest_analyses(const std::string& wordform, SearchStatistics* stats=0);
     //! @brief hyphenate word form
     std::vector<StringWeightPair>
     hyphenate(const std::string& wordform);
+    //! @brief hyphenate all word forms, e.g. of a whole document
+    std::vector<std::vector<StringWeightPair> >
+    hyphenate(const std::vector<std::string>& wordforms);
 
     #if USE_CACHE
     //! @brief Clears the internal cache (to free up memory)
     void clear_suggestion_cache(void);
     #endif
 
+    //! @brief memory taken by the tables of the automata loaded, by the
+    //!        delete index and by the completion table
+    size_t automata_size() const;
+
     //! @brief get access to metadata read from XML.
     const ZHfstOspellerXmlMetadata& get_metadata() const;
     //! @brief create string representation of the speller for
@@ -117,6 +239,31 @@ private:
     Weight maximum_weight_;
     //! @brief upper bound for search beam around best candidate
     Weight beam_;
+    //! @brief first weight limit of unlimited n-best suggestions, or 0
+    Weight deepening_weight_;
+    //! @brief suggestions needed from a cascade model to stop there
+    uint64_t cascade_minimum_;
+    //! @brief upper bound for nodes expanded per suggestion
+    uint64_t node_limit_;
+    //! @brief upper bound for arcs scanned per suggestion
+    uint64_t arc_limit_;
+    //! @brief upper bound for seconds spent per suggestion
+    double time_limit_;
+    //! @brief whether the last suggestion was cut short
+    bool partial_;
+    //! @brief MappingFlags for automata read from files
+    int mapping_;
+    //! @brief deletions of the words in the delete index, 0 for none
+    uint32_t delete_distance_;
+    //! @brief words of the acceptor for the correction models, or 0
+    SymmetricDeleteIndex* delete_index_;
+    //! @brief whether the acceptor gets a table for completions
+    bool completion_table_;
+    //! @brief whether plain edit distance error models are searched as
+    //!        edit weights
+    bool edit_distance_;
+    //! @brief whether the spellers read capitals as small letters too
+    bool case_folding_;
     //! @brief whether automatons loaded yet can be used to check
     //!        spelling
     bool can_spell_;
@@ -133,23 +280,42 @@ private:
     std::map<std::string, Transducer*> acceptors_;
     //! @brief error models loaded
     std::map<std::string, Transducer*> errmodels_;
+    //! @brief hyphenators loaded
+    std::map<std::string, Transducer*> hyphenators_;
     //! @brief pointer to current speller
     Speller* current_speller_;
     //! @brief pointer to current correction model
     Speller* current_sugger_;
+    //! @brief cheaper correction models tried before current_sugger_,
+    //!        in the order they appear in index.xml
+    std::vector<Speller*> cascade_;
     //! @brief pointer to current morphological analyser
     Speller* current_analyser_;
     //! @brief pointer to current hyphenator
-    Transducer* current_hyphenator_;
+    Hyphenator* current_hyphenator_;
+    //! @brief splits text into words for current_speller_
+    TextTokenizer tokenizer_;
     //! @brief the metadata of loaded speller
     ZHfstOspellerXmlMetadata metadata_;
     //! @brief temporary directory for files
     std::string tmp_prefix_;
 
-    CorrectionQueue suggest_queue(const std::string& wordform);
-    AnalysisQueue analyse_queue(const std::string& wordform, bool ask_sugger);
+    CorrectionQueue suggest_queue(const std::string& wordform,
+                                  SearchStatistics* stats=0);
+    void build_cascade();
+    void build_delete_index();
+    void build_completion_table();
+    void build_edit_distance();
+    void build_case_folding();
+    void build_tokenizer();
+    void set_budget(Speller* speller,
+                    std::chrono::steady_clock::time_point start);
+    AnalysisQueue analyse_queue(const std::string& wordform, bool ask_sugger,
+                                SearchStatistics* stats=0);
+    HyphenationQueue hyphenate_queue(const std::string& wordform);
     Transducer* load_acceptor(struct archive* ar, struct archive_entry* entry, const char* filename, const std::string& tempdir);
     Transducer* load_errmodel(struct archive* ar, struct archive_entry* entry, const char* filename, const std::string& tempdir);
+    Transducer* load_hyphenator(struct archive* ar, struct archive_entry* entry, const char* filename, const std::string& tempdir);
 };
 
 //! @brief Top-level exception for zhfst handling.
@@ -16,9 +16,46 @@
 %template(StringPairWeightPair) std::pair<std::pair<std::string, std::string>, Weight>;
 %template(StringWeightPairVector) std::vector<std::pair<std::string, Weight> >;
 %template(StringPairWeightPairVector) std::vector<std::pair<std::pair<std::string, std::string>, Weight> >;
+%template(StringVector) std::vector<std::string>;
+%template(StringWeightPairVectorVector) std::vector<std::vector<std::pair<std::string, Weight> > >;
+
+// Java strings are utf-16, so std::u16string maps to String by its
+// code units as they are, without the conversion to modified utf-8
+%naturalvar std::u16string;
+%typemap(jni) std::u16string, const std::u16string& "jstring"
+%typemap(jtype) std::u16string, const std::u16string& "String"
+%typemap(jstype) std::u16string, const std::u16string& "String"
+%typemap(javain) std::u16string, const std::u16string& "$javainput"
+%typemap(javaout) std::u16string, const std::u16string& {
+    return $jnicall;
+}
+%typemap(in) const std::u16string& (std::u16string units) %{
+    if (!$input) {
+        SWIG_JavaThrowException(jenv, SWIG_JavaNullPointerException, "null string");
+        return $null;
+    }
+    {
+        const jchar* chars = jenv->GetStringChars($input, 0);
+        if (!chars) return $null;
+        units.assign(reinterpret_cast<const char16_t*>(chars), jenv->GetStringLength($input));
+        jenv->ReleaseStringChars($input, chars);
+    }
+    $1 = &units;
+%}
+%typemap(out) std::u16string %{
+    $result = jenv->NewString(reinterpret_cast<const jchar*>($1.data()), $1.size());
+%}
+%typemap(out) const std::u16string& %{
+    $result = jenv->NewString(reinterpret_cast<const jchar*>($1->data()), $1->size());
+%}
+
+%template(U16StringWeightPair) std::pair<std::u16string, Weight>;
+%template(U16StringWeightPairVector) std::vector<std::pair<std::u16string, Weight> >;
 
 #define StringWeightPair std::pair<std::string, Weight>
 #define StringPairWeightPair std::pair<std::pair<std::string, std::string>, Weight>
+#define U16StringWeightPair std::pair<std::u16string, Weight>
+#define U32StringWeightPair std::pair<std::u32string, Weight>
 
 %{
 #include "hfst-ol.h"
@@ -52,9 +89,15 @@
 
 %ignore hfst_ol::ZHfstOspeller::inject_speller(Speller *s);
 %ignore hfst_ol::ZHfstOspeller::get_metadata() const;
-
-// BUG: SWIG bugs up with this method for some reason and makes linker errors
-%ignore hfst_ol::ZHfstOspeller::hyphenate(const std::string& wordform);
+%ignore hfst_ol::ZHfstOspeller::spell(const std::u32string&, hfst_ol::SearchStatistics*);
+%ignore hfst_ol::ZHfstOspeller::spell(const std::u32string&);
+%ignore hfst_ol::ZHfstOspeller::suggest(const std::u32string&, hfst_ol::SearchStatistics*);
+%ignore hfst_ol::ZHfstOspeller::suggest(const std::u32string&);
+// String in, String out either way; these skip the utf-8 round trip
+%rename(spellUtf16) hfst_ol::ZHfstOspeller::spell(const std::u16string&, hfst_ol::SearchStatistics*);
+%rename(spellUtf16) hfst_ol::ZHfstOspeller::spell(const std::u16string&);
+%rename(suggestUtf16) hfst_ol::ZHfstOspeller::suggest(const std::u16string&, hfst_ol::SearchStatistics*);
+%rename(suggestUtf16) hfst_ol::ZHfstOspeller::suggest(const std::u16string&);
 
 %include "ZHfstOspeller.h"
 
@@ -0,0 +1,185 @@
+// Copyright 2010 University of Helsinki
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <sys/stat.h>
+
+#include "ZHfstOspellerRegistry.h"
+
+namespace hfst_ol
+{
+
+ZHfstOspellerRegistry::ZHfstOspellerRegistry(size_t memory_budget,
+                                             int mapping) :
+    memory_budget_(memory_budget),
+    memory_used_(0),
+    mapping_(mapping)
+{
+}
+
+//! @brief a speller of its own over the automata of @a model, keeping
+//!        @a model loaded until the speller is deleted
+static ZHfstOspellerRegistry::Handle
+share_model(const std::shared_ptr<ZHfstOspellerRegistry::Model>& model)
+{
+    return ZHfstOspellerRegistry::Handle(model->speller.share(),
+                                         [model](ZHfstOspeller* speller)
+                                         {
+                                             delete speller;
+                                         });
+}
+
+ZHfstOspellerRegistry::Handle
+ZHfstOspellerRegistry::acquire(const std::string& path)
+{
+    struct stat statbuf;
+    if (stat(path.c_str(), &statbuf) == -1)
+    {
+        throw ZHfstZipReadingError("cannot read " + path);
+    }
+    std::shared_ptr<Model> model;
+    int mapping;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<std::string, std::shared_ptr<Model> >::iterator found =
+            models_.find(path);
+        if (found != models_.end())
+        {
+            recent_.remove(path);
+            if (found->second->mtime == statbuf.st_mtime)
+            {
+                recent_.push_front(path);
+                model = found->second;
+            }
+            else
+            {
+                // changed on disk; spellers of the old one keep it alive
+                memory_used_ -= found->second->bytes;
+                models_.erase(found);
+            }
+        }
+        mapping = mapping_;
+    }
+    if (model)
+    {
+        // sharing only reads the loaded speller, so it needs no lock
+        return share_model(model);
+    }
+    // reading takes long, let other languages be acquired meanwhile
+    model.reset(new Model);
+    model->speller.set_mapping(mapping);
+    model->speller.read_zhfst(path);
+    model->path = path;
+    model->mtime = statbuf.st_mtime;
+    model->bytes = model->speller.automata_size();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<std::string, std::shared_ptr<Model> >::iterator found =
+            models_.find(path);
+        if (found != models_.end() && found->second->mtime == model->mtime)
+        {
+            // another thread read it first, share that one
+            model = found->second;
+        }
+        else
+        {
+            if (found != models_.end())
+            {
+                memory_used_ -= found->second->bytes;
+                recent_.remove(path);
+            }
+            models_[path] = model;
+            recent_.push_front(path);
+            memory_used_ += model->bytes;
+            if (memory_budget_ > 0)
+            {
+                evict(memory_budget_);
+            }
+        }
+    }
+    return share_model(model);
+}
+
+void
+ZHfstOspellerRegistry::set_memory_budget(size_t memory_budget)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    memory_budget_ = memory_budget;
+    if (memory_budget_ > 0)
+    {
+        evict(memory_budget_);
+    }
+}
+
+void
+ZHfstOspellerRegistry::set_mapping(int mapping)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    mapping_ = mapping;
+}
+
+void
+ZHfstOspellerRegistry::unload_idle()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    evict(0);
+}
+
+size_t
+ZHfstOspellerRegistry::memory_used() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return memory_used_;
+}
+
+size_t
+ZHfstOspellerRegistry::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return models_.size();
+}
+
+ZHfstOspellerRegistry&
+ZHfstOspellerRegistry::instance()
+{
+    static ZHfstOspellerRegistry registry;
+    return registry;
+}
+
+void
+ZHfstOspellerRegistry::evict(size_t budget)
+{
+    // from the least recently acquired end
+    std::list<std::string>::iterator path = recent_.end();
+    while (path != recent_.begin() && (budget == 0 || memory_used_ > budget))
+    {
+        --path;
+        std::map<std::string, std::shared_ptr<Model> >::iterator model =
+            models_.find(*path);
+        // models are only copied out of the map under the lock, so an
+        // archive seen idle here cannot be taken before it is erased
+        if (model->second.use_count() == 1)
+        {
+            memory_used_ -= model->second->bytes;
+            models_.erase(model);
+            path = recent_.erase(path);
+        }
+    }
+}
+
+} // namespace hfst_ol
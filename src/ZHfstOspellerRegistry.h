@@ -0,0 +1,107 @@
+/* -*- Mode: C++ -*- */
+// Copyright 2010 University of Helsinki
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef HFST_OSPELL_ZHFSTOSPELLERREGISTRY_H_
+#define HFST_OSPELL_ZHFSTOSPELLERREGISTRY_H_
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <ctime>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "ZHfstOspeller.h"
+
+namespace hfst_ol
+{
+//! @brief Process-wide cache of spellers loaded from zhfst archives.
+//!
+//! Each archive is loaded once per path and modification time. Every
+//! acquire gives a speller of its own over the automata of the archive,
+//! so callers never wait on each other; acquire once per thread rather
+//! than once per word. When the automata of all loaded archives take more
+//! memory than the budget, archives that no speller uses any more are
+//! unloaded, least recently acquired first.
+class ZHfstOspellerRegistry
+{
+public:
+    //! @brief a loaded archive
+    struct Model
+    {
+        //! the speller read from @c path, only shared and never queried
+        ZHfstOspeller speller;
+        std::string path; //!< archive the speller was read from
+        time_t mtime; //!< modification time of the archive when read
+        size_t bytes; //!< memory taken by the automata
+    };
+    //! @brief a speller for one caller, keeping its archive loaded
+    typedef std::shared_ptr<ZHfstOspeller> Handle;
+
+    //! @brief create registry keeping at most @a memory_budget bytes of
+    //!        idle automata loaded, zero for no limit, and reading
+    //!        archives with @a mapping.
+    explicit ZHfstOspellerRegistry(size_t memory_budget=0,
+                                   int mapping=MapDefault);
+
+    //! @brief get a new speller for archive @a path, loading the archive
+    //!        if it is not loaded or has changed on disk since.
+    //!
+    //! The speller shares the automata of every other speller of the
+    //! archive and has its own settings and search state.
+    //!
+    //! Throws ZHfstZipReadingError if @a path cannot be read and the
+    //! exceptions of ZHfstOspeller::read_zhfst() if it cannot be loaded.
+    Handle acquire(const std::string& path);
+
+    //! @brief change the memory budget and unload what no longer fits
+    void set_memory_budget(size_t memory_budget);
+
+    //! @brief set how archives read later are mapped into memory, as in
+    //!        ZHfstOspeller::set_mapping()
+    void set_mapping(int mapping);
+
+    //! @brief unload every archive without spellers in use
+    void unload_idle();
+
+    //! @brief memory taken by the automata of the loaded archives
+    size_t memory_used() const;
+
+    //! @brief number of archives loaded
+    size_t size() const;
+
+    //! @brief the registry shared by the whole process
+    static ZHfstOspellerRegistry& instance();
+
+private:
+    //! @brief unload idle archives until under @a budget, or all idle
+    //!        archives if @a budget is zero; the lock must be held
+    void evict(size_t budget);
+
+    mutable std::mutex mutex_;
+    size_t memory_budget_;
+    size_t memory_used_;
+    int mapping_;
+    std::map<std::string, std::shared_ptr<Model> > models_; //!< by path
+    std::list<std::string> recent_; //!< paths, most recently acquired first
+};
+
+} // namespace hfst_ol
+
+#endif // HFST_OSPELL_ZHFSTOSPELLERREGISTRY_H_
@@ -0,0 +1,571 @@
+/*
+
+   Copyright 2009 University of Helsinki
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+ */
+
+/*
+   This is a benchmark that replays a word list against a speller and
+   reports throughput and latency as JSON.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+#if HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ol-exceptions.h"
+#include "ospell.h"
+#include "ZHfstOspeller.h"
+
+using hfst_ol::ZHfstOspeller;
+using hfst_ol::Transducer;
+
+enum BenchMode { CHECK, SUGGEST, ANALYSE };
+
+static const char* mode_names[] = { "check", "suggest", "analyse" };
+
+static bool verbose = false;
+static uint64_t suggs = 0;
+static hfst_ol::Weight max_weight = -1.0;
+static hfst_ol::Weight beam = -1.0;
+static bool edit_distance = false;
+static std::string error_model_filename = "";
+static std::string lexicon_filename = "";
+static std::string zhfst_filename = "";
+static std::vector<BenchMode> modes;
+static unsigned long threads = 1;
+static unsigned long warm_up = 100;
+static unsigned long seed = 1;
+static int mapping = hfst_ol::MapDefault;
+static double load_ms = 0.0;
+static double first_query_us = 0.0;
+
+//! @brief one speller per thread, the search state is not shareable
+struct BenchSpeller
+{
+    ZHfstOspeller speller;
+    Transducer* errmodel;
+    Transducer* lexicon;
+
+    BenchSpeller(void) :
+        errmodel(0),
+        lexicon(0)
+    {
+    }
+
+    ~BenchSpeller(void)
+    {
+        // the speller deletes its Speller but not the legacy automata
+        delete errmodel;
+        delete lexicon;
+    }
+
+    void load(void)
+    {
+        speller.set_mapping(mapping);
+        if (zhfst_filename != "")
+        {
+            speller.read_zhfst(zhfst_filename);
+        }
+        else
+        {
+            errmodel = Transducer::new_from_file(error_model_filename, mapping);
+            lexicon = Transducer::new_from_file(lexicon_filename, mapping);
+            speller.inject_speller(new hfst_ol::Speller(errmodel, lexicon));
+        }
+        speller.set_queue_limit(suggs);
+        speller.set_weight_limit(max_weight);
+        speller.set_beam(beam);
+        speller.set_edit_distance(edit_distance);
+    }
+
+    void run(BenchMode mode, const std::string& word,
+             hfst_ol::SearchStatistics* stats=0)
+    {
+        switch (mode)
+        {
+        case CHECK:
+            speller.spell(word, stats);
+            break;
+        case SUGGEST:
+            speller.suggest(word, stats);
+            break;
+        case ANALYSE:
+            speller.analyse(word, false, stats);
+            break;
+        }
+    }
+};
+
+//! @brief timings of one mode at one thread count
+struct BenchResult
+{
+    BenchMode mode;
+    unsigned long threads;
+    double seconds;
+    std::vector<double> latencies; //!< microseconds per word
+    uint64_t nodes; //!< search nodes expanded
+};
+
+bool print_usage(void)
+{
+    std::cout <<
+        "\n" <<
+        "Usage: hfst-ospell-bench [OPTIONS] [ZHFST-ARCHIVE] < WORDLIST\n" <<
+        "Replay WORDLIST against automata in ZHFST-ARCHIVE or from OPTIONS\n" <<
+        "and print throughput and latency as JSON\n" <<
+        "\n" <<
+        "  -h, --help                Print this help message\n" <<
+        "  -V, --version             Print version information\n" <<
+        "  -v, --verbose             Print progress to standard error\n" <<
+        "  -M, --mode=MODE           Benchmark MODE: check, suggest, analyse\n" <<
+        "                            (may be repeated, default all)\n" <<
+        "  -t, --threads=N           Also run with N threads (default 1)\n" <<
+        "  -W, --warm-up=N           Run N words untimed first (default 100)\n" <<
+        "  -r, --seed=N              Shuffle word list with seed N (default 1)\n" <<
+        "  -n, --limit=N             Suggest at most N corrections\n" <<
+        "  -w, --max-weight=W        Suppress corrections with weights above W\n" <<
+        "  -b, --beam=W              Suppress corrections worse than best candidate by more than W\n" <<
+        "  -e, --edit-distance       Search an error model that is a plain edit\n"
+        "                            distance as edit weights, not as an automaton\n" <<
+        "  -m, --error-model         Use this error model (must also give lexicon as option)\n" <<
+        "  -l, --lexicon             Use this lexicon (must also give error model as option)\n" <<
+        "  -p, --map=FLAGS           Load automata with comma separated FLAGS:\n" <<
+        "                            populate, hugepages, random\n" <<
+        "\n" <<
+        "Report bugs to " << PACKAGE_BUGREPORT << "\n" <<
+        "\n";
+    return true;
+}
+
+bool print_version(void)
+{
+    std::cout <<
+        "\n" <<
+        PACKAGE_STRING << std::endl <<
+        __DATE__ << " " __TIME__ << std::endl <<
+        "copyright (C) 2009 - 2014 University of Helsinki\n";
+    return true;
+}
+
+//! @brief shuffle @a words the same way on every platform
+void
+shuffle_words(std::vector<std::string>& words)
+{
+    // std::shuffle and the distributions are implementation defined
+    std::mt19937 generator(seed);
+    for (size_t i = words.size(); i > 1; --i)
+    {
+        size_t j = generator() % i;
+        std::swap(words[i - 1], words[j]);
+    }
+}
+
+double
+percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0.0;
+    }
+    size_t rank = (size_t) (p * (sorted.size() - 1) + 0.5);
+    return sorted[rank];
+}
+
+long
+peak_rss_kb(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+void
+run_worker(BenchSpeller* speller, BenchMode mode,
+           const std::vector<std::string>* words,
+           size_t first, size_t step, std::vector<double>* latencies,
+           uint64_t* nodes)
+{
+    hfst_ol::SearchStatistics stats;
+    for (size_t i = first; i < words->size(); i += step)
+    {
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        speller->run(mode, (*words)[i], &stats);
+        std::chrono::steady_clock::time_point end =
+            std::chrono::steady_clock::now();
+        latencies->push_back(
+            std::chrono::duration<double, std::micro>(end - start).count());
+        *nodes += stats.nodes_popped;
+    }
+}
+
+BenchResult
+run_bench(std::vector<BenchSpeller*>& spellers, BenchMode mode,
+          unsigned long thread_count, const std::vector<std::string>& words)
+{
+    BenchResult result;
+    result.mode = mode;
+    result.threads = thread_count;
+    // warm up caches and page in the automata, untimed
+    for (unsigned long t = 0; t < thread_count; ++t)
+    {
+        for (size_t i = 0; i < warm_up && i < words.size(); ++i)
+        {
+            spellers[t]->run(mode, words[i]);
+        }
+    }
+    std::vector<std::vector<double> > latencies(thread_count);
+    std::vector<uint64_t> nodes(thread_count, 0);
+    std::vector<std::thread> workers;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (unsigned long t = 0; t < thread_count; ++t)
+    {
+        workers.push_back(std::thread(run_worker, spellers[t], mode, &words,
+                                      (size_t) t, (size_t) thread_count,
+                                      &latencies[t], &nodes[t]));
+    }
+    for (std::vector<std::thread>::iterator worker = workers.begin();
+         worker != workers.end();
+         ++worker)
+    {
+        worker->join();
+    }
+    std::chrono::steady_clock::time_point end =
+        std::chrono::steady_clock::now();
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    result.nodes = 0;
+    for (unsigned long t = 0; t < thread_count; ++t)
+    {
+        result.latencies.insert(result.latencies.end(),
+                                latencies[t].begin(), latencies[t].end());
+        result.nodes += nodes[t];
+    }
+    std::sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+void
+print_json(const std::vector<BenchResult>& results, size_t word_count)
+{
+    fprintf(stdout, "{\n");
+    fprintf(stdout, "  \"words\": %lu,\n", (unsigned long) word_count);
+    fprintf(stdout, "  \"seed\": %lu,\n", seed);
+    fprintf(stdout, "  \"warm_up\": %lu,\n", warm_up);
+    fprintf(stdout, "  \"peak_rss_kb\": %ld,\n", peak_rss_kb());
+    fprintf(stdout, "  \"load_ms\": %.3f,\n", load_ms);
+    fprintf(stdout, "  \"first_query_us\": %.1f,\n", first_query_us);
+    fprintf(stdout, "  \"runs\": [\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult& r = results[i];
+        double words_per_sec = (r.seconds > 0.0) ?
+            r.latencies.size() / r.seconds : 0.0;
+        fprintf(stdout, "    {\"mode\": \"%s\", \"threads\": %lu, "
+                "\"seconds\": %.6f, \"words_per_sec\": %.1f, ",
+                mode_names[r.mode], r.threads, r.seconds, words_per_sec);
+#if USE_STATISTICS
+        fprintf(stdout, "\"nodes_expanded\": %lu, ", (unsigned long) r.nodes);
+#endif
+        fprintf(stdout, "\"latency_us\": {\"p50\": %.1f, \"p95\": %.1f, "
+                "\"p99\": %.1f, \"max\": %.1f}}%s\n",
+                percentile(r.latencies, 0.50),
+                percentile(r.latencies, 0.95),
+                percentile(r.latencies, 0.99),
+                r.latencies.empty() ? 0.0 : r.latencies.back(),
+                (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(stdout, "  ]\n");
+    fprintf(stdout, "}\n");
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+#if HAVE_GETOPT_H
+    while (true)
+    {
+        static struct option long_options[] =
+        {
+            {"help",         no_argument,       0, 'h'},
+            {"version",      no_argument,       0, 'V'},
+            {"verbose",      no_argument,       0, 'v'},
+            {"mode",         required_argument, 0, 'M'},
+            {"threads",      required_argument, 0, 't'},
+            {"warm-up",      required_argument, 0, 'W'},
+            {"seed",         required_argument, 0, 'r'},
+            {"limit",        required_argument, 0, 'n'},
+            {"max-weight",   required_argument, 0, 'w'},
+            {"beam",         required_argument, 0, 'b'},
+            {"edit-distance", no_argument,      0, 'e'},
+            {"error-model",  required_argument, 0, 'm'},
+            {"lexicon",      required_argument, 0, 'l'},
+            {"map",          required_argument, 0, 'p'},
+            {0, 0, 0, 0}
+        };
+
+        int option_index = 0;
+        c = getopt_long(argc, argv, "hVvM:t:W:r:n:w:b:em:l:p:", long_options, &option_index);
+        char* endptr = 0;
+
+        if (c == -1) // no more options to look at
+            break;
+
+        switch (c)
+        {
+        case 'h':
+            print_usage();
+            return EXIT_SUCCESS;
+            break;
+
+        case 'V':
+            print_version();
+            return EXIT_SUCCESS;
+            break;
+
+        case 'v':
+            verbose = true;
+            break;
+        case 'M':
+            if (strcmp(optarg, "check") == 0)
+            {
+                modes.push_back(CHECK);
+            }
+            else if (strcmp(optarg, "suggest") == 0)
+            {
+                modes.push_back(SUGGEST);
+            }
+            else if (strcmp(optarg, "analyse") == 0)
+            {
+                modes.push_back(ANALYSE);
+            }
+            else
+            {
+                fprintf(stderr, "%s is not check, suggest or analyse\n", optarg);
+                exit(1);
+            }
+            break;
+        case 't':
+            threads = strtoul(optarg, &endptr, 10);
+            if (endptr == optarg || threads == 0)
+            {
+                fprintf(stderr, "%s not a positive strtoul number\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'W':
+            warm_up = strtoul(optarg, &endptr, 10);
+            if (endptr == optarg)
+            {
+                fprintf(stderr, "%s not a strtoul number\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'r':
+            seed = strtoul(optarg, &endptr, 10);
+            if (endptr == optarg)
+            {
+                fprintf(stderr, "%s not a strtoul number\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'n':
+            suggs = strtoul(optarg, &endptr, 10);
+            if (endptr == optarg)
+            {
+                fprintf(stderr, "%s not a strtoul number\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'w':
+            max_weight = strtof(optarg, &endptr);
+            if (endptr == optarg)
+            {
+                fprintf(stderr, "%s is not a float\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'b':
+            beam = strtof(optarg, &endptr);
+            if (endptr == optarg)
+            {
+                fprintf(stderr, "%s is not a float\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'e':
+            edit_distance = true;
+            break;
+        case 'm':
+            error_model_filename = optarg;
+            break;
+        case 'l':
+            lexicon_filename = optarg;
+            break;
+        case 'p':
+            mapping = hfst_ol::parse_mapping_flags(optarg);
+            if (mapping < 0)
+            {
+                fprintf(stderr, "%s is not populate, hugepages or random\n",
+                        optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            std::cerr << "Invalid option\n\n";
+            print_usage();
+            return EXIT_FAILURE;
+            break;
+        }
+    }
+#else
+    int optind = 1;
+#endif
+    if (optind == (argc - 1))
+    {
+        zhfst_filename = argv[optind];
+    }
+    else if (optind < (argc - 1))
+    {
+        std::cerr << "Too many file parameters" << std::endl;
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    if ((zhfst_filename == "") ==
+        (error_model_filename == "" || lexicon_filename == ""))
+    {
+        std::cerr << "Give *either* a zhfst speller or --error-model and --lexicon"
+                  << std::endl;
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    if (modes.empty())
+    {
+        modes.push_back(CHECK);
+        modes.push_back(SUGGEST);
+        modes.push_back(ANALYSE);
+    }
+
+    std::vector<std::string> words;
+    std::string line;
+    while (std::getline(std::cin, line))
+    {
+        if (!line.empty())
+        {
+            words.push_back(line);
+        }
+    }
+    shuffle_words(words);
+
+    std::vector<BenchSpeller*> spellers;
+    for (unsigned long t = 0; t < threads; ++t)
+    {
+        BenchSpeller* speller = new BenchSpeller;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        try
+        {
+            speller->load();
+        }
+        catch (hfst_ol::ZHfstMetaDataParsingError zhmdpe)
+        {
+            fprintf(stderr, "cannot finish reading zhfst archive %s:\n%s.\n",
+                    zhfst_filename.c_str(), zhmdpe.what());
+            return EXIT_FAILURE;
+        }
+        catch (hfst_ol::ZHfstZipReadingError zhzre)
+        {
+            fprintf(stderr, "cannot read zhfst archive %s:\n%s.\n",
+                    zhfst_filename.c_str(), zhzre.what());
+            return EXIT_FAILURE;
+        }
+        catch (hfst_ol::ZHfstXmlParsingError zhxpe)
+        {
+            fprintf(stderr, "Cannot finish reading index.xml from %s:\n"
+                    "%s.\n", zhfst_filename.c_str(), zhxpe.what());
+            return EXIT_FAILURE;
+        }
+        if (t == 0)
+        {
+            load_ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+        spellers.push_back(speller);
+    }
+    if (!words.empty())
+    {
+        // what a freshly deployed speller costs its first user
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        spellers[0]->run(modes[0], words[0]);
+        first_query_us = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::vector<BenchResult> results;
+    for (std::vector<BenchMode>::iterator mode = modes.begin();
+         mode != modes.end();
+         ++mode)
+    {
+        if (verbose)
+        {
+            fprintf(stderr, "%s: %lu words, 1 thread\n",
+                    mode_names[*mode], (unsigned long) words.size());
+        }
+        results.push_back(run_bench(spellers, *mode, 1, words));
+        if (threads > 1)
+        {
+            if (verbose)
+            {
+                fprintf(stderr, "%s: %lu words, %lu threads\n",
+                        mode_names[*mode], (unsigned long) words.size(),
+                        threads);
+            }
+            results.push_back(run_bench(spellers, *mode, threads, words));
+        }
+    }
+    print_json(results, words.size());
+
+    for (std::vector<BenchSpeller*>::iterator speller = spellers.begin();
+         speller != spellers.end();
+         ++speller)
+    {
+        delete *speller;
+    }
+    return EXIT_SUCCESS;
+}
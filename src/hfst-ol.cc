@@ -15,6 +15,7 @@
 #include "hfst-ol.h"
 #include <string>
 #include <sys/mman.h>
+#include <unistd.h>
 
 namespace hfst_ol {
 
@@ -347,6 +348,17 @@ TransducerAlphabet::is_flag(SymbolNumber symbol)
     return operations.count(symbol) == 1;
 }
 
+#if !ZHFST_EXTRACT_TO_MEM
+//! @brief give @a advice for the whole pages holding @a len bytes at @a start
+static void
+advise_pages(const int8_t* start, size_t len, int advice)
+{
+    uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t) start & ~(page - 1);
+    madvise((void*) first, (uintptr_t) start + len - first, advice);
+}
+#endif
+
 void IndexTable::read(int8_t** raw,
                       TransitionTableIndex number_of_table_entries)
 {
@@ -357,11 +369,12 @@ void IndexTable::read(int8_t** raw,
     memcpy((void*) indices, (const void*) *raw, table_size);
     #else
 
+    indices = *raw;
+
     #if __APPLE__
-    madvise(raw, sizeof(table_size), MADV_WILLNEED | MADV_RANDOM);
+    advise_pages(*raw, table_size, MADV_WILLNEED);
+    advise_pages(*raw, table_size, MADV_RANDOM);
     #endif
-
-    indices = *raw;
     #endif
 
     (*raw) += table_size;
@@ -377,11 +390,12 @@ void TransitionTable::read(int8_t** raw,
     memcpy((void*) transitions, (const void*) *raw, table_size);
     #else
 
+    transitions = *raw;
+
     #if __APPLE__
-    madvise(raw, sizeof(table_size), MADV_WILLNEED | MADV_RANDOM);
+    advise_pages(*raw, table_size, MADV_WILLNEED);
+    advise_pages(*raw, table_size, MADV_RANDOM);
     #endif
-
-    transitions = *raw;
     #endif
 
     (*raw) += table_size;
@@ -418,6 +432,23 @@ SymbolNumber LetterTrie::find_key(int8_t** p)
     return s;
 }
 
+const LetterTrie* LetterTrie::step(const uint8_t* bytes, int32_t length,
+                                   SymbolNumber& key) const
+{
+    const LetterTrie* trie = this;
+    for (int32_t i = 0; i < length - 1; ++i)
+    {
+        trie = trie->letters[bytes[i]];
+        if (trie == NULL)
+        {
+            key = NO_SYMBOL;
+            return NULL;
+        }
+    }
+    key = trie->symbols[bytes[length - 1]];
+    return trie->letters[bytes[length - 1]];
+}
+
 LetterTrie::~LetterTrie()
 {
     for (LetterTrieVector::iterator i = letters.begin();
@@ -535,6 +566,16 @@ IndexTable::IndexTable(int8_t** raw,
     read(raw, number_of_table_entries);
 }
 
+void
+IndexTable::advise(int advice) const
+{
+    #if ZHFST_EXTRACT_TO_MEM
+    (void) advice;
+    #else
+    advise_pages(indices, size * TransitionIndex::SIZE, advice);
+    #endif
+}
+
 IndexTable::~IndexTable(void)
 {
 #if ZHFST_EXTRACT_TO_MEM
@@ -692,4 +733,97 @@ SymbolNumber Encoder::find_key(int8_t** p)
     return s;
 }
 
+template <typename C>
+SymbolNumber Encoder::find_code_unit_key(const C** p, const C* end)
+{
+    const C* q = *p;
+    if (*q < 128 && ascii_symbols[*q] != NO_SYMBOL)
+    {
+        ++(*p);
+        return ascii_symbols[*q];
+    }
+    // the longest symbol in the trie, taken a character at a time
+    SymbolNumber found = NO_SYMBOL;
+    const LetterTrie* trie = &letters;
+    while (trie != NULL && q < end)
+    {
+        int32_t code = decode_code_point(&q, end);
+        if (code < 0)
+        {
+            break;
+        }
+        uint8_t bytes[4];
+        SymbolNumber key;
+        trie = trie->step(bytes, encode_utf8(code, bytes), key);
+        if (key != NO_SYMBOL)
+        {
+            found = key;
+            *p = q;
+        }
+    }
+    return found;
+}
+
+SymbolNumber Encoder::find_key(const char16_t** p, const char16_t* end)
+{
+    return find_code_unit_key(p, end);
+}
+
+SymbolNumber Encoder::find_key(const char32_t** p, const char32_t* end)
+{
+    return find_code_unit_key(p, end);
+}
+
+int32_t decode_code_point(const char16_t** p, const char16_t* end)
+{
+    int32_t code = *((*p)++);
+    if (code < 0xD800 || code > 0xDFFF)
+    {
+        return code;
+    }
+    if (code > 0xDBFF || *p == end || **p < 0xDC00 || **p > 0xDFFF)
+    {
+        return -1;
+    }
+    return 0x10000 + ((code - 0xD800) << 10) + (*((*p)++) - 0xDC00);
+}
+
+int32_t decode_code_point(const char32_t** p, const char32_t* end)
+{
+    (void) end;
+    char32_t code = *((*p)++);
+    if (code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+    {
+        return -1;
+    }
+    return static_cast<int32_t>(code);
+}
+
+int32_t encode_utf8(int32_t code, uint8_t* bytes)
+{
+    if (code < 0x80)
+    {
+        bytes[0] = static_cast<uint8_t>(code);
+        return 1;
+    }
+    if (code < 0x800)
+    {
+        bytes[0] = static_cast<uint8_t>(0xC0 | (code >> 6));
+        bytes[1] = static_cast<uint8_t>(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000)
+    {
+        bytes[0] = static_cast<uint8_t>(0xE0 | (code >> 12));
+        bytes[1] = static_cast<uint8_t>(0x80 | ((code >> 6) & 0x3F));
+        bytes[2] = static_cast<uint8_t>(0x80 | (code & 0x3F));
+        return 3;
+    }
+    bytes[0] = static_cast<uint8_t>(0xF0 | (code >> 18));
+    bytes[1] = static_cast<uint8_t>(0x80 | ((code >> 12) & 0x3F));
+    bytes[2] = static_cast<uint8_t>(0x80 | ((code >> 6) & 0x3F));
+    bytes[3] = static_cast<uint8_t>(0x80 | (code & 0x3F));
+    return 4;
+}
+
 } // namespace hfst_ol
@@ -243,11 +243,33 @@ public:
     {
     }
     //!
+    //! the trie owns its branches, so it can only be moved
+    LetterTrie(LetterTrie&& other)
+    {
+        letters.swap(other.letters);
+        symbols.swap(other.symbols);
+    }
+    LetterTrie& operator=(LetterTrie&& other)
+    {
+        // other frees what was ours
+        letters.swap(other.letters);
+        symbols.swap(other.symbols);
+        return *this;
+    }
+    LetterTrie(const LetterTrie&) = delete;
+    LetterTrie& operator=(const LetterTrie&) = delete;
+    //!
     //! add a string to alphabets with a key
     void add_string(const char* p, SymbolNumber symbol_key);
     //!
     //! find a key for string or add it
     SymbolNumber find_key(int8_t** p);
+    //!
+    //! @brief the branch after the @a length utf-8 @a bytes of one
+    //!        character, or NULL; @a key is the key of the string ending
+    //!        there
+    const LetterTrie* step(const uint8_t* bytes, int32_t length,
+                           SymbolNumber& key) const;
     ~LetterTrie();
 };
 
@@ -261,16 +283,30 @@ private:
     SymbolVector ascii_symbols;
 
     void read_input_symbols(KeyTable* kt, SymbolNumber number_of_input_symbols);
+    template <typename C>
+    SymbolNumber find_code_unit_key(const C** p, const C* end);
 
 public:
     //!
     //! create encoder from keytable
     Encoder(KeyTable* kt, SymbolNumber number_of_input_symbols);
     SymbolNumber find_key(int8_t** p);
+    //!
+    //! @brief find_key() on the utf-16 or utf-32 code units before @a end,
+    //!        without recoding them into a string
+    SymbolNumber find_key(const char16_t** p, const char16_t* end);
+    SymbolNumber find_key(const char32_t** p, const char32_t* end);
     void read_input_symbol(const char* s, const int32_t s_num);
     void read_input_symbol(std::string const & s, const int32_t s_num);
 };
 
+//! @brief the code point at @a p, before @a end, moving @a p past it;
+//!        -1 for a lone surrogate or a unit that is no character
+int32_t decode_code_point(const char16_t** p, const char16_t* end);
+int32_t decode_code_point(const char32_t** p, const char32_t* end);
+//! @brief write the utf-8 of @a code to @a bytes and return their number
+int32_t encode_utf8(int32_t code, uint8_t* bytes);
+
 typedef std::vector<ValueNumber> FlagDiacriticState;
 
 //! Internal class for transition data.
@@ -407,6 +443,15 @@ public:
     //!
     //! transition's weight
     Weight final_weight(TransitionTableIndex i) const;
+    //!
+    //! give madvise() @a advice for the pages of a mapped table
+    void advise(int advice) const;
+    //!
+    //! where index @a i is in memory, for hints that it will be read soon
+    const int8_t* address(TransitionTableIndex i) const
+    {
+        return indices + TransitionIndex::SIZE * i;
+    }
 };
 
 //! Internal class for transition processing.
@@ -457,6 +502,12 @@ public:
     //!
     //! whether it's final
     bool final (TransitionTableIndex i) const;
+    //!
+    //! where transition @a i is in memory, for hints that it will be read soon
+    const int8_t* address(TransitionTableIndex i) const
+    {
+        return transitions + Transition::SIZE * i;
+    }
 
 
 };
@@ -36,13 +36,22 @@
 #include <cstdint>
 #include <stdio.h>
 #include <errno.h>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <thread>
+#include <vector>
 
 #include "ol-exceptions.h"
 #include "ospell.h"
 #include "ZHfstOspeller.h"
+#include "ZHfstOspellerRegistry.h"
+#include "server.h"
 
 using hfst_ol::ZHfstOspeller;
 using hfst_ol::Transducer;
+typedef hfst_ol::ZHfstOspellerRegistry::Handle SpellerHandle;
 
 static bool quiet = false;
 static bool verbose = false;
@@ -50,13 +59,24 @@ static bool analyse = false;
 static uint64_t suggs = 0;
 static hfst_ol::Weight max_weight = -1.0;
 static hfst_ol::Weight beam = -1.0;
+static hfst_ol::Weight deepening_weight = 0.0;
+static bool case_folding = false;
 static std::string error_model_filename = "";
 static std::string lexicon_filename = "";
+static std::string matrix_filename = "";
+static uint32_t distance = 1;
+static bool edit_distance = false;
+static std::string delete_index_filename = "";
 #ifdef WINDOWS
 static bool output_to_console = false;
 #endif
 static bool suggest = false;
 static bool suggest_reals = false;
+static bool batch = false;
+static enum { HUMAN, TSV, JSON } output_format = HUMAN;
+static std::string server_path = "";
+static unsigned long threads = 1;
+static int mapping = hfst_ol::MapDefault;
 
 #ifdef WINDOWS
 static std::string wide_string_to_string(const std::wstring & wstr)
@@ -68,16 +88,13 @@ static std::string wide_string_to_string(const std::wstring & wstr)
 }
 #endif
 
-static int hfst_fprintf(FILE * stream, const char * format, ...)
+static int hfst_vfprintf(FILE * stream, const char * format, va_list args)
 {
-    va_list args;
-    va_start(args, format);
 #ifdef WINDOWS
     if (output_to_console && (stream == stdout || stream == stderr))
     {
         char buffer [1024];
         int r = vsprintf(buffer, format, args);
-        va_end(args);
         if (r < 0)
             return r;
         HANDLE stdHandle = GetStdHandle(STD_OUTPUT_HANDLE);
@@ -98,9 +115,7 @@ static int hfst_fprintf(FILE * stream, const char * format, ...)
     }
     else
     {
-        int retval = vfprintf(stream, format, args);
-        va_end(args);
-        return retval;
+        return vfprintf(stream, format, args);
     }
 #else
     errno = 0;
@@ -109,11 +124,49 @@ static int hfst_fprintf(FILE * stream, const char * format, ...)
     {
         perror("hfst_fprintf");
     }
-    va_end(args);
     return retval;
 #endif
 }
 
+static int hfst_fprintf(FILE * stream, const char * format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int retval = hfst_vfprintf(stream, format, args);
+    va_end(args);
+    return retval;
+}
+
+//! @brief printf to the end of @a out, or to stdout if @a out is 0
+static int output_printf(std::string* out, const char * format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    if (out == 0)
+    {
+        int retval = hfst_vfprintf(stdout, format, args);
+        va_end(args);
+        return retval;
+    }
+    size_t used = out->size();
+    out->resize(used + 256);
+    int len = vsnprintf(&(*out)[used], 256, format, args);
+    va_end(args);
+    if (len < 0)
+    {
+        out->resize(used);
+        return len;
+    }
+    if (len >= 256)
+    {
+        out->resize(used + len + 1);
+        va_start(args, format);
+        vsnprintf(&(*out)[used], len + 1, format, args);
+        va_end(args);
+    }
+    out->resize(used + len);
+    return len;
+}
 
 bool print_usage(void)
 {
@@ -131,10 +184,31 @@ bool print_usage(void)
         "  -n, --limit=N             Show at most N suggestions\n" <<
         "  -w, --max-weight=W        Suppress corrections with weights above W\n" <<
         "  -b, --beam=W              Suppress corrections worse than best candidate by more than W\n" <<
+        "  -i, --deepen=W            Without -w and -b, search up to weight W first\n"
+        "                            and double it until -n corrections are found\n" <<
+        "  -c, --fold-case           Read capitals as small letters too and suggest\n"
+        "                            in the case of the input\n" <<
         "  -S, --suggest             Suggest corrections to mispellings\n" <<
         "  -X, --real-word           Also suggest corrections to correct words\n" <<
         "  -m, --error-model         Use this error model (must also give lexicon as option)\n" <<
         "  -l, --lexicon             Use this lexicon (must also give error model as option)\n" <<
+        "  -M, --matrix=FILE         Use the edit weights of an editdist.py specification\n" <<
+        "                            FILE as error model instead of --error-model\n" <<
+        "  -d, --distance=N          Allow N edits with --matrix (default 1)\n" <<
+        "  -e, --edit-distance       Search an error model that is a plain edit\n"
+        "                            distance as edit weights, not as an automaton\n" <<
+        "  -D, --delete-index=FILE   Look corrections up in the delete index FILE\n" <<
+        "                            of an acyclic --lexicon, built for --distance\n" <<
+        "                            edits and saved to FILE if it doesn't exist\n" <<
+        "  -B, --batch               Read all input in blocks and buffer output\n" <<
+        "  -f, --format=FORMAT       Print one record per word as FORMAT:\n" <<
+        "                            human (default), tsv or json\n" <<
+#ifndef WINDOWS
+        "  -u, --server=SOCKET       Serve requests on Unix domain SOCKET\n" <<
+#endif
+        "  -t, --threads=N           Use N threads in batch or server mode (default 1)\n" <<
+        "  -p, --map=FLAGS           Load automata with comma separated FLAGS:\n" <<
+        "                            populate, hugepages, random\n" <<
 #ifdef WINDOWS
     "  -k, --output-to-console   Print output to console (Windows-specific)" <<
 #endif
@@ -162,78 +236,257 @@ bool print_short_help(void)
 }
 
 void
-do_suggest(ZHfstOspeller& speller, const std::string& str)
+do_suggest_analyses(ZHfstOspeller& speller, const std::string& str,
+                    std::string* out)
 {
-    std::vector<hfst_ol::StringWeightPair> corrections = speller.suggest(str);
+    std::vector<hfst_ol::StringPairWeightPair> pairs =
+        speller.suggest_analyses(str);
 
-    if (corrections.size() > 0)
+    if (pairs.size() > 0)
     {
-        hfst_fprintf(stdout, "Corrections for \"%s\":\n", str.c_str());
-        for (hfst_ol::StringWeightPair corr : corrections)
+        output_printf(out, "Corrections for \"%s\":\n", str.c_str());
+        // group the analyses under their corrections, best correction first
+        // and print the weight of the correction, i.e. of its best path,
+        // in the second column as before
+        std::vector<std::string> corrections;
+        std::map<std::string, std::vector<hfst_ol::StringWeightPair> > analyses;
+        std::map<std::string, hfst_ol::Weight> weights;
+        for (hfst_ol::StringPairWeightPair pair : pairs)
+        {
+            if (analyses.count(pair.first.first) == 0)
+            {
+                corrections.push_back(pair.first.first);
+                weights[pair.first.first] = pair.second;
+            }
+            else if (pair.second < weights[pair.first.first])
+            {
+                weights[pair.first.first] = pair.second;
+            }
+            analyses[pair.first.first].push_back(
+                hfst_ol::StringWeightPair(pair.first.second, pair.second));
+        }
+        for (std::string corr : corrections)
         {
-            if (analyse)
+            bool all_discarded = true;
+            for (hfst_ol::StringWeightPair analysis : analyses[corr])
             {
-                std::vector<hfst_ol::StringWeightPair> analyses = speller.analyse(corr.first, true);
-                bool all_discarded = true;
-                for (hfst_ol::StringWeightPair analysis : analyses)
+                if (analysis.first.find("Use/SpellNoSugg") !=
+                    std::string::npos)
                 {
-                    if (analysis.first.find("Use/SpellNoSugg") !=
-                        std::string::npos)
-                    {
-                        hfst_fprintf(stdout, "%s    %f    %s    "
-                                     "[DISCARDED BY ANALYSES]\n",
-                                     corr.first.c_str(), corr.second,
-                                     analysis.first.c_str());
-                    }
-                    else
-                    {
-                        all_discarded = false;
-                        hfst_fprintf(stdout, "%s    %f    %s\n",
-                                    corr.first.c_str(), corr.second,
-                                    analysis.first.c_str());
-                    }
+                    output_printf(out, "%s    %f    %s    "
+                                 "[DISCARDED BY ANALYSES]\n",
+                                 corr.c_str(), weights[corr],
+                                 analysis.first.c_str());
                 }
-                if (all_discarded)
+                else
                 {
-                    hfst_fprintf(stdout, "All corrections were "
-                                 "invalidated by analysis! "
-                                 "No score!\n");
+                    all_discarded = false;
+                    output_printf(out, "%s    %f    %s\n",
+                                corr.c_str(), weights[corr],
+                                analysis.first.c_str());
                 }
             }
-            else
+            if (all_discarded)
             {
-                hfst_fprintf(stdout, "%s    %f\n",
-                             corr.first.c_str(),
-                             corr.second);
+                output_printf(out, "All corrections were "
+                             "invalidated by analysis! "
+                             "No score!\n");
             }
         }
-        hfst_fprintf(stdout, "\n");
+        output_printf(out, "\n");
     }
     else
     {
-        hfst_fprintf(stdout,
+        output_printf(out,
+                     "Unable to correct \"%s\"!\n\n", str.c_str());
+    }
+}
+
+void
+do_suggest(ZHfstOspeller& speller, const std::string& str,
+           std::string* out=0)
+{
+    if (analyse)
+    {
+        do_suggest_analyses(speller, str, out);
+        return;
+    }
+    std::vector<hfst_ol::StringWeightPair> corrections = speller.suggest(str);
+
+    if (corrections.size() > 0)
+    {
+        output_printf(out, "Corrections for \"%s\":\n", str.c_str());
+        for (hfst_ol::StringWeightPair corr : corrections)
+        {
+            output_printf(out, "%s    %f\n",
+                         corr.first.c_str(),
+                         corr.second);
+        }
+        output_printf(out, "\n");
+    }
+    else
+    {
+        output_printf(out,
                      "Unable to correct \"%s\"!\n\n", str.c_str());
     }
 
 }
 
+//! @brief append @a str to @a out escaped for the current output format
 void
-do_spell(ZHfstOspeller& speller, const std::string& str)
+append_escaped(std::string& out, const std::string& str)
 {
+    static const char hex[] = "0123456789abcdef";
+    for (std::string::const_iterator c = str.begin(); c != str.end(); ++c)
+    {
+        switch (*c)
+        {
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '"':
+            out += (output_format == JSON) ? "\\\"" : "\"";
+            break;
+        default:
+            if (output_format == JSON && (unsigned char) *c < 0x20)
+            {
+                out += "\\u00";
+                out += hex[(*c >> 4) & 0xf];
+                out += hex[*c & 0xf];
+            }
+            else
+            {
+                out += *c;
+            }
+        }
+    }
+}
+
+//! @brief append @a w to @a out with at most three decimals
+void
+append_weight(std::string& out, hfst_ol::Weight w)
+{
+    if (!(w == w) || w > 1e15 || w < -1e15)
+    {
+        // NaN and huge weights are not worth a fast path
+        out += (output_format == JSON) ? "null" : "inf";
+        return;
+    }
+    if (w < 0)
+    {
+        out += '-';
+        w = -w;
+    }
+    uint64_t thousandths = (uint64_t) (w * 1000.0 + 0.5);
+    char digits[24];
+    char* d = digits + sizeof(digits);
+    uint64_t whole = thousandths / 1000;
+    do
+    {
+        *--d = '0' + whole % 10;
+        whole /= 10;
+    } while (whole > 0);
+    out.append(d, digits + sizeof(digits) - d);
+    unsigned int fraction = thousandths % 1000;
+    if (fraction != 0)
+    {
+        out += '.';
+        out += (char) ('0' + fraction / 100);
+        fraction %= 100;
+        if (fraction != 0)
+        {
+            out += (char) ('0' + fraction / 10);
+            fraction %= 10;
+            if (fraction != 0)
+            {
+                out += (char) ('0' + fraction);
+            }
+        }
+    }
+}
+
+//! @brief spell @a str and write one tsv or json record for it
+void
+do_record(ZHfstOspeller& speller, const std::string& str, std::string* out)
+{
+    // reused between calls so records are built without allocating
+    static thread_local std::string buffer;
+    std::string& record = (out != 0) ? *out : buffer;
+    if (out == 0)
+    {
+        buffer.clear();
+    }
+    bool correct = speller.spell(str);
+    std::vector<hfst_ol::StringWeightPair> corrections;
+    if ((!correct && suggest) || (correct && suggest_reals))
+    {
+        corrections = speller.suggest(str);
+    }
+    if (output_format == TSV)
+    {
+        // word, 1 or 0, then correction and weight pairs
+        append_escaped(record, str);
+        record += correct ? "\t1" : "\t0";
+        for (hfst_ol::StringWeightPair corr : corrections)
+        {
+            record += '\t';
+            append_escaped(record, corr.first);
+            record += '\t';
+            append_weight(record, corr.second);
+        }
+        record += '\n';
+    }
+    else
+    {
+        record += "{\"word\":\"";
+        append_escaped(record, str);
+        record += correct ? "\",\"correct\":true" : "\",\"correct\":false";
+        record += ",\"suggestions\":[";
+        for (size_t i = 0; i < corrections.size(); ++i)
+        {
+            record += (i == 0) ? "[\"" : ",[\"";
+            append_escaped(record, corrections[i].first);
+            record += "\",";
+            append_weight(record, corrections[i].second);
+            record += ']';
+        }
+        record += "]}\n";
+    }
+    if (out == 0)
+    {
+        fwrite(buffer.data(), 1, buffer.size(), stdout);
+    }
+}
+
+void
+do_spell(ZHfstOspeller& speller, const std::string& str,
+         std::string* out=0)
+{
+    if (output_format != HUMAN)
+    {
+        do_record(speller, str, out);
+        return;
+    }
     if (speller.spell(str))
     {
-        hfst_fprintf(stdout, "\"%s\" is in the lexicon.\n",
+        output_printf(out, "\"%s\" is in the lexicon.\n",
                      str.c_str());
         if (analyse)
         {
-            hfst_fprintf(stdout, "analysing:\n");
+            output_printf(out, "analysing:\n");
             std::vector<hfst_ol::StringWeightPair> analyses = speller.analyse(str, false);
             bool all_no_spell = true;
             for (hfst_ol::StringWeightPair analysis : analyses)
             {
                 if (analysis.first.find("Use/-Spell") != std::string::npos)
                 {
-                    hfst_fprintf(stdout,
+                    output_printf(out,
                                  "%s   %f [DISCARDED AS -Spell]\n",
                                  analysis.first.c_str(),
                                  analysis.second);
@@ -241,31 +494,31 @@ do_spell(ZHfstOspeller& speller, const std::string& str)
                 else
                 {
                     all_no_spell = false;
-                    hfst_fprintf(stdout, "%s   %f\n",
+                    output_printf(out, "%s   %f\n",
                                  analysis.first.c_str(),
                                  analysis.second);
                 }
             }
             if (all_no_spell)
             {
-                hfst_fprintf(stdout,
+                output_printf(out,
                              "All spellings were invalidated by analysis! "
                              ".:. Not in lexicon!\n");
             }
         }
         if (suggest_reals)
         {
-            hfst_fprintf(stdout, "(but correcting anyways)\n", str.c_str());
-            do_suggest(speller, str);
+            output_printf(out, "(but correcting anyways)\n", str.c_str());
+            do_suggest(speller, str, out);
         }
     }
     else
     {
-        hfst_fprintf(stdout, "\"%s\" is NOT in the lexicon.\n",
+        output_printf(out, "\"%s\" is NOT in the lexicon.\n",
                      str.c_str());
         if (suggest)
         {
-            do_suggest(speller, str);
+            do_suggest(speller, str, out);
         }
     }
 }
@@ -274,6 +527,7 @@ int
 zhfst_spell(char* zhfst_filename)
 {
     ZHfstOspeller speller;
+    speller.set_mapping(mapping);
     try
     {
         speller.read_zhfst(zhfst_filename);
@@ -332,7 +586,10 @@ zhfst_spell(char* zhfst_filename)
     {
         hfst_fprintf(stdout, "Not printing suggestions worse than best by margin %f\n", beam);
     }
-    char * str = (char*) malloc(2000);
+    speller.set_deepening_weight(deepening_weight);
+    speller.set_case_folding(case_folding);
+    speller.set_edit_distance(edit_distance);
+    char * str = 0;
 
 #ifdef WINDOWS
     SetConsoleCP(65001);
@@ -346,9 +603,11 @@ zhfst_spell(char* zhfst_filename)
         free(str);
         str = strdup(linestr.c_str());
 #else
-    while (!std::cin.eof())
+    std::string line;
+    while (std::getline(std::cin, line))
     {
-        std::cin.getline(str, 2000);
+        free(str);
+        str = strdup(line.c_str());
 #endif
         if (str[0] == '\0')
         {
@@ -390,7 +649,10 @@ legacy_spell(hfst_ol::Speller * s)
     {
         hfst_fprintf(stdout, "Not printing suggestions worse than best by margin %f\n", suggs);
     }
-    char * str = (char*) malloc(2000);
+    speller.set_deepening_weight(deepening_weight);
+    speller.set_case_folding(case_folding);
+    speller.set_edit_distance(edit_distance);
+    char * str = 0;
 
 #ifdef WINDOWS
     SetConsoleCP(65001);
@@ -404,9 +666,11 @@ legacy_spell(hfst_ol::Speller * s)
         free(str);
         str = strdup(linestr.c_str());
 #else
-    while (!std::cin.eof())
+    std::string line;
+    while (std::getline(std::cin, line))
     {
-        std::cin.getline(str, 2000);
+        free(str);
+        str = strdup(line.c_str());
 #endif
         if (str[0] == '\0')
         {
@@ -428,6 +692,243 @@ legacy_spell(hfst_ol::Speller * s)
     return EXIT_SUCCESS;
 }
 
+//! @brief the index of --delete-index for @a lexicon, read from its file
+//!        or built and saved there once
+static const hfst_ol::SymmetricDeleteIndex&
+legacy_delete_index(Transducer& lexicon)
+{
+    static hfst_ol::SymmetricDeleteIndex* index = 0;
+    if (index != 0)
+    {
+        return *index;
+    }
+    try
+    {
+        if (std::ifstream(delete_index_filename.c_str()).good())
+        {
+            index = new hfst_ol::SymmetricDeleteIndex(
+                hfst_ol::SymmetricDeleteIndex::from_file(delete_index_filename,
+                                                         lexicon, distance,
+                                                         mapping));
+        }
+        else
+        {
+            index = new hfst_ol::SymmetricDeleteIndex(
+                hfst_ol::SymmetricDeleteIndex::build(lexicon, distance));
+            index->write(delete_index_filename);
+        }
+    }
+    catch (hfst_ol::SymmetricDeleteIndexError& e)
+    {
+        fprintf(stderr, "%s\n", e.name.c_str());
+        exit(EXIT_FAILURE);
+    }
+    return *index;
+}
+
+//! @brief the speller of the legacy automata or matrix given as options
+static hfst_ol::Speller*
+new_legacy_speller()
+{
+    // the automata and matrices are read once and live as long as the
+    // process; each speller reads their tables through its own Transducers
+    static Transducer* lex = Transducer::new_from_file(lexicon_filename,
+                                                       mapping);
+    hfst_ol::Speller* speller = 0;
+    if (matrix_filename != "")
+    {
+        static hfst_ol::ConfusionMatrix matrix =
+            hfst_ol::ConfusionMatrix::from_file(matrix_filename, distance);
+        speller = new hfst_ol::Speller(matrix,
+                                       new Transducer(lex->get_storage()));
+    }
+    else
+    {
+        static Transducer* err =
+            Transducer::new_from_file(error_model_filename, mapping);
+        speller = new hfst_ol::Speller(new Transducer(err->get_storage()),
+                                       new Transducer(lex->get_storage()));
+    }
+    if (delete_index_filename != "")
+    {
+        speller->use_delete_index(legacy_delete_index(*lex));
+    }
+    return speller;
+}
+
+//! @brief give @a speller the limits and options of the command line
+static void
+set_options(ZHfstOspeller& speller)
+{
+    speller.set_queue_limit(suggs);
+    speller.set_weight_limit(max_weight);
+    speller.set_beam(beam);
+    speller.set_deepening_weight(deepening_weight);
+    speller.set_case_folding(case_folding);
+    speller.set_edit_distance(edit_distance);
+}
+
+//! @brief load one speller per thread from @a zhfst_filename, or from
+//!        the legacy automata if it is 0, all reading the same tables
+bool
+load_spellers(char* zhfst_filename, std::vector<SpellerHandle>& spellers)
+{
+    hfst_ol::ZHfstOspellerRegistry& registry =
+        hfst_ol::ZHfstOspellerRegistry::instance();
+    registry.set_mapping(mapping);
+    for (unsigned long i = 0; i < threads; ++i)
+    {
+        SpellerHandle speller;
+        if (zhfst_filename != 0)
+        {
+            try
+            {
+                speller = registry.acquire(zhfst_filename);
+            }
+            catch (hfst_ol::ZHfstException& zhe)
+            {
+                hfst_fprintf(stderr, "cannot read zhfst archive %s:\n%s.\n",
+                             zhfst_filename, zhe.what());
+                return false;
+            }
+        }
+        else
+        {
+            speller.reset(new ZHfstOspeller);
+            speller->inject_speller(new_legacy_speller());
+        }
+        set_options(*speller);
+        spellers.push_back(speller);
+    }
+    return true;
+}
+
+//! @brief spell @a count lines starting at @a lines into @a out
+void
+spell_lines(ZHfstOspeller* speller, std::vector<char*>* lines,
+            size_t first, size_t count, std::string* out)
+{
+    out->clear();
+    for (size_t i = first; i < first + count; ++i)
+    {
+        do_spell(*speller, (*lines)[i], out);
+    }
+}
+
+int
+batch_spell(char* zhfst_filename)
+{
+    std::vector<SpellerHandle> spellers;
+    if (!load_spellers(zhfst_filename, spellers))
+    {
+        return EXIT_FAILURE;
+    }
+    std::vector<char> block(1 << 20);
+    size_t carried = 0;
+    std::vector<char*> lines;
+    std::vector<std::string> outputs(threads);
+    while (true)
+    {
+        if (carried == block.size())
+        {
+            // a line longer than the block, make room for the rest of it
+            block.resize(block.size() * 2);
+        }
+        size_t got = fread(&block[carried], 1, block.size() - carried, stdin);
+        bool eof = (got == 0);
+        size_t filled = carried + got;
+        // only complete lines are spelled, the rest waits for more input
+        size_t end = filled;
+        while (!eof && end > 0 && block[end - 1] != '\n')
+        {
+            --end;
+        }
+        if (end == 0)
+        {
+            if (eof)
+            {
+                break;
+            }
+            carried = filled;
+            continue;
+        }
+        if (end == block.size())
+        {
+            // room to terminate a last line without a newline
+            block.push_back('\0');
+        }
+        // split the lines in place
+        lines.clear();
+        char* line = &block[0];
+        char* stop = &block[0] + end;
+        while (line < stop)
+        {
+            char* eol = (char*) memchr(line, '\n', stop - line);
+            if (eol == 0)
+            {
+                eol = stop;
+            }
+            *eol = '\0';
+            if (*line != '\0')
+            {
+                if (eol[-1] == '\r')
+                {
+#ifdef WINDOWS
+                    eol[-1] = '\0';
+#else
+                    hfst_fprintf(stderr, "There is a WINDOWS linebreak in "
+                                 "this file\n"
+                                 "Please convert with dos2unix or fromdos\n");
+                    exit(1);
+#endif
+                }
+                lines.push_back(line);
+            }
+            line = eol + 1;
+        }
+        // each thread spells a contiguous slice so output stays in order
+        std::vector<std::thread> workers;
+        size_t slice = (lines.size() + threads - 1) / threads;
+        for (unsigned long t = 0; t < threads; ++t)
+        {
+            size_t first = std::min(lines.size(), t * slice);
+            size_t count = std::min(slice, lines.size() - first);
+            workers.push_back(std::thread(spell_lines, spellers[t].get(), &lines,
+                                          first, count, &outputs[t]));
+        }
+        for (unsigned long t = 0; t < threads; ++t)
+        {
+            workers[t].join();
+            fwrite(outputs[t].data(), 1, outputs[t].size(), stdout);
+        }
+        if (eof)
+        {
+            break;
+        }
+        carried = filled - end;
+        memmove(&block[0], &block[0] + end, carried);
+    }
+    return EXIT_SUCCESS;
+}
+
+#ifndef WINDOWS
+int
+serve(char* zhfst_filename)
+{
+    std::vector<SpellerHandle> spellers;
+    if (!load_spellers(zhfst_filename, spellers))
+    {
+        return EXIT_FAILURE;
+    }
+    if (verbose)
+    {
+        hfst_fprintf(stderr, "Serving on %s with %lu threads\n",
+                     server_path.c_str(), threads);
+    }
+    return run_spell_server(server_path, spellers);
+}
+#endif
+
 int main(int argc, char **argv)
 {
 
@@ -449,10 +950,23 @@ int main(int argc, char **argv)
             {"limit",        required_argument, 0, 'n'},
             {"max-weight",   required_argument, 0, 'w'},
             {"beam",         required_argument, 0, 'b'},
+            {"deepen",       required_argument, 0, 'i'},
+            {"fold-case",    no_argument,       0, 'c'},
             {"suggest",      no_argument,       0, 'S'},
             {"real-word",    no_argument,       0, 'X'},
             {"error-model",  required_argument, 0, 'm'},
             {"lexicon",      required_argument, 0, 'l'},
+            {"matrix",       required_argument, 0, 'M'},
+            {"distance",     required_argument, 0, 'd'},
+            {"edit-distance", no_argument,      0, 'e'},
+            {"delete-index", required_argument, 0, 'D'},
+            {"batch",        no_argument,       0, 'B'},
+            {"format",       required_argument, 0, 'f'},
+#ifndef WINDOWS
+            {"server",       required_argument, 0, 'u'},
+#endif
+            {"threads",      required_argument, 0, 't'},
+            {"map",          required_argument, 0, 'p'},
 #ifdef WINDOWS
             {"output-to-console", no_argument,  0, 'k'},
 #endif
@@ -460,7 +974,7 @@ int main(int argc, char **argv)
         };
 
         int option_index = 0;
-        c = getopt_long(argc, argv, "hVvqsan:w:b:SXm:l:k", long_options, &option_index);
+        c = getopt_long(argc, argv, "hVvqsan:w:b:i:cSXm:l:M:d:eD:Bf:u:t:p:k", long_options, &option_index);
         char* endptr = 0;
 
         if (c == -1) // no more options to look at
@@ -528,6 +1042,21 @@ int main(int argc, char **argv)
                 fprintf(stderr, "%s truncated from limit parameter\n", endptr);
             }
 
+            break;
+        case 'i':
+            deepening_weight = strtof(optarg, &endptr);
+            if (endptr == optarg)
+            {
+                fprintf(stderr, "%s is not a float\n", optarg);
+                exit(1);
+            }
+            else if (*endptr != '\0')
+            {
+                fprintf(stderr, "%s truncated from limit parameter\n", endptr);
+            }
+            break;
+        case 'c':
+            case_folding = true;
             break;
 #ifdef WINDOWS
         case 'k':
@@ -546,6 +1075,67 @@ int main(int argc, char **argv)
         case 'l':
             lexicon_filename = optarg;
             break;
+        case 'M':
+            matrix_filename = optarg;
+            break;
+        case 'd':
+            distance = strtoul(optarg, &endptr, 10);
+            if (endptr == optarg || distance == 0)
+            {
+                fprintf(stderr, "%s not a positive strtoul number\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'e':
+            edit_distance = true;
+            break;
+        case 'D':
+            delete_index_filename = optarg;
+            break;
+        case 'B':
+            batch = true;
+            break;
+        case 'f':
+            if (strcmp(optarg, "human") == 0)
+            {
+                output_format = HUMAN;
+            }
+            else if (strcmp(optarg, "tsv") == 0)
+            {
+                output_format = TSV;
+            }
+            else if (strcmp(optarg, "json") == 0)
+            {
+                output_format = JSON;
+            }
+            else
+            {
+                fprintf(stderr, "%s is not human, tsv or json\n", optarg);
+                exit(1);
+            }
+            break;
+#ifndef WINDOWS
+        case 'u':
+            server_path = optarg;
+            break;
+#endif
+        case 't':
+            threads = strtoul(optarg, &endptr, 10);
+            if (endptr == optarg || threads == 0)
+            {
+                fprintf(stderr, "%s not a positive strtoul number\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'p':
+            mapping = hfst_ol::parse_mapping_flags(optarg);
+            if (mapping < 0)
+            {
+                fprintf(stderr, "%s is not populate, hugepages or random\n",
+                        optarg);
+                exit(1);
+            }
+            break;
         default:
             std::cerr << "Invalid option\n\n";
             print_short_help();
@@ -559,13 +1149,24 @@ int main(int argc, char **argv)
     // no more options, we should now be at the input filenames
     if (optind == (argc - 1))
     {
-        if (error_model_filename != "" || lexicon_filename != "")
+        if (error_model_filename != "" || lexicon_filename != "" ||
+            matrix_filename != "" || delete_index_filename != "")
         {
             std::cerr << "Give *either* a zhfst speller or --error-model and --lexicon"
                       << std::endl;
             print_short_help();
             return EXIT_FAILURE;
         }
+#ifndef WINDOWS
+        if (server_path != "")
+        {
+            return serve(argv[optind]);
+        }
+#endif
+        if (batch)
+        {
+            return batch_spell(argv[optind]);
+        }
         return zhfst_spell(argv[optind]);
     }
     else if (optind < (argc - 1))
@@ -576,7 +1177,8 @@ int main(int argc, char **argv)
     }
     else if (optind >= argc)
     {
-        if (error_model_filename == "" || lexicon_filename == "")
+        if ((error_model_filename == "" && matrix_filename == "") ||
+            lexicon_filename == "")
         {
             std::cerr << "Give *either* a zhfst speller or --error-model and --lexicon"
                       << std::endl;
@@ -584,10 +1186,17 @@ int main(int argc, char **argv)
             return EXIT_FAILURE;
         }
 
-        Transducer err = hfst_ol::Transducer::from_file(error_model_filename);
-        Transducer lex = hfst_ol::Transducer::from_file(lexicon_filename);
-        hfst_ol::Speller * s = new hfst_ol::Speller(&err, &lex);
-        return legacy_spell(s);
+#ifndef WINDOWS
+        if (server_path != "")
+        {
+            return serve(0);
+        }
+#endif
+        if (batch)
+        {
+            return batch_spell(0);
+        }
+        return legacy_spell(new_legacy_speller());
     }
     return EXIT_SUCCESS;
 }
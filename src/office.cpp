@@ -19,12 +19,14 @@
 */
 
 /*
-	Tests up to 8 variations of each input token:
+	Tests up to 4 variations of each input token:
 	- Verbatim
 	- With leading non-alphanumerics removed
 	- With trailing non-alphanumerics removed
 	- With leading and trailing non-alphanumerics removed
-	- Lower-case of all the above
+	Unless --verbatim, the speller folds case itself, so each variation
+	is checked in lower case, capitalised and in capitals by one search,
+	and suggestions come back in the case of the token.
 */
 
 #include <iostream>
@@ -60,14 +62,12 @@ struct word_t {
 	size_t start, count;
 	UnicodeString buffer;
 };
-std::vector<word_t> words(8);
+std::vector<word_t> words(4);
 std::string buffer;
-UnicodeString ubuffer, uc_buffer;
+UnicodeString ubuffer;
 size_t cw;
 
 bool verbatim = false;
-bool uc_first = false;
-bool uc_all = true;
 
 bool find_alternatives(ZHfstOspeller& speller, size_t suggs) {
 	/* Weights make this entirely pointless
@@ -77,9 +77,8 @@ bool find_alternatives(ZHfstOspeller& speller, size_t suggs) {
 	//*/
 
 	for (size_t k=1 ; k <= cw ; ++k) {
-		buffer.clear();
-		words[cw-k].buffer.toUTF8String(buffer);
-		hfst_ol::CorrectionQueue corrections = speller.suggest(buffer);
+		const UnicodeString& word = words[cw-k].buffer;
+		std::vector<hfst_ol::U16StringWeightPair> corrections = speller.suggest(std::u16string(reinterpret_cast<const char16_t*>(word.getBuffer()), word.length()));
 
 		if (corrections.size() == 0) {
 			continue;
@@ -90,29 +89,19 @@ bool find_alternatives(ZHfstOspeller& speller, size_t suggs) {
 		for (size_t i=0, e=corrections.size() ; i<e && i<suggs ; ++i) {
 			std::cout << "\t";
 
-			buffer.clear();
+			ubuffer.remove();
 			if (cw - k != 0) {
-				words[0].buffer.tempSubString(0, words[cw-k].start).toUTF8String(buffer);
-			}
-			if (uc_all) {
-				UnicodeString::fromUTF8(corrections.top().first).toUpper().toUTF8String(buffer);
-			}
-			else if (uc_first) {
-				uc_buffer.setTo(UnicodeString::fromUTF8(corrections.top().first));
-				ubuffer.setTo(uc_buffer, 0, 1);
-				ubuffer.toUpper();
-				ubuffer.append(uc_buffer, 1, uc_buffer.length()-1);
-				ubuffer.toUTF8String(buffer);
-			}
-			else {
-				buffer.append(corrections.top().first);
+				ubuffer.append(words[0].buffer.tempSubString(0, words[cw-k].start));
 			}
+			// The speller already gave the suggestion the case of the token
+			ubuffer.append(reinterpret_cast<const UChar*>(corrections[i].first.data()), corrections[i].first.size());
 			if (cw - k != 0) {
-				words[0].buffer.tempSubString(words[cw-k].start + words[cw-k].count).toUTF8String(buffer);
+				ubuffer.append(words[0].buffer.tempSubString(words[cw-k].start + words[cw-k].count));
 			}
 
+			buffer.clear();
+			ubuffer.toUTF8String(buffer);
 			std::cout << buffer;
-			corrections.pop();
 		}
 		std::cout << std::endl;
 		return true;
@@ -123,19 +112,11 @@ bool find_alternatives(ZHfstOspeller& speller, size_t suggs) {
 bool is_valid_word(ZHfstOspeller& speller, const std::string& word) {
 	ubuffer.setTo(UnicodeString::fromUTF8(word));
 
-	uc_first = false;
-	uc_all = true;
 	bool has_letters = false;
 	for (int32_t i=0 ; i<ubuffer.length() ; ++i) {
 		if (u_isalpha(ubuffer[i])) {
 			has_letters = true;
-			if (u_isupper(ubuffer[i]) && uc_all) {
-				uc_first = true;
-			}
-			else if (u_islower(ubuffer[i])) {
-				uc_all = false;
-				break;
-			}
+			break;
 		}
 	}
 
@@ -196,36 +177,9 @@ bool is_valid_word(ZHfstOspeller& speller, const std::string& word) {
 		valid_words_t::iterator it = valid_words.find(words[i].buffer);
 
 		if (it == valid_words.end()) {
-			buffer.clear();
-			words[i].buffer.toUTF8String(buffer);
-			bool valid = speller.spell(buffer);
+			const UnicodeString& word = words[i].buffer;
+			bool valid = speller.spell(std::u16string(reinterpret_cast<const char16_t*>(word.getBuffer()), word.length()));
 			it = valid_words.insert(std::make_pair(words[i].buffer,valid)).first;
-
-			if (!valid && !verbatim) {
-				// If the word was not valid, fold it to lower case and try again
-				buffer.clear();
-				ubuffer = words[i].buffer;
-				ubuffer.toLower();
-				ubuffer.toUTF8String(buffer);
-
-				// Add the lower case variant to the list so that we get suggestions using that, if need be
-				words[cw].start = words[i].start;
-				words[cw].count = words[i].count;
-				words[cw].buffer = ubuffer;
-				++cw;
-
-				// Don't try again if the lower cased variant has already been tried
-				valid_words_t::iterator itl = valid_words.find(ubuffer);
-				if (itl != valid_words.end()) {
-					it->second = itl->second;
-					it = itl;
-				}
-				else {
-					valid = speller.spell(buffer);
-					it->second = valid; // Also mark the original mixed case variant as whatever the lower cased one was
-					it = valid_words.insert(std::make_pair(words[i].buffer,valid)).first;
-				}
-			}
 		}
 
 		if (it->second == true) {
@@ -254,6 +208,9 @@ int zhfst_spell(const char* zhfst_filename) {
 		return EXIT_FAILURE;
 	}
 
+	// Capitals are also read as small letters in the same search
+	speller.set_case_folding(!verbatim);
+
 	std::cout << "@@ hfst-ospell-office is alive" << std::endl;
 
 	std::string line;
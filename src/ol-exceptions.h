@@ -85,5 +85,9 @@ HFST_EXCEPTION_CHILD_DECLARATION(UnweightedSpellerException);
 HFST_EXCEPTION_CHILD_DECLARATION(TransducerTypeException);
 
 HFST_EXCEPTION_CHILD_DECLARATION(TransducerReadError);
+
+HFST_EXCEPTION_CHILD_DECLARATION(ConfusionMatrixReadError);
+
+HFST_EXCEPTION_CHILD_DECLARATION(SymmetricDeleteIndexError);
 } // namespace
 #endif // _OL_EXCEPTIONS_H
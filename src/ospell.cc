@@ -16,12 +16,22 @@
 #  include <config.h>
 #endif
 
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "ospell.h"
 
+// Counting compiles away unless statistics were enabled at configure time
+#if USE_STATISTICS
+#  define COUNT_STATISTIC(STATEMENT) \
+    do { if (statistics != 0) { statistics->STATEMENT; } } while (0)
+#else
+#  define COUNT_STATISTIC(STATEMENT) do { } while (0)
+#endif
+
 namespace hfst_ol {
 
 int32_t nByte_utf8(uint8_t c)
@@ -50,6 +60,199 @@ int32_t nByte_utf8(uint8_t c)
     }
 }
 
+//! @brief code points from @c upper to @c last, every one or every other
+//!        as @c step says, whose lower case is @c delta code points on
+struct CaseRange
+{
+    int32_t upper;
+    int32_t last;
+    int32_t step;
+    int32_t delta;
+};
+
+static const CaseRange case_ranges[] =
+{
+    { 0x0041, 0x005a, 1, 32 },   // Basic Latin
+    { 0x00c0, 0x00d6, 1, 32 },   // Latin-1 Supplement
+    { 0x00d8, 0x00de, 1, 32 },
+    { 0x0100, 0x012e, 2, 1 },    // Latin Extended-A, without dotted I
+    { 0x0132, 0x0136, 2, 1 },
+    { 0x0139, 0x0147, 2, 1 },
+    { 0x014a, 0x0176, 2, 1 },
+    { 0x0178, 0x0178, 1, -121 },
+    { 0x0179, 0x017d, 2, 1 },
+    { 0x01b7, 0x01b7, 1, 219 },  // Latin Extended-B, for Sami
+    { 0x01cd, 0x01db, 2, 1 },
+    { 0x01de, 0x01ee, 2, 1 },
+    { 0x01f4, 0x01f4, 1, 1 },
+    { 0x01f8, 0x021e, 2, 1 },
+    { 0x0222, 0x0232, 2, 1 },
+    { 0x0386, 0x0386, 1, 38 },   // Greek
+    { 0x0388, 0x038a, 1, 37 },
+    { 0x038c, 0x038c, 1, 64 },
+    { 0x038e, 0x038f, 1, 63 },
+    { 0x0391, 0x03a1, 1, 32 },
+    { 0x03a3, 0x03ab, 1, 32 },
+    { 0x0400, 0x040f, 1, 80 },   // Cyrillic
+    { 0x0410, 0x042f, 1, 32 },
+    { 0x0460, 0x0480, 2, 1 },
+    { 0x048a, 0x04be, 2, 1 },
+    { 0x04c0, 0x04c0, 1, 15 },
+    { 0x04c1, 0x04cd, 2, 1 },
+    { 0x04d0, 0x052e, 2, 1 },
+    { 0x0531, 0x0556, 1, 48 },   // Armenian
+    { 0x1e00, 0x1e94, 2, 1 },    // Latin Extended Additional
+    { 0x1ea0, 0x1efe, 2, 1 }
+};
+
+//! @brief the other case of @a code, @a code itself if it has none
+static int32_t
+change_case(int32_t code, bool to_upper)
+{
+    for (size_t i = 0; i < sizeof(case_ranges) / sizeof(case_ranges[0]); ++i)
+    {
+        const CaseRange& range = case_ranges[i];
+        int32_t upper = to_upper ? code - range.delta : code;
+        if (upper >= range.upper && upper <= range.last &&
+            (upper - range.upper) % range.step == 0)
+        {
+            return to_upper ? upper : code + range.delta;
+        }
+    }
+    return code;
+}
+
+//! @brief the code point of the utf-8 character at @a i of @a s, @a bytes
+//!        long, or -1 and one byte if there is none
+static int32_t
+decode_utf8(const std::string& s, size_t i, int32_t& bytes)
+{
+    bytes = nByte_utf8(static_cast<uint8_t>(s[i]));
+    if (bytes == 0 || i + bytes > s.size())
+    {
+        bytes = 1;
+        return -1;
+    }
+    static const uint8_t lead_mask[] = { 0, 0x7f, 0x1f, 0x0f, 0x07 };
+    int32_t code = static_cast<uint8_t>(s[i]) & lead_mask[bytes];
+    for (int32_t b = 1; b < bytes; ++b)
+    {
+        code = (code << 6) | (static_cast<uint8_t>(s[i + b]) & 0x3f);
+    }
+    return code;
+}
+
+//! @brief @a s with each character changed by change_case(); bytes that
+//!        are no utf-8 are kept
+static std::string
+utf8_change_case(const std::string& s, bool to_upper)
+{
+    std::string changed;
+    changed.reserve(s.size());
+    size_t i = 0;
+    while (i < s.size())
+    {
+        int32_t bytes;
+        int32_t code = decode_utf8(s, i, bytes);
+        int32_t other = (code < 0) ? code : change_case(code, to_upper);
+        if (other == code)
+        {
+            changed.append(s, i, bytes);
+        }
+        else
+        {
+            uint8_t other_bytes[4];
+            changed.append(reinterpret_cast<const char*>(other_bytes),
+                           encode_utf8(other, other_bytes));
+        }
+        i += bytes;
+    }
+    return changed;
+}
+
+std::string utf8_to_lower(const std::string& s)
+{
+    return utf8_change_case(s, false);
+}
+
+std::string utf8_to_upper(const std::string& s)
+{
+    return utf8_change_case(s, true);
+}
+
+//! @brief the code units of @a s in the encoding of @a S; bytes that are
+//!        no utf-8 become U+FFFD
+template <typename S>
+static S
+utf8_to_code_units(const std::string& s)
+{
+    S units;
+    units.reserve(s.size());
+    size_t i = 0;
+    while (i < s.size())
+    {
+        int32_t bytes;
+        int32_t code = decode_utf8(s, i, bytes);
+        if (code < 0)
+        {
+            code = 0xFFFD;
+        }
+        if (sizeof(typename S::value_type) == 2 && code >= 0x10000)
+        {
+            // a surrogate pair
+            code -= 0x10000;
+            units.push_back(0xD800 + (code >> 10));
+            units.push_back(0xDC00 + (code & 0x3FF));
+        }
+        else
+        {
+            units.push_back(code);
+        }
+        i += bytes;
+    }
+    return units;
+}
+
+//! @brief the utf-8 of the code units of @a s; units that are no character
+//!        become U+FFFD
+template <typename S>
+static std::string
+code_units_to_utf8(const S& s)
+{
+    std::string utf8;
+    utf8.reserve(s.size());
+    const typename S::value_type* p = s.data();
+    const typename S::value_type* end = p + s.size();
+    while (p < end)
+    {
+        int32_t code = decode_code_point(&p, end);
+        uint8_t bytes[4];
+        utf8.append(reinterpret_cast<const char*>(bytes),
+                    encode_utf8((code < 0) ? 0xFFFD : code, bytes));
+    }
+    return utf8;
+}
+
+std::u16string utf8_to_utf16(const std::string& s)
+{
+    return utf8_to_code_units<std::u16string>(s);
+}
+
+std::u32string utf8_to_utf32(const std::string& s)
+{
+    return utf8_to_code_units<std::u32string>(s);
+}
+
+std::string utf16_to_utf8(const std::u16string& s)
+{
+    return code_units_to_utf8(s);
+}
+
+std::string utf32_to_utf8(const std::u32string& s)
+{
+    return code_units_to_utf8(s);
+}
+
 bool
 StringWeightComparison::operator()(StringWeightPair lhs, StringWeightPair rhs)
 { // return true when we want rhs to appear before lhs
@@ -134,15 +337,102 @@ Transducer::Transducer(int8_t* raw) :
 {
 }
 
-Transducer::~Transducer()
+Transducer::Transducer(const TransducerStoragePtr& storage) :
+    Transducer(storage->data())
+{
+    storage_ = storage;
+}
+
+Transducer::Transducer(Transducer&& other) :
+    storage_(std::move(other.storage_)),
+    header(other.header),
+    alphabet(std::move(other.alphabet)),
+    keys(alphabet.get_key_table()),
+    encoder(std::move(other.encoder)),
+    indices(other.indices),
+    transitions(other.transitions)
+{
+}
+
+Transducer&
+Transducer::operator=(Transducer&& other)
+{
+    storage_ = std::move(other.storage_);
+    header = other.header;
+    alphabet = std::move(other.alphabet);
+    keys = alphabet.get_key_table();
+    encoder = std::move(other.encoder);
+    indices = other.indices;
+    transitions = other.transitions;
+    return *this;
+}
+
+TransducerStoragePtr
+Transducer::get_storage(void) const
+{
+    return storage_;
+}
+
+TransducerStorage::TransducerStorage(int8_t* data, size_t len, Kind kind) :
+    data_(data),
+    len_(len),
+    kind_(kind)
+{
+}
+
+TransducerStorage::~TransducerStorage()
+{
+    if (kind_ == Mapped)
+    {
+        munmap(data_, len_);
+    }
+    else
+    {
+        delete[] data_;
+    }
+}
+
+//! @brief read @a sz bytes of @a fd into anonymous huge page memory.
+//
+//! File backed pages cannot be transparent huge pages, so the automaton is
+//! copied. Returns 0 if the kernel cannot provide such memory.
+static int8_t* copy_to_huge_pages(int32_t fd, const size_t sz)
 {
-    if (raw_ != nullptr)
+    #ifdef MADV_HUGEPAGE
+    int8_t* ptr = (int8_t*) mmap(NULL, sz, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        return 0;
+    }
+    // the advice must come before the pages are touched
+    madvise(ptr, sz, MADV_HUGEPAGE);
+    size_t done = 0;
+    while (done < sz)
     {
-        munmap(raw_, len_);
+        ssize_t got = pread(fd, ptr + done, sz - done, done);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            munmap(ptr, sz);
+            return 0;
+        }
+        done += got;
     }
+    mprotect(ptr, sz, PROT_READ);
+    return ptr;
+    #else
+    (void) fd;
+    (void) sz;
+    return 0;
+    #endif
 }
 
-inline int8_t* mmap_file(const std::string &filename, const size_t sz)
+inline int8_t* mmap_file(const std::string &filename, const size_t sz,
+                         int mapping)
 {
     int32_t fd = open(filename.c_str(), O_RDONLY);
 
@@ -151,12 +441,41 @@ inline int8_t* mmap_file(const std::string &filename, const size_t sz)
         HFST_THROW_MESSAGE(TransducerReadError, "the file '" + filename + "' could not be read.\n");
     }
 
-    int8_t* ptr = (int8_t*) mmap(NULL, sz, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
+    int8_t* ptr = 0;
+    if (mapping & MapHugePages)
+    {
+        ptr = copy_to_huge_pages(fd, sz);
+    }
+    if (ptr == 0)
+    {
+        int flags = MAP_FILE | MAP_SHARED;
+        #ifdef MAP_POPULATE
+        if (mapping & MapPopulate)
+        {
+            flags |= MAP_POPULATE;
+        }
+        #endif
+        ptr = (int8_t*) mmap(NULL, sz, PROT_READ, flags, fd, 0);
+    }
+    close(fd);
     if (ptr == MAP_FAILED)
     {
         HFST_THROW_MESSAGE(TransducerReadError, "the file '" + filename + "' could not be mmapped.\n");
     }
 
+    #ifndef MAP_POPULATE
+    if (mapping & MapPopulate)
+    {
+        // fault the pages in now rather than during the first queries
+        long page = sysconf(_SC_PAGESIZE);
+        volatile int8_t sink = 0;
+        for (size_t i = 0; i < sz; i += page)
+        {
+            sink += ptr[i];
+        }
+    }
+    #endif
+
     #if __APPLE__
     madvise(ptr, sz, MADV_SEQUENTIAL);
     #endif
@@ -164,6 +483,39 @@ inline int8_t* mmap_file(const std::string &filename, const size_t sz)
     return ptr;
 }
 
+int parse_mapping_flags(const std::string& names)
+{
+    int mapping = MapDefault;
+    size_t start = 0;
+    while (start <= names.size())
+    {
+        size_t end = names.find(',', start);
+        if (end == std::string::npos)
+        {
+            end = names.size();
+        }
+        std::string name = names.substr(start, end - start);
+        if (name == "populate")
+        {
+            mapping |= MapPopulate;
+        }
+        else if (name == "hugepages")
+        {
+            mapping |= MapHugePages;
+        }
+        else if (name == "random")
+        {
+            mapping |= MapRandom;
+        }
+        else if (name != "")
+        {
+            return -1;
+        }
+        start = end + 1;
+    }
+    return mapping;
+}
+
 inline size_t file_size(const std::string &filename)
 {
     struct stat statbuf;
@@ -176,30 +528,38 @@ inline size_t file_size(const std::string &filename)
     return statbuf.st_size;
 }
 
-Transducer*
-Transducer::new_from_file(const std::string &filename)
+TransducerStoragePtr
+TransducerStorage::from_file(const std::string &filename, int mapping)
 {
     size_t sz = file_size(filename);
-    int8_t* ptr = mmap_file(filename, sz);
+    return TransducerStoragePtr(
+        new TransducerStorage(mmap_file(filename, sz, mapping), sz,
+                              TransducerStorage::Mapped));
+}
 
-    Transducer* trans = new Transducer(ptr);
+Transducer*
+Transducer::new_from_file(const std::string &filename, int mapping)
+{
+    Transducer* trans = new Transducer(TransducerStorage::from_file(filename,
+                                                                    mapping));
 
-    trans->raw_ = ptr;
-    trans->len_ = sz;
+    if (mapping & MapRandom)
+    {
+        trans->indices.advise(MADV_RANDOM);
+    }
 
     return trans;
 }
 
 Transducer
-Transducer::from_file(const std::string &filename)
+Transducer::from_file(const std::string &filename, int mapping)
 {
-    size_t sz = file_size(filename);
-    int8_t* ptr = mmap_file(filename, sz);
+    Transducer trans(TransducerStorage::from_file(filename, mapping));
 
-    Transducer trans(ptr);
-
-    trans.raw_ = ptr;
-    trans.len_ = sz;
+    if (mapping & MapRandom)
+    {
+        trans.indices.advise(MADV_RANDOM);
+    }
 
     return trans;
 }
@@ -207,13 +567,27 @@ Transducer::from_file(const std::string &filename)
 TreeNode TreeNode::update_lexicon(SymbolNumber symbol,
                                   TransitionTableIndex next_lexicon,
                                   Weight weight)
+{
+    return update_lexicon(symbol, 0, next_lexicon, weight);
+}
+
+TreeNode TreeNode::update_lexicon(SymbolNumber symbol,
+                                  SymbolNumber analysis_symbol,
+                                  TransitionTableIndex next_lexicon,
+                                  Weight weight)
 {
     SymbolVector str(this->string);
     if (symbol != 0)
     {
         str.push_back(symbol);
     }
+    SymbolVector ana(this->analysis);
+    if (analysis_symbol != 0)
+    {
+        ana.push_back(analysis_symbol);
+    }
     return TreeNode(str,
+                    ana,
                     this->input_state,
                     this->mutator_state,
                     next_lexicon,
@@ -225,6 +599,7 @@ TreeNode TreeNode::update_mutator(TransitionTableIndex next_mutator,
                                   Weight weight)
 {
     return TreeNode(this->string,
+                    this->analysis,
                     this->input_state,
                     next_mutator,
                     this->lexicon_state,
@@ -237,13 +612,29 @@ TreeNode TreeNode::update(SymbolNumber symbol,
                           TransitionTableIndex next_mutator,
                           TransitionTableIndex next_lexicon,
                           Weight weight)
+{
+    return update(symbol, 0, next_input, next_mutator, next_lexicon, weight);
+}
+
+TreeNode TreeNode::update(SymbolNumber symbol,
+                          SymbolNumber analysis_symbol,
+                          uint32_t next_input,
+                          TransitionTableIndex next_mutator,
+                          TransitionTableIndex next_lexicon,
+                          Weight weight)
 {
     SymbolVector str(this->string);
     if (symbol != 0)
     {
         str.push_back(symbol);
     }
+    SymbolVector ana(this->analysis);
+    if (analysis_symbol != 0)
+    {
+        ana.push_back(analysis_symbol);
+    }
     return TreeNode(str,
+                    ana,
                     next_input,
                     next_mutator,
                     next_lexicon,
@@ -256,20 +647,12 @@ TreeNode TreeNode::update(SymbolNumber symbol,
                           TransitionTableIndex next_lexicon,
                           Weight weight)
 {
-    SymbolVector str(this->string);
-    if (symbol != 0)
-    {
-        str.push_back(symbol);
-    }
-    return TreeNode(str,
-                    this->input_state,
-                    next_mutator,
-                    next_lexicon,
-                    this->flag_state,
-                    this->weight + weight);
+    return update(symbol, 0, this->input_state, next_mutator, next_lexicon,
+                  weight);
 }
 
-bool TreeNode::try_compatible_with(FlagDiacriticOperation op)
+bool try_compatible_with(FlagDiacriticState& flag_state,
+                         FlagDiacriticOperation op)
 {
     switch (op.Operation())
     {
@@ -318,6 +701,11 @@ bool TreeNode::try_compatible_with(FlagDiacriticOperation op)
     return false; // to make the compiler happy
 }
 
+bool TreeNode::try_compatible_with(FlagDiacriticOperation op)
+{
+    return hfst_ol::try_compatible_with(flag_state, op);
+}
+
 Speller::Speller(Transducer* mutator_ptr, Transducer* lexicon_ptr) :
     mutator(mutator_ptr),
     lexicon(lexicon_ptr),
@@ -327,6 +715,26 @@ Speller::Speller(Transducer* mutator_ptr, Transducer* lexicon_ptr) :
     limit(std::numeric_limits<Weight>::max()),
     alphabet_translator(SymbolVector()),
     operations(lexicon->get_operations()),
+    statistics(0),
+    max_nodes(0),
+    max_arcs(0),
+    max_seconds(0.0),
+    arcs_scanned(0),
+    partial(false),
+    deterministic_lexicon(
+        lexicon->get_header()->probe_flag(Input_deterministic) &&
+        !lexicon->get_header()->probe_flag(Has_input_epsilon_transitions) &&
+        lexicon->get_state_size() == 0),
+    open_alphabet(lexicon->get_unknown() != NO_SYMBOL ||
+                  lexicon->get_identity() != NO_SYMBOL ||
+                  (mutator != NULL &&
+                   (mutator->get_unknown() != NO_SYMBOL ||
+                    mutator->get_identity() != NO_SYMBOL))),
+    matrix(0),
+    edit_unit(0.0),
+    delete_index(0),
+    deepening_weight(0.0),
+    weight_limited(false),
     limiting(None),
     mode(Correct)
 {
@@ -338,6 +746,21 @@ Speller::Speller(Transducer* mutator_ptr, Transducer* lexicon_ptr) :
             mutator->get_key_table()->size(), CacheContainer());
         #endif
     }
+    else
+    {
+        // without an error model the input is read as lexicon symbols
+        for (SymbolNumber i = 0; i < lexicon->get_key_table()->size(); ++i)
+        {
+            alphabet_translator.push_back(i);
+        }
+    }
+}
+
+Speller::Speller(const ConfusionMatrix& confusion_matrix,
+                 Transducer* lexicon_ptr) :
+    Speller(static_cast<Transducer*>(0), lexicon_ptr)
+{
+    use_matrix(confusion_matrix);
 }
 
 
@@ -348,6 +771,11 @@ Speller::get_state_size()
 }
 
 
+// The traversal below is templated on the search mode, on whether weights
+// must stay strictly under the limit (n-best only) and on whether unknown
+// or identity arcs exist, so each query runs a kernel without those tests.
+
+template <Speller::Mode MODE, bool STRICT, bool OPEN>
 void Speller::lexicon_epsilons(void)
 {
     if (!lexicon->has_epsilons_or_flags(next_node.lexicon_state + 1))
@@ -359,13 +787,30 @@ void Speller::lexicon_epsilons(void)
 
     while (i_s.symbol != NO_SYMBOL)
     {
-        if (is_under_weight_limit(next_node.weight + i_s.weight))
+        ++arcs_scanned;
+        COUNT_STATISTIC(arcs_scanned++);
+        if (is_under_weight_limit<MODE, STRICT>(next_node.weight + i_s.weight))
         {
             if (lexicon->transitions.input_symbol(next) == 0)
             {
-                node_queue.push_back(next_node.update_lexicon((mode == Correct) ? 0 : i_s.symbol,
-                                                              i_s.index,
-                                                              i_s.weight));
+                COUNT_STATISTIC(epsilon_expansions++);
+                COUNT_STATISTIC(nodes_pushed++);
+                if (MODE == CorrectAnalyse)
+                {
+                    // surface stays, the output goes to the analysis
+                    node_queue.push_back(next_node.update_lexicon(0,
+                                                                  i_s.symbol,
+                                                                  i_s.index,
+                                                                  i_s.weight));
+                    prefetch_queued<MODE>();
+                }
+                else
+                {
+                    node_queue.push_back(next_node.update_lexicon((MODE == Correct) ? 0 : i_s.symbol,
+                                                                  i_s.index,
+                                                                  i_s.weight));
+                    prefetch_queued<MODE>();
+                }
             }
             else
             {
@@ -377,7 +822,10 @@ void Speller::lexicon_epsilons(void)
                     node_queue.push_back(next_node.update_lexicon(0,
                                                                   i_s.index,
                                                                   i_s.weight));
+                    prefetch_queued<MODE>();
                     next_node.flag_state = old_flags;
+                    COUNT_STATISTIC(flag_expansions++);
+                    COUNT_STATISTIC(nodes_pushed++);
                 }
             }
         }
@@ -386,6 +834,7 @@ void Speller::lexicon_epsilons(void)
     }
 }
 
+template <Speller::Mode MODE, bool STRICT, bool OPEN>
 void Speller::lexicon_consume(void)
 {
     uint32_t input_state = next_node.input_state;
@@ -394,12 +843,24 @@ void Speller::lexicon_consume(void)
         // no more input
         return;
     }
-    SymbolNumber this_input = alphabet_translator[input[input_state]];
+    SymbolNumber input_sym = input[input_state];
+    lexicon_consume_symbol<MODE, STRICT, OPEN>(alphabet_translator[input_sym]);
+    if (!lower_case.empty() && lower_case[input_sym] != NO_SYMBOL)
+    {
+        // a capital may also be read as its small letter
+        lexicon_consume_symbol<MODE, STRICT, OPEN>(
+            alphabet_translator[lower_case[input_sym]]);
+    }
+}
+
+template <Speller::Mode MODE, bool STRICT, bool OPEN>
+void Speller::lexicon_consume_symbol(SymbolNumber this_input)
+{
     if (!lexicon->has_transitions(
             next_node.lexicon_state + 1, this_input))
     {
         // we have no regular transitions for this
-        if (this_input >= lexicon->get_alphabet()->get_orig_symbol_count())
+        if (OPEN && this_input >= lexicon->get_alphabet()->get_orig_symbol_count())
         {
             // this input was not originally in the alphabet, so unknown or identity
             // may apply
@@ -407,25 +868,26 @@ void Speller::lexicon_consume(void)
                 lexicon->has_transitions(next_node.lexicon_state + 1,
                                          lexicon->get_unknown()))
             {
-                queue_lexicon_arcs(lexicon->get_unknown(),
-                                   next_node.mutator_state,
-                                   0.0, 1);
+                queue_lexicon_arcs<MODE, STRICT, OPEN>(lexicon->get_unknown(),
+                                                       next_node.mutator_state,
+                                                       0.0, 1);
             }
             if (lexicon->get_identity() != NO_SYMBOL &&
                 lexicon->has_transitions(next_node.lexicon_state + 1,
                                          lexicon->get_identity()))
             {
-                queue_lexicon_arcs(lexicon->get_identity(),
-                                   next_node.mutator_state,
-                                   0.0, 1);
+                queue_lexicon_arcs<MODE, STRICT, OPEN>(lexicon->get_identity(),
+                                                       next_node.mutator_state,
+                                                       0.0, 1);
             }
         }
         return;
     }
-    queue_lexicon_arcs(this_input,
-                       next_node.mutator_state, 0.0, 1);
+    queue_lexicon_arcs<MODE, STRICT, OPEN>(this_input,
+                                           next_node.mutator_state, 0.0, 1);
 }
 
+template <Speller::Mode MODE, bool STRICT, bool OPEN>
 void Speller::queue_lexicon_arcs(SymbolNumber input_sym,
                                  uint32_t mutator_state,
                                  Weight mutator_weight,
@@ -436,24 +898,41 @@ void Speller::queue_lexicon_arcs(SymbolNumber input_sym,
     STransition i_s = lexicon->take_non_epsilons(next, input_sym);
     while (i_s.symbol != NO_SYMBOL)
     {
-        if (i_s.symbol == lexicon->get_identity())
+        ++arcs_scanned;
+        COUNT_STATISTIC(arcs_scanned++);
+        if (OPEN && i_s.symbol == lexicon->get_identity())
         {
             i_s.symbol = input[next_node.input_state];
         }
-        if (mode == Correct || is_under_weight_limit(next_node.weight + i_s.weight + mutator_weight))
+        if (MODE == CorrectAnalyse)
+        {
+            node_queue.push_back(next_node.update(
+                                     input_sym,
+                                     i_s.symbol,
+                                     next_node.input_state + input_increment,
+                                     mutator_state,
+                                     i_s.index,
+                                     i_s.weight + mutator_weight));
+            prefetch_queued<MODE>();
+            COUNT_STATISTIC(nodes_pushed++);
+        }
+        else if (MODE == Correct || is_under_weight_limit<MODE, STRICT>(next_node.weight + i_s.weight + mutator_weight))
         {
             node_queue.push_back(next_node.update(
-                                     (mode == Correct) ? input_sym : i_s.symbol,
+                                     (MODE == Correct) ? input_sym : i_s.symbol,
                                      next_node.input_state + input_increment,
                                      mutator_state,
                                      i_s.index,
                                      i_s.weight + mutator_weight));
+            prefetch_queued<MODE>();
+            COUNT_STATISTIC(nodes_pushed++);
         }
         ++next;
         i_s = lexicon->take_non_epsilons(next, input_sym);
     }
 }
 
+template <Speller::Mode MODE, bool STRICT, bool OPEN>
 void Speller::mutator_epsilons(void)
 {
     if (!mutator->has_transitions(next_node.mutator_state + 1, 0))
@@ -465,13 +944,18 @@ void Speller::mutator_epsilons(void)
 
     while (mutator_i_s.symbol != NO_SYMBOL)
     {
+        ++arcs_scanned;
+        COUNT_STATISTIC(arcs_scanned++);
         if (mutator_i_s.symbol == 0)
         {
-            if (is_under_weight_limit(
+            if (is_under_weight_limit<MODE, STRICT>(
                     next_node.weight + mutator_i_s.weight))
             {
                 node_queue.push_back(next_node.update_mutator(mutator_i_s.index,
                                                               mutator_i_s.weight));
+                prefetch_queued<MODE>();
+                COUNT_STATISTIC(epsilon_expansions++);
+                COUNT_STATISTIC(nodes_pushed++);
             }
             ++next_m;
             mutator_i_s = mutator->take_epsilons(next_m);
@@ -482,7 +966,7 @@ void Speller::mutator_epsilons(void)
                      alphabet_translator[mutator_i_s.symbol]))
         {
             // we have no regular transitions for this
-            if (alphabet_translator[mutator_i_s.symbol] >= lexicon->get_alphabet()->get_orig_symbol_count())
+            if (OPEN && alphabet_translator[mutator_i_s.symbol] >= lexicon->get_alphabet()->get_orig_symbol_count())
             {
                 // this input was not originally in the alphabet, so unknown or identity
                 // may apply
@@ -490,38 +974,96 @@ void Speller::mutator_epsilons(void)
                     lexicon->has_transitions(next_node.lexicon_state + 1,
                                              lexicon->get_unknown()))
                 {
-                    queue_lexicon_arcs(lexicon->get_unknown(),
-                                       mutator_i_s.index, mutator_i_s.weight);
+                    queue_lexicon_arcs<MODE, STRICT, OPEN>(lexicon->get_unknown(),
+                                                           mutator_i_s.index, mutator_i_s.weight);
                 }
                 if (lexicon->get_identity() != NO_SYMBOL &&
                     lexicon->has_transitions(next_node.lexicon_state + 1,
                                              lexicon->get_identity()))
                 {
-                    queue_lexicon_arcs(lexicon->get_identity(),
-                                       mutator_i_s.index, mutator_i_s.weight);
+                    queue_lexicon_arcs<MODE, STRICT, OPEN>(lexicon->get_identity(),
+                                                           mutator_i_s.index, mutator_i_s.weight);
                 }
             }
             ++next_m;
             mutator_i_s = mutator->take_epsilons(next_m);
             continue;
         }
-        queue_lexicon_arcs(alphabet_translator[mutator_i_s.symbol],
-                           mutator_i_s.index, mutator_i_s.weight);
+        queue_lexicon_arcs<MODE, STRICT, OPEN>(alphabet_translator[mutator_i_s.symbol],
+                                               mutator_i_s.index, mutator_i_s.weight);
         ++next_m;
         mutator_i_s = mutator->take_epsilons(next_m);
     }
 }
 
 
-bool Speller::is_under_weight_limit(Weight w) const
+// Defined here rather than in the header, where USE_PREFETCH from config.h
+// could differ between the library and the programs including it
+void Transducer::prefetch(const TransitionTableIndex i,
+                          const SymbolNumber symbol) const
+{
+    #if USE_PREFETCH
+    if (i >= TARGET_TABLE)
+    {
+        __builtin_prefetch(transitions.address(i - TARGET_TABLE));
+    }
+    else
+    {
+        // finality and epsilons are at the start of the row
+        __builtin_prefetch(indices.address(i));
+        if (symbol != NO_SYMBOL)
+        {
+            __builtin_prefetch(indices.address(i + 1 + symbol));
+        }
+    }
+    #else
+    (void) i;
+    (void) symbol;
+    #endif
+}
+
+template <Speller::Mode MODE>
+void Speller::prefetch_queued(void) const
+{
+    #if USE_PREFETCH
+    // nodes pushed early are popped last, so their rows have time to arrive
+    const TreeNode& node = node_queue.back();
+    bool more_input = node.input_state < input.size();
+    if (MODE == Check || MODE == Lookup)
+    {
+        lexicon->prefetch(node.lexicon_state,
+                          more_input ?
+                          alphabet_translator[input[node.input_state]] :
+                          NO_SYMBOL);
+    }
+    else
+    {
+        // the lexicon symbol depends on the error model arc taken later
+        lexicon->prefetch(node.lexicon_state, NO_SYMBOL);
+        mutator->prefetch(node.mutator_state,
+                          more_input ? input[node.input_state] : NO_SYMBOL);
+    }
+    #endif
+}
+
+template <Speller::Mode MODE, bool STRICT>
+bool Speller::is_under_weight_limit(Weight w)
 {
-    if (limiting == Nbest)
+    if (MODE == Check || MODE == Lookup)
+    {
+        // only corrections have a weight limit
+        return true;
+    }
+    bool under = STRICT ? (w < limit) : (w <= limit);
+    if (!under)
     {
-        return w < limit;
+        COUNT_STATISTIC(pruned++);
+        weight_limited = true;
     }
-    return w <= limit;
+    return under;
 }
 
+template <Speller::Mode MODE, bool STRICT, bool OPEN>
 void Speller::consume_input()
 {
     if (next_node.input_state >= input.size())
@@ -529,11 +1071,22 @@ void Speller::consume_input()
         return; // not enough input to consume
     }
     SymbolNumber input_sym = input[next_node.input_state];
+    consume_input_symbol<MODE, STRICT, OPEN>(input_sym);
+    if (!lower_case.empty() && lower_case[input_sym] != NO_SYMBOL)
+    {
+        // a capital may also be read as its small letter
+        consume_input_symbol<MODE, STRICT, OPEN>(lower_case[input_sym]);
+    }
+}
+
+template <Speller::Mode MODE, bool STRICT, bool OPEN>
+void Speller::consume_input_symbol(SymbolNumber input_sym)
+{
     if (!mutator->has_transitions(next_node.mutator_state + 1,
                                   input_sym))
     {
         // we have no regular transitions for this
-        if (input_sym >= mutator->get_alphabet()->get_orig_symbol_count())
+        if (OPEN && input_sym >= mutator->get_alphabet()->get_orig_symbol_count())
         {
             // this input was not originally in the alphabet, so unknown or identity
             // may apply
@@ -541,22 +1094,23 @@ void Speller::consume_input()
                 mutator->has_transitions(next_node.mutator_state + 1,
                                          mutator->get_identity()))
             {
-                queue_mutator_arcs(mutator->get_identity());
+                queue_mutator_arcs<MODE, STRICT, OPEN>(mutator->get_identity());
             }
             if (mutator->get_unknown() != NO_SYMBOL &&
                 mutator->has_transitions(next_node.mutator_state + 1,
                                          mutator->get_unknown()))
             {
-                queue_mutator_arcs(mutator->get_unknown());
+                queue_mutator_arcs<MODE, STRICT, OPEN>(mutator->get_unknown());
             }
         }
     }
     else
     {
-        queue_mutator_arcs(input_sym);
+        queue_mutator_arcs<MODE, STRICT, OPEN>(input_sym);
     }
 }
 
+template <Speller::Mode MODE, bool STRICT, bool OPEN>
 void Speller::queue_mutator_arcs(SymbolNumber input_sym)
 {
     TransitionTableIndex next_m = mutator->next(next_node.mutator_state,
@@ -565,15 +1119,19 @@ void Speller::queue_mutator_arcs(SymbolNumber input_sym)
                                                          input_sym);
     while (mutator_i_s.symbol != NO_SYMBOL)
     {
+        ++arcs_scanned;
+        COUNT_STATISTIC(arcs_scanned++);
         if (mutator_i_s.symbol == 0)
         {
-            if (is_under_weight_limit(
+            if (is_under_weight_limit<MODE, STRICT>(
                     next_node.weight + mutator_i_s.weight))
             {
                 node_queue.push_back(next_node.update(0, next_node.input_state + 1,
                                                       mutator_i_s.index,
                                                       next_node.lexicon_state,
                                                       mutator_i_s.weight));
+                prefetch_queued<MODE>();
+                COUNT_STATISTIC(nodes_pushed++);
             }
             ++next_m;
             mutator_i_s = mutator->take_non_epsilons(next_m, input_sym);
@@ -584,7 +1142,7 @@ void Speller::queue_mutator_arcs(SymbolNumber input_sym)
                      alphabet_translator[mutator_i_s.symbol]))
         {
             // we have no regular transitions for this
-            if (alphabet_translator[mutator_i_s.symbol] >= lexicon->get_alphabet()->get_orig_symbol_count())
+            if (OPEN && alphabet_translator[mutator_i_s.symbol] >= lexicon->get_alphabet()->get_orig_symbol_count())
             {
                 // this input was not originally in the alphabet, so unknown or identity
                 // may apply
@@ -592,23 +1150,23 @@ void Speller::queue_mutator_arcs(SymbolNumber input_sym)
                     lexicon->has_transitions(next_node.lexicon_state + 1,
                                              lexicon->get_unknown()))
                 {
-                    queue_lexicon_arcs(lexicon->get_unknown(),
-                                       mutator_i_s.index, mutator_i_s.weight, 1);
+                    queue_lexicon_arcs<MODE, STRICT, OPEN>(lexicon->get_unknown(),
+                                                           mutator_i_s.index, mutator_i_s.weight, 1);
                 }
                 if (lexicon->get_identity() != NO_SYMBOL &&
                     lexicon->has_transitions(next_node.lexicon_state + 1,
                                              lexicon->get_identity()))
                 {
-                    queue_lexicon_arcs(lexicon->get_identity(),
-                                       mutator_i_s.index, mutator_i_s.weight, 1);
+                    queue_lexicon_arcs<MODE, STRICT, OPEN>(lexicon->get_identity(),
+                                                           mutator_i_s.index, mutator_i_s.weight, 1);
                 }
             }
             ++next_m;
             mutator_i_s = mutator->take_non_epsilons(next_m, input_sym);
             continue;
         }
-        queue_lexicon_arcs(alphabet_translator[mutator_i_s.symbol],
-                           mutator_i_s.index, mutator_i_s.weight, 1);
+        queue_lexicon_arcs<MODE, STRICT, OPEN>(alphabet_translator[mutator_i_s.symbol],
+                                               mutator_i_s.index, mutator_i_s.weight, 1);
         ++next_m;
         mutator_i_s = mutator->take_non_epsilons(next_m,
                                                  input_sym);
@@ -789,6 +1347,12 @@ Transducer::get_identity() const
     return alphabet.get_identity();
 }
 
+TransducerHeader*
+Transducer::get_header()
+{
+    return &header;
+}
+
 TransducerAlphabet*
 Transducer::get_alphabet()
 {
@@ -938,9 +1502,17 @@ Transducer::is_weighted(void)
 }
 
 
-AnalysisQueue Speller::analyse(int8_t* line)
+size_t
+Transducer::get_table_size(void)
+{
+    return (size_t) header.index_table_size() * TransitionIndex::SIZE +
+           (size_t) header.target_table_size() * Transition::SIZE;
+}
+
+AnalysisQueue Speller::analyse(int8_t* line, SearchStatistics* stats)
 {
     mode = Lookup;
+    statistics = stats;
     if (!init_input(line))
     {
         return AnalysisQueue();
@@ -948,8 +1520,32 @@ AnalysisQueue Speller::analyse(int8_t* line)
     std::map<std::string, Weight> outputs;
     TreeNode start_node(FlagDiacriticState(get_state_size(), 0));
     node_queue.assign(1, start_node);
+    COUNT_STATISTIC(nodes_pushed++);
+    if (open_alphabet)
+    {
+        analyse_nodes<true>(outputs);
+    }
+    else
+    {
+        analyse_nodes<false>(outputs);
+    }
+
+    AnalysisQueue analyses;
+    std::map<std::string, Weight>::const_iterator it;
+    for (it = outputs.begin(); it != outputs.end(); ++it)
+    {
+        analyses.push(StringWeightPair(it->first, it->second));
+    }
+
+    return analyses;
+}
+
+template <bool OPEN>
+void Speller::analyse_nodes(std::map<std::string, Weight>& outputs)
+{
     while (node_queue.size() > 0)
     {
+        COUNT_STATISTIC(pop(node_queue.size()));
         next_node = node_queue.back();
         node_queue.pop_back();
         // Final states
@@ -960,6 +1556,11 @@ AnalysisQueue Speller::analyse(int8_t* line)
                             lexicon->final_weight(next_node.lexicon_state);
             std::string output = stringify(lexicon->get_key_table(),
                                            next_node.string);
+            COUNT_STATISTIC(finals++);
+            if (outputs.count(output) != 0)
+            {
+                COUNT_STATISTIC(duplicate_finals++);
+            }
             // if the result is novel or lower weighted than before, insert it
             if (outputs.count(output) == 0 ||
                 outputs[output] > weight)
@@ -967,18 +1568,9 @@ AnalysisQueue Speller::analyse(int8_t* line)
                 outputs[output] = weight;
             }
         }
-        lexicon_epsilons();
-        lexicon_consume();
+        lexicon_epsilons<Lookup, false, OPEN>();
+        lexicon_consume<Lookup, false, OPEN>();
     }
-
-    AnalysisQueue analyses;
-    std::map<std::string, Weight>::const_iterator it;
-    for (it = outputs.begin(); it != outputs.end(); ++it)
-    {
-        analyses.push(StringWeightPair(it->first, it->second));
-    }
-
-    return analyses;
 }
 
 #if USE_CACHE
@@ -987,20 +1579,23 @@ void Speller::clear_cache(void)
     cache.clear();
 }
 
+template <bool OPEN>
 void Speller::build_cache(SymbolNumber first_sym)
 {
     TreeNode start_node(FlagDiacriticState(get_state_size(), 0));
     node_queue.assign(1, start_node);
+    COUNT_STATISTIC(nodes_pushed++);
     limit = std::numeric_limits<Weight>::max();
     // A placeholding map, only one weight per correction
     StringWeightMap corrections_len_0;
     StringWeightMap corrections_len_1;
     while (node_queue.size() > 0)
     {
+        COUNT_STATISTIC(pop(node_queue.size()));
         next_node = node_queue.back();
         node_queue.pop_back();
-        lexicon_epsilons();
-        mutator_epsilons();
+        lexicon_epsilons<Correct, false, OPEN>();
+        mutator_epsilons<Correct, false, OPEN>();
         if (mutator->is_final(next_node.mutator_state) &&
             lexicon->is_final(next_node.lexicon_state))
         {
@@ -1009,6 +1604,7 @@ void Speller::build_cache(SymbolNumber first_sym)
                             lexicon->final_weight(next_node.lexicon_state) +
                             mutator->final_weight(next_node.mutator_state);
             std::string string = stringify(lexicon->get_key_table(), next_node.string);
+            COUNT_STATISTIC(finals++);
             // if the correction is novel or better than before, insert it
             if (next_node.input_state == 0)
             {
@@ -1029,15 +1625,12 @@ void Speller::build_cache(SymbolNumber first_sym)
         }
         if (next_node.input_state == 1)
         {
-            //cache[first_sym].nodes.push_back(next_node);
-        }
-        else
-        {
-            //            std::cerr << "discarded node\n";
+            // correct() resumes the search for longer inputs from these
+            cache[first_sym].nodes.push_back(next_node);
         }
         if (first_sym > 0 && next_node.input_state == 0)
         {
-            consume_input();
+            consume_input<Correct, false, OPEN>();
         }
     }
     cache[first_sym].results_len_0.assign(corrections_len_0.begin(), corrections_len_0.end());
@@ -1047,28 +1640,66 @@ void Speller::build_cache(SymbolNumber first_sym)
 #endif // if USE_CACHE
 
 std::map<std::string, Weight>
-Speller::generate_correction_map(size_t nbest, Weight beam)
+Speller::search_corrections(size_t nbest, Weight beam,
+                            std::map<StringPair, Weight>* analyses)
+{
+    // choose the kernel once here instead of branching for every node
+    bool strict = (limiting == Nbest);
+    if (mode == CorrectAnalyse)
+    {
+        if (open_alphabet)
+        {
+            return strict ?
+                generate_correction_map<CorrectAnalyse, true, true>(nbest, beam, analyses) :
+                generate_correction_map<CorrectAnalyse, false, true>(nbest, beam, analyses);
+        }
+        return strict ?
+            generate_correction_map<CorrectAnalyse, true, false>(nbest, beam, analyses) :
+            generate_correction_map<CorrectAnalyse, false, false>(nbest, beam, analyses);
+    }
+    if (open_alphabet)
+    {
+        return strict ?
+            generate_correction_map<Correct, true, true>(nbest, beam, analyses) :
+            generate_correction_map<Correct, false, true>(nbest, beam, analyses);
+    }
+    return strict ?
+        generate_correction_map<Correct, true, false>(nbest, beam, analyses) :
+        generate_correction_map<Correct, false, false>(nbest, beam, analyses);
+}
+
+template <Speller::Mode MODE, bool STRICT, bool OPEN>
+std::map<std::string, Weight>
+Speller::generate_correction_map(size_t nbest, Weight beam,
+                                 std::map<StringPair, Weight>* analyses)
 {
     std::map<std::string, Weight> corrections;
+    uint64_t nodes_expanded = 0;
 
     while (node_queue.size() > 0)
     {
+        if (is_over_budget(nodes_expanded))
+        {
+            // give what we have rather than blow the caller's deadline
+            partial = true;
+            break;
+        }
+        ++nodes_expanded;
         // For depth-first searching, we save the back node now, remove it
         // from the queue and add new nodes to the search at the back.
+        COUNT_STATISTIC(pop(node_queue.size()));
         next_node = node_queue.back();
         node_queue.pop_back();
 
-        adjust_weight_limits(nbest, beam);
-
         #if USE_CACHE
-        if (next_node.input_state > 1)
+        if (next_node.input_state > 1 || MODE == CorrectAnalyse)
         #else
         if (true)
         #endif
         {
             // Early epsilons were handled during the caching stage
-            lexicon_epsilons();
-            mutator_epsilons();
+            lexicon_epsilons<MODE, STRICT, OPEN>();
+            mutator_epsilons<MODE, STRICT, OPEN>();
         }
 
         if (next_node.input_state == input.size())
@@ -1081,12 +1712,18 @@ Speller::generate_correction_map(size_t nbest, Weight beam)
                 Weight weight = next_node.weight +
                                 lexicon->final_weight(next_node.lexicon_state) +
                                 mutator->final_weight(next_node.mutator_state);
+                COUNT_STATISTIC(finals++);
                 if (weight > limit)
                 {
+                    weight_limited = true;
                     continue;
                 }
 
                 std::string string = stringify(lexicon->get_key_table(), next_node.string);
+                if (corrections.count(string) != 0)
+                {
+                    COUNT_STATISTIC(duplicate_finals++);
+                }
                 // if the correction is novel or better than before, insert it
                 if (corrections.count(string) == 0 ||
                     corrections[string] > weight)
@@ -1097,16 +1734,1423 @@ Speller::generate_correction_map(size_t nbest, Weight beam)
                     {
                         nbest_queue.push(weight);
                     }
+                    // the limit only moves when a correction is found
+                    adjust_weight_limits(nbest, beam);
+                }
+                if (analyses != 0)
+                {
+                    StringPair pair(string,
+                                    stringify(lexicon->get_key_table(),
+                                              next_node.analysis));
+                    if (analyses->count(pair) == 0 ||
+                        (*analyses)[pair] > weight)
+                    {
+                        (*analyses)[pair] = weight;
+                    }
+                }
+            }
+        }
+        else
+        {
+            consume_input<MODE, STRICT, OPEN>();
+        }
+    }
+
+    return corrections;
+}
+
+// An incremental search keeps its nodes in one layer per input position.
+// Epsilons never move the input, and consuming moves it by one, so the
+// layer of each position depends only on the input before it.
+
+template <bool OPEN>
+bool Speller::close_layer(TreeNodeVector& layer, uint64_t& nodes_expanded)
+{
+    // the layer grows while it is read
+    for (size_t n = 0; n < layer.size(); ++n)
+    {
+        if (is_over_budget(nodes_expanded))
+        {
+            node_queue.clear();
+            return false;
+        }
+        ++nodes_expanded;
+        COUNT_STATISTIC(pop(layer.size() - n));
+        next_node = layer[n];
+        node_queue.clear();
+        lexicon_epsilons<Correct, false, OPEN>();
+        mutator_epsilons<Correct, false, OPEN>();
+        layer.insert(layer.end(), node_queue.begin(), node_queue.end());
+    }
+    node_queue.clear();
+    return true;
+}
+
+template <bool OPEN>
+void Speller::extend_layers(std::vector<TreeNodeVector>& layers)
+{
+    uint64_t nodes_expanded = 0;
+    if (layers.empty())
+    {
+        layers.push_back(TreeNodeVector(
+            1, TreeNode(FlagDiacriticState(get_state_size(), 0))));
+        COUNT_STATISTIC(nodes_pushed++);
+        if (!close_layer<OPEN>(layers.back(), nodes_expanded))
+        {
+            layers.clear();
+            partial = true;
+            return;
+        }
+    }
+    while (layers.size() <= input.size())
+    {
+        TreeNodeVector next;
+        const TreeNodeVector& last = layers.back();
+        for (TreeNodeVector::const_iterator node = last.begin();
+             node != last.end(); ++node)
+        {
+            next_node = *node;
+            node_queue.clear();
+            consume_input<Correct, false, OPEN>();
+            next.insert(next.end(), node_queue.begin(), node_queue.end());
+        }
+        node_queue.clear();
+        layers.push_back(TreeNodeVector());
+        layers.back().swap(next);
+        if (!close_layer<OPEN>(layers.back(), nodes_expanded))
+        {
+            // a layer cut short would spoil the words typed next
+            layers.pop_back();
+            partial = true;
+            return;
+        }
+    }
+}
+
+std::map<std::string, Weight>
+Speller::layer_corrections(TreeNodeVector& layer, size_t nbest, Weight beam)
+{
+    std::map<std::string, Weight> corrections;
+    for (TreeNodeVector::iterator node = layer.begin();
+         node != layer.end(); ++node)
+    {
+        if (!mutator->is_final(node->mutator_state) ||
+            !lexicon->is_final(node->lexicon_state))
+        {
+            continue;
+        }
+        COUNT_STATISTIC(finals++);
+        Weight weight = node->weight +
+            lexicon->final_weight(node->lexicon_state) +
+            mutator->final_weight(node->mutator_state);
+        if (weight > limit)
+        {
+            continue;
+        }
+        std::string string = stringify(lexicon->get_key_table(),
+                                       node->string);
+        std::map<std::string, Weight>::iterator it = corrections.find(string);
+        if (it != corrections.end())
+        {
+            COUNT_STATISTIC(duplicate_finals++);
+        }
+        if (it == corrections.end() || it->second > weight)
+        {
+            corrections[string] = weight;
+        }
+    }
+    for (std::map<std::string, Weight>::iterator it = corrections.begin();
+         it != corrections.end(); ++it)
+    {
+        best_suggestion = std::min(best_suggestion, it->second);
+        if (nbest > 0)
+        {
+            nbest_queue.push(it->second);
+        }
+    }
+    adjust_weight_limits(nbest, beam);
+    return corrections;
+}
+
+CorrectionSession::CorrectionSession(Speller* speller) :
+    speller_(speller),
+    maxweight_(-1.0)
+{
+}
+
+void CorrectionSession::reset(void)
+{
+    input_.clear();
+    layers_.clear();
+}
+
+size_t CorrectionSession::depth(void) const
+{
+    return layers_.empty() ? 0 : layers_.size() - 1;
+}
+
+CorrectionQueue CorrectionSession::correct(int8_t* line, size_t nbest,
+                                           Weight maxweight, Weight beam,
+                                           SearchStatistics* stats)
+{
+    if (speller_ == 0)
+    {
+        return CorrectionQueue();
+    }
+    Speller& speller = *speller_;
+    if (speller.mutator == NULL || speller.delete_index != 0)
+    {
+        reset();
+        return speller.correct(line, nbest, maxweight, beam, stats);
+    }
+    speller.mode = Speller::Correct;
+    speller.statistics = stats;
+    speller.partial = false;
+    speller.arcs_scanned = 0;
+    speller.search_start = std::chrono::steady_clock::now();
+    if (!speller.init_input(line))
+    {
+        reset();
+        return CorrectionQueue();
+    }
+    if (maxweight != maxweight_)
+    {
+        reset();
+        maxweight_ = maxweight;
+    }
+    // keep the layers of the input the previous word has in common
+    size_t common = 0;
+    while (common < input_.size() && common < speller.input.size() &&
+           input_[common] == speller.input[common])
+    {
+        ++common;
+    }
+    if (layers_.size() > common + 1)
+    {
+        layers_.resize(common + 1);
+    }
+    input_ = speller.input;
+    // the layers are only pruned by the maximum weight
+    speller.set_limiting_behaviour(0, maxweight, -1.0);
+    if (speller.open_alphabet)
+    {
+        speller.extend_layers<true>(layers_);
+    }
+    else
+    {
+        speller.extend_layers<false>(layers_);
+    }
+    speller.nbest_queue = WeightQueue(nbest);
+    speller.set_limiting_behaviour(nbest, maxweight, beam);
+    std::map<std::string, Weight> corrections;
+    // out of budget, the layers kept may not reach the end of the input
+    if (layers_.size() == input_.size() + 1)
+    {
+        corrections = speller.layer_corrections(layers_.back(), nbest, beam);
+    }
+    return speller.queue_corrections(corrections, nbest, beam);
+}
+
+template <bool OPEN>
+bool Speller::consume_prefix(TreeNodeVector& ends, uint64_t& nodes_expanded)
+{
+    while (node_queue.size() > 0)
+    {
+        if (is_over_budget(nodes_expanded))
+        {
+            node_queue.clear();
+            return false;
+        }
+        ++nodes_expanded;
+        COUNT_STATISTIC(pop(node_queue.size()));
+        next_node = node_queue.back();
+        node_queue.pop_back();
+        if (next_node.input_state == input.size())
+        {
+            // the completions follow the epsilons from here
+            ends.push_back(next_node);
+            continue;
+        }
+        lexicon_epsilons<Lookup, false, OPEN>();
+        lexicon_consume<Lookup, false, OPEN>();
+    }
+    return true;
+}
+
+void Speller::queue_completion_arcs(Weight symbol_weight)
+{
+    TransitionTableIndex i = next_node.lexicon_state;
+    if (lexicon->has_epsilons_or_flags(i + 1))
+    {
+        TransitionTableIndex next = lexicon->next(i, 0);
+        STransition i_s = lexicon->take_epsilons_and_flags(next);
+        while (i_s.symbol != NO_SYMBOL)
+        {
+            ++arcs_scanned;
+            COUNT_STATISTIC(arcs_scanned++);
+            SymbolNumber input_sym = lexicon->transitions.input_symbol(next);
+            if (input_sym == 0)
+            {
+                COUNT_STATISTIC(epsilon_expansions++);
+                COUNT_STATISTIC(nodes_pushed++);
+                node_queue.push_back(next_node.update_lexicon(0, i_s.index,
+                                                              i_s.weight));
+            }
+            else
+            {
+                FlagDiacriticState old_flags = next_node.flag_state;
+                if (next_node.try_compatible_with(
+                        operations->operator[](input_sym)))
+                {
+                    COUNT_STATISTIC(flag_expansions++);
+                    COUNT_STATISTIC(nodes_pushed++);
+                    node_queue.push_back(next_node.update_lexicon(0,
+                                                                  i_s.index,
+                                                                  i_s.weight));
                 }
+                next_node.flag_state = old_flags;
+            }
+            ++next;
+            i_s = lexicon->take_epsilons_and_flags(next);
+        }
+    }
+    SymbolNumber symbols = lexicon->get_header()->input_symbol_count();
+    for (SymbolNumber sym = 1; sym < symbols; ++sym)
+    {
+        // unknown and identity arcs have no string to complete with
+        if (lexicon->is_flag(sym) || sym == lexicon->get_unknown() ||
+            sym == lexicon->get_identity() ||
+            !lexicon->has_transitions(i + 1, sym))
+        {
+            continue;
+        }
+        TransitionTableIndex next = lexicon->next(i, sym);
+        STransition i_s = lexicon->take_non_epsilons(next, sym);
+        while (i_s.symbol != NO_SYMBOL)
+        {
+            ++arcs_scanned;
+            COUNT_STATISTIC(arcs_scanned++);
+            COUNT_STATISTIC(nodes_pushed++);
+            node_queue.push_back(next_node.update_lexicon(
+                                     sym, i_s.index,
+                                     i_s.weight + symbol_weight));
+            ++next;
+            i_s = lexicon->take_non_epsilons(next, sym);
+        }
+    }
+}
+
+Weight Speller::completion_estimate(TransitionTableIndex i) const
+{
+    std::vector<std::pair<TransitionTableIndex, Weight> >::const_iterator it =
+        std::lower_bound(completion_table.begin(), completion_table.end(),
+                         std::make_pair(i, -std::numeric_limits<Weight>::infinity()));
+    if (it == completion_table.end() || it->first != i)
+    {
+        return 0.0;
+    }
+    return it->second;
+}
+
+//! @brief a node of the completion search, or a completion if @c final
+struct CompletionNode
+{
+    Weight estimate; //!< weight so far plus the least weight still to come
+    bool final;
+    TreeNode node;
+};
+
+//! @brief orders the lightest estimate first, completions before nodes
+struct CompletionNodeComparison
+{
+    bool operator()(const CompletionNode& lhs, const CompletionNode& rhs) const
+    {
+        if (lhs.estimate != rhs.estimate)
+        {
+            return lhs.estimate > rhs.estimate;
+        }
+        return !lhs.final && rhs.final;
+    }
+};
+
+CorrectionQueue Speller::complete(int8_t* line, size_t nbest,
+                                  Weight maxweight, SearchStatistics* stats)
+{
+    // the lexicon is walked like for analyses, without the error model
+    mode = Lookup;
+    statistics = stats;
+    partial = false;
+    arcs_scanned = 0;
+    search_start = std::chrono::steady_clock::now();
+    std::string prefix(reinterpret_cast<char*>(line));
+    if (!init_input(line))
+    {
+        return CorrectionQueue();
+    }
+    limit = (maxweight >= 0.0) ? maxweight :
+        std::numeric_limits<Weight>::infinity();
+    uint64_t nodes_expanded = 0;
+    TreeNodeVector ends;
+    node_queue.assign(1, TreeNode(FlagDiacriticState(get_state_size(), 0)));
+    COUNT_STATISTIC(nodes_pushed++);
+    bool within_budget = open_alphabet ?
+        consume_prefix<true>(ends, nodes_expanded) :
+        consume_prefix<false>(ends, nodes_expanded);
+    if (!within_budget)
+    {
+        partial = true;
+        return CorrectionQueue();
+    }
+    for (TreeNodeVector::iterator it = ends.begin(); it != ends.end(); ++it)
+    {
+        // the prefix is given as typed
+        it->string.clear();
+        node_queue.push_back(*it);
+    }
+    return complete_nodes(prefix, nbest, 0.0, nodes_expanded);
+}
+
+CorrectionQueue Speller::correct_prefix(int8_t* line, size_t nbest,
+                                        Weight maxweight,
+                                        Weight symbol_weight,
+                                        SearchStatistics* stats)
+{
+    if (mutator == NULL)
+    {
+        return complete(line, nbest, maxweight, stats);
+    }
+    mode = Correct;
+    statistics = stats;
+    partial = false;
+    arcs_scanned = 0;
+    search_start = std::chrono::steady_clock::now();
+    if (!init_input(line))
+    {
+        return CorrectionQueue();
+    }
+    // the corrections of the prefix are the nodes at the end of the input
+    // where the error model may stop, whatever the lexicon state
+    set_limiting_behaviour(0, maxweight, -1.0);
+    std::vector<TreeNodeVector> layers;
+    if (open_alphabet)
+    {
+        extend_layers<true>(layers);
+    }
+    else
+    {
+        extend_layers<false>(layers);
+    }
+    if (layers.size() != input.size() + 1)
+    {
+        return CorrectionQueue();
+    }
+    TreeNodeVector& ends = layers.back();
+    for (TreeNodeVector::iterator it = ends.begin(); it != ends.end(); ++it)
+    {
+        if (mutator->is_final(it->mutator_state))
+        {
+            it->weight += mutator->final_weight(it->mutator_state);
+            node_queue.push_back(*it);
+        }
+    }
+    // the layers were counted against the budget on their own
+    return complete_nodes("", nbest, std::max<Weight>(symbol_weight, 0.0), 0);
+}
+
+CorrectionQueue Speller::complete_nodes(const std::string& prefix,
+                                        size_t nbest, Weight symbol_weight,
+                                        uint64_t nodes_expanded)
+{
+    CorrectionQueue completions;
+    std::priority_queue<CompletionNode, std::vector<CompletionNode>,
+                        CompletionNodeComparison> agenda;
+    std::map<std::string, Weight> found;
+    while (true)
+    {
+        for (TreeNodeQueue::iterator it = node_queue.begin();
+             it != node_queue.end(); ++it)
+        {
+            Weight estimate = it->weight + completion_estimate(it->lexicon_state);
+            // an infinite estimate means no final state can be reached
+            if (estimate <= limit)
+            {
+                CompletionNode node = { estimate, false, *it };
+                agenda.push(node);
+            }
+            else
+            {
+                COUNT_STATISTIC(pruned++);
+            }
+        }
+        node_queue.clear();
+        if (agenda.empty() || (nbest > 0 && found.size() >= nbest))
+        {
+            break;
+        }
+        if (is_over_budget(nodes_expanded))
+        {
+            partial = true;
+            break;
+        }
+        CompletionNode best = agenda.top();
+        agenda.pop();
+        if (best.final)
+        {
+            // the lightest path to a word comes out first
+            std::string word = prefix + stringify(lexicon->get_key_table(),
+                                                  best.node.string);
+            if (found.count(word) == 0)
+            {
+                found[word] = best.estimate;
+                completions.push(StringWeightPair(word, best.estimate));
+            }
+            else
+            {
+                COUNT_STATISTIC(duplicate_finals++);
+            }
+            continue;
+        }
+        ++nodes_expanded;
+        COUNT_STATISTIC(pop(agenda.size() + 1));
+        next_node = best.node;
+        if (lexicon->is_final(next_node.lexicon_state))
+        {
+            COUNT_STATISTIC(finals++);
+            Weight weight = next_node.weight +
+                lexicon->final_weight(next_node.lexicon_state);
+            if (weight <= limit)
+            {
+                CompletionNode node = { weight, true, next_node };
+                agenda.push(node);
             }
         }
-        else
+        queue_completion_arcs(symbol_weight);
+    }
+    return completions;
+}
+
+void Speller::build_completion_table(void)
+{
+    completion_table.clear();
+    // number the states reachable from the start, keeping their arcs
+    // backwards to find the least weights from the final states
+    struct Arc
+    {
+        TransitionTableIndex source;
+        TransitionTableIndex target;
+        Weight weight;
+    };
+    std::vector<Arc> arcs;
+    std::vector<TransitionTableIndex> states;
+    uint32_t indices = lexicon->get_header()->index_table_size();
+    std::vector<bool> seen(indices + lexicon->get_header()->target_table_size(),
+                           false);
+    SymbolNumber symbols = lexicon->get_header()->input_symbol_count();
+    std::vector<TransitionTableIndex> stack(1, 0);
+    seen[0] = true;
+    while (!stack.empty())
+    {
+        TransitionTableIndex i = stack.back();
+        stack.pop_back();
+        states.push_back(i);
+        if (lexicon->is_final(i) && lexicon->final_weight(i) < 0.0)
+        {
+            return;
+        }
+        for (SymbolNumber sym = 0; sym < symbols; ++sym)
+        {
+            // the completion search follows the same arcs
+            if (sym != 0 && (lexicon->is_flag(sym) ||
+                             sym == lexicon->get_unknown() ||
+                             sym == lexicon->get_identity()))
+            {
+                continue;
+            }
+            if (sym == 0 ? !lexicon->has_epsilons_or_flags(i + 1) :
+                !lexicon->has_transitions(i + 1, sym))
+            {
+                continue;
+            }
+            TransitionTableIndex next = lexicon->next(i, sym);
+            STransition i_s = (sym == 0) ?
+                lexicon->take_epsilons_and_flags(next) :
+                lexicon->take_non_epsilons(next, sym);
+            while (i_s.symbol != NO_SYMBOL)
+            {
+                if (i_s.weight < 0.0)
+                {
+                    return;
+                }
+                Arc arc = { i, i_s.index, i_s.weight };
+                arcs.push_back(arc);
+                TransitionTableIndex slot = (i_s.index >= TARGET_TABLE) ?
+                    indices + (i_s.index - TARGET_TABLE) : i_s.index;
+                if (!seen[slot])
+                {
+                    seen[slot] = true;
+                    stack.push_back(i_s.index);
+                }
+                ++next;
+                i_s = (sym == 0) ?
+                    lexicon->take_epsilons_and_flags(next) :
+                    lexicon->take_non_epsilons(next, sym);
+            }
+        }
+    }
+    std::sort(states.begin(), states.end());
+    std::vector<uint32_t> first(states.size() + 1, 0);
+    std::vector<std::pair<uint32_t, Weight> > incoming(arcs.size());
+    for (std::vector<Arc>::iterator arc = arcs.begin(); arc != arcs.end(); ++arc)
+    {
+        arc->target = std::lower_bound(states.begin(), states.end(),
+                                       arc->target) - states.begin();
+        arc->source = std::lower_bound(states.begin(), states.end(),
+                                       arc->source) - states.begin();
+        ++first[arc->target + 1];
+    }
+    for (size_t s = 0; s < states.size(); ++s)
+    {
+        first[s + 1] += first[s];
+    }
+    std::vector<uint32_t> filled(first.begin(), first.end() - 1);
+    for (std::vector<Arc>::iterator arc = arcs.begin(); arc != arcs.end(); ++arc)
+    {
+        incoming[filled[arc->target]++] =
+            std::make_pair(arc->source, arc->weight);
+    }
+    // Dijkstra from the final states along the arcs reversed
+    std::vector<Weight> least(states.size(),
+                              std::numeric_limits<Weight>::infinity());
+    typedef std::pair<Weight, uint32_t> Item;
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item> > agenda;
+    for (size_t s = 0; s < states.size(); ++s)
+    {
+        if (lexicon->is_final(states[s]))
+        {
+            least[s] = lexicon->final_weight(states[s]);
+            agenda.push(Item(least[s], s));
+        }
+    }
+    while (!agenda.empty())
+    {
+        Item item = agenda.top();
+        agenda.pop();
+        if (item.first > least[item.second])
+        {
+            continue;
+        }
+        for (uint32_t k = first[item.second]; k < first[item.second + 1]; ++k)
+        {
+            Weight weight = item.first + incoming[k].second;
+            if (weight < least[incoming[k].first])
+            {
+                least[incoming[k].first] = weight;
+                agenda.push(Item(weight, incoming[k].first));
+            }
+        }
+    }
+    completion_table.reserve(states.size());
+    for (size_t s = 0; s < states.size(); ++s)
+    {
+        completion_table.push_back(std::make_pair(states[s], least[s]));
+    }
+}
+
+//! @brief an arc of an error model as the search sees it
+struct EditArc
+{
+    SymbolNumber input;
+    SymbolNumber output;
+    TransitionTableIndex target;
+    Weight weight;
+};
+
+//! @brief collect the arcs the search would follow from @a state of @a t.
+static void
+collect_arcs(Transducer* t, TransitionTableIndex state,
+             std::vector<EditArc>& arcs)
+{
+    arcs.clear();
+    SymbolNumber symbols = t->get_header()->input_symbol_count();
+    for (SymbolNumber sym = 0; sym < symbols; ++sym)
+    {
+        if (!t->has_transitions(state + 1, sym))
+        {
+            continue;
+        }
+        for (TransitionTableIndex next = t->next(state, sym);
+             t->transitions.input_symbol(next) == sym;
+             ++next)
+        {
+            EditArc arc = { sym,
+                            t->transitions.output_symbol(next),
+                            t->transitions.target(next),
+                            t->transitions.weight(next) };
+            arcs.push_back(arc);
+        }
+    }
+}
+
+void Speller::recognise_edit_distance(void)
+{
+    // longer chains than this are not worth telling apart from loops
+    const uint32_t max_distance = 16;
+    std::set<SymbolNumber> alphabet;
+    std::vector<EditArc> arcs;
+    uint32_t distance = 0;
+    TransitionTableIndex state = 0;
+    Weight weight = 0.0;
+    bool weighed = false;
+    for (uint32_t level = 0; level <= max_distance; ++level)
+    {
+        if (!mutator->is_final(state) || mutator->final_weight(state) != 0.0)
+        {
+            return;
+        }
+        collect_arcs(mutator, state, arcs);
+        std::set<SymbolNumber> identities;
+        std::set<std::pair<SymbolNumber, SymbolNumber> > edits;
+        TransitionTableIndex next = NO_TABLE_INDEX;
+        for (std::vector<EditArc>::iterator arc = arcs.begin();
+             arc != arcs.end(); ++arc)
+        {
+            if (arc->input == arc->output)
+            {
+                // identities loop for free; epsilon loops are no edit
+                if (arc->input == 0 || arc->target != state ||
+                    arc->weight != 0.0 ||
+                    !identities.insert(arc->input).second)
+                {
+                    return;
+                }
+                continue;
+            }
+            if (!weighed)
+            {
+                weight = arc->weight;
+                weighed = true;
+            }
+            if (next == NO_TABLE_INDEX)
+            {
+                next = arc->target;
+            }
+            if (arc->weight != weight || arc->target != next ||
+                next == state ||
+                !edits.insert(std::make_pair(arc->input,
+                                             arc->output)).second)
+            {
+                return;
+            }
+        }
+        if (level == 0)
+        {
+            alphabet = identities;
+        }
+        if (alphabet.empty() || identities != alphabet ||
+            (weighed && weight <= 0.0))
+        {
+            return;
+        }
+        if (edits.empty())
+        {
+            if (level == 0)
+            {
+                return;
+            }
+            distance = level;
+            break;
+        }
+        // every substitution, deletion and insertion within the alphabet,
+        // each once, and nothing else
+        if (edits.size() != alphabet.size() * (alphabet.size() + 1))
+        {
+            return;
+        }
+        for (std::set<std::pair<SymbolNumber, SymbolNumber> >::iterator
+                 edit = edits.begin(); edit != edits.end(); ++edit)
+        {
+            if ((edit->first != 0 && alphabet.count(edit->first) == 0) ||
+                (edit->second != 0 && alphabet.count(edit->second) == 0))
+            {
+                return;
+            }
+        }
+        state = next;
+    }
+    if (distance == 0)
+    {
+        return;
+    }
+    recognised_matrix.reset(new ConfusionMatrix(distance));
+    KeyTable* keys = mutator->get_key_table();
+    std::vector<SymbolNumber> symbols;
+    for (std::set<SymbolNumber>::iterator sym = alphabet.begin();
+         sym != alphabet.end(); ++sym)
+    {
+        symbols.push_back(recognised_matrix->add_symbol(keys->at(*sym)));
+    }
+    // input outside the alphabet can't even be deleted, as in the automaton
+    for (std::vector<SymbolNumber>::iterator from = symbols.begin();
+         from != symbols.end(); ++from)
+    {
+        recognised_matrix->set_edit(*from, ConfusionMatrix::EPSILON, weight);
+        recognised_matrix->set_edit(ConfusionMatrix::EPSILON, *from, weight);
+        for (std::vector<SymbolNumber>::iterator to = symbols.begin();
+             to != symbols.end(); ++to)
+        {
+            if (*from != *to)
+            {
+                recognised_matrix->set_edit(*from, *to, weight);
+            }
+        }
+    }
+    use_matrix(*recognised_matrix);
+}
+
+//! @brief cost of an edit of weight @a w in the rows: the weight, or one
+//!        edit if the weights are @c UNIFORM and only edits are counted
+template <bool UNIFORM>
+static inline Weight
+edit_cost(Weight w)
+{
+    return (UNIFORM && w != std::numeric_limits<Weight>::infinity()) ? 1.0 : w;
+}
+
+bool Speller::use_edit_distance(bool edit_distance)
+{
+    if (!edit_distance)
+    {
+        if (matrix != 0 && matrix == recognised_matrix.get())
+        {
+            matrix = 0;
+        }
+    }
+    else if (matrix == 0 && mutator != NULL && !open_alphabet &&
+             mutator->get_state_size() == 0)
+    {
+        if (recognised_matrix)
+        {
+            use_matrix(*recognised_matrix);
+        }
+        else
+        {
+            recognise_edit_distance();
+        }
+    }
+    return matrix != 0;
+}
+
+void Speller::use_matrix(const ConfusionMatrix& confusion_matrix)
+{
+    matrix = &confusion_matrix;
+    // find out whether all possible edits weigh the same
+    edit_unit = 0.0;
+    for (SymbolNumber from = 0; from < matrix->size(); ++from)
+    {
+        for (SymbolNumber to = 0; to < matrix->size(); ++to)
+        {
+            Weight w = matrix->edit(from, to);
+            if (from == to || w == std::numeric_limits<Weight>::infinity())
+            {
+                continue;
+            }
+            if (edit_unit == 0.0)
+            {
+                edit_unit = w;
+            }
+            if (w != edit_unit || w <= 0.0 || matrix->has_swaps())
+            {
+                edit_unit = -1.0;
+            }
+        }
+    }
+    edit_unit = std::max<Weight>(edit_unit, 0.0);
+    edit_targets.clear();
+    KeyTable* keys = lexicon->get_key_table();
+    // the lexicon has no arcs for symbols it only got from the error model
+    SymbolNumber symbols = lexicon->get_header()->input_symbol_count();
+    for (SymbolNumber sym = 1; sym < symbols && sym < keys->size(); ++sym)
+    {
+        SymbolNumber code = matrix->find(keys->at(sym));
+        if (code != ConfusionMatrix::UNKNOWN && !lexicon->is_flag(sym))
+        {
+            edit_targets.push_back(std::make_pair(sym, code));
+        }
+    }
+}
+
+void Speller::encode_edit_input(void)
+{
+    KeyTable* keys = (mutator != NULL ? mutator : lexicon)->get_key_table();
+    edit_input.clear();
+    edit_folded.clear();
+    for (uint32_t i = 0; i < input.size(); ++i)
+    {
+        SymbolNumber code = input[i] < keys->size() ?
+            matrix->find(keys->at(input[i])) : ConfusionMatrix::UNKNOWN;
+        SymbolNumber lower = lower_case.empty() ? NO_SYMBOL :
+            lower_case[input[i]];
+        SymbolNumber folded = (lower == NO_SYMBOL) ? NO_SYMBOL :
+            matrix->find(keys->at(lower));
+        if (code == ConfusionMatrix::UNKNOWN && folded != NO_SYMBOL)
+        {
+            // a capital the matrix doesn't know is only its small letter
+            code = folded;
+            folded = NO_SYMBOL;
+        }
+        edit_input.push_back(code);
+        edit_folded.push_back(folded);
+    }
+}
+
+std::map<std::string, Weight>
+Speller::search_edit_distance(size_t nbest, Weight beam,
+                              std::map<StringPair, Weight>* analyses)
+{
+    uint32_t distance = matrix->get_distance();
+    // when every edit weighs the same, counting them is enough
+    uint32_t stride = (edit_unit > 0.0) ? 1 : distance + 1;
+    uint32_t width = (input.size() + 1) * stride;
+    // a path more insertions past the input than allowed is out of reach
+    edit_rows.assign((input.size() + distance + 1) * width,
+                     std::numeric_limits<Weight>::infinity());
+    encode_edit_input();
+    // the empty path is reached by deleting the input
+    for (uint32_t k = 0; k < stride; ++k)
+    {
+        edit_rows[k] = 0.0;
+    }
+    for (uint32_t i = 1; i <= input.size() && i <= distance; ++i)
+    {
+        Weight deletion = folded_edit(i - 1, ConfusionMatrix::EPSILON);
+        if (stride == 1)
+        {
+            edit_rows[i] = edit_rows[i - 1] + edit_cost<true>(deletion);
+            continue;
+        }
+        for (uint32_t k = 1; k <= distance; ++k)
+        {
+            edit_rows[i * stride + k] =
+                edit_rows[(i - 1) * stride + k - 1] + deletion;
+        }
+    }
+    edit_path.clear();
+    next_node = TreeNode(FlagDiacriticState(get_state_size(), 0));
+    EditSearch search;
+    search.analyses = analyses;
+    search.nbest = nbest;
+    search.beam = beam;
+    search.nodes_expanded = 0;
+    bool fold = !lower_case.empty();
+    if (stride == 1 && fold)
+    {
+        edit_distance_lookup<true, true>(0, 0, 0.0, search);
+    }
+    else if (stride == 1)
+    {
+        edit_distance_lookup<true, false>(0, 0, 0.0, search);
+    }
+    else if (fold)
+    {
+        edit_distance_lookup<false, true>(0, 0, 0.0, search);
+    }
+    else
+    {
+        edit_distance_lookup<false, false>(0, 0, 0.0, search);
+    }
+    return search.corrections;
+}
+
+// The rows hold the least weight of editing each input prefix into the
+// lexicon path with at most each number of edits. With @c UNIFORM edit
+// weights, they only hold the least number of edits. With @c FOLD, each
+// capital in the input may be edited as its small letter.
+template <bool UNIFORM, bool FOLD>
+void Speller::edit_distance_lookup(TransitionTableIndex i, uint32_t depth,
+                                   Weight weight, EditSearch& search)
+{
+    if (partial || is_over_budget(search.nodes_expanded))
+    {
+        partial = true;
+        return;
+    }
+    ++search.nodes_expanded;
+    COUNT_STATISTIC(pop(depth + 1));
+    const Weight infinity = std::numeric_limits<Weight>::infinity();
+    uint32_t distance = matrix->get_distance();
+    uint32_t stride = UNIFORM ? 1 : distance + 1;
+    uint32_t top = stride - 1; // the cell with all edits allowed
+    uint32_t width = (input.size() + 1) * stride;
+    const Weight* row = &edit_rows[depth * width];
+    Weight edits = row[input.size() * stride + top];
+    if (UNIFORM)
+    {
+        edits *= edit_unit;
+    }
+    if (edits <= limit && lexicon->is_final(i))
+    {
+        COUNT_STATISTIC(finals++);
+        Weight final = weight + lexicon->final_weight(i) + edits;
+        if (final <= limit)
+        {
+            std::string string = stringify(lexicon->get_key_table(),
+                                           next_node.string);
+            std::map<std::string, Weight>::iterator it =
+                search.corrections.find(string);
+            if (it != search.corrections.end())
+            {
+                COUNT_STATISTIC(duplicate_finals++);
+            }
+            if (it == search.corrections.end() || it->second > final)
+            {
+                search.corrections[string] = final;
+                best_suggestion = std::min(best_suggestion, final);
+                if (search.nbest > 0)
+                {
+                    nbest_queue.push(final);
+                }
+                adjust_weight_limits(search.nbest, search.beam);
+            }
+            if (search.analyses != 0)
+            {
+                StringPair pair(string, stringify(lexicon->get_key_table(),
+                                                  next_node.analysis));
+                if (search.analyses->count(pair) == 0 ||
+                    (*search.analyses)[pair] > final)
+                {
+                    (*search.analyses)[pair] = final;
+                }
+            }
+        }
+    }
+    // Only input prefixes within the distance of the path length can be
+    // reached, the other cells of the rows stay infinite
+    uint32_t first = (depth > distance) ? depth - distance : 0;
+    uint32_t last = std::min<uint32_t>(input.size(), depth + distance);
+    // the least weight any extension of this path can still add; paths
+    // that tie with the limit are followed even for n-best, so all the
+    // corrections as good as the n-th come out whatever the search order
+    Weight closest = infinity;
+    for (uint32_t j = first; j <= last; ++j)
+    {
+        closest = std::min(closest, row[j * stride + top]);
+    }
+    if (UNIFORM)
+    {
+        closest *= edit_unit;
+    }
+    if (lexicon->has_epsilons_or_flags(i + 1))
+    {
+        TransitionTableIndex next = lexicon->next(i, 0);
+        STransition i_s = lexicon->take_epsilons_and_flags(next);
+        while (i_s.symbol != NO_SYMBOL)
+        {
+            ++arcs_scanned;
+            COUNT_STATISTIC(arcs_scanned++);
+            if (weight + i_s.weight + closest <= limit)
+            {
+                SymbolNumber input_sym = lexicon->transitions.input_symbol(next);
+                if (input_sym == 0)
+                {
+                    COUNT_STATISTIC(epsilon_expansions++);
+                    if (search.analyses != 0)
+                    {
+                        next_node.analysis.push_back(i_s.symbol);
+                    }
+                    edit_distance_lookup<UNIFORM, FOLD>(i_s.index, depth,
+                                                        weight + i_s.weight,
+                                                        search);
+                    if (search.analyses != 0)
+                    {
+                        next_node.analysis.pop_back();
+                    }
+                }
+                else
+                {
+                    FlagDiacriticOperation op = operations->operator[](input_sym);
+                    ValueNumber old_value = next_node.flag_state[op.Feature()];
+                    if (next_node.try_compatible_with(op))
+                    {
+                        COUNT_STATISTIC(flag_expansions++);
+                        edit_distance_lookup<UNIFORM, FOLD>(i_s.index, depth,
+                                                            weight + i_s.weight,
+                                                            search);
+                    }
+                    next_node.flag_state[op.Feature()] = old_value;
+                }
+            }
+            ++next;
+            i_s = lexicon->take_epsilons_and_flags(next);
+        }
+    }
+    if ((depth + 2) * width > edit_rows.size())
+    {
+        return;
+    }
+    Weight* next_row = &edit_rows[(depth + 1) * width];
+    uint32_t next_last = std::min<uint32_t>(input.size(), depth + 1 + distance);
+    for (std::vector<std::pair<SymbolNumber, SymbolNumber> >::iterator
+             target = edit_targets.begin();
+         target != edit_targets.end(); ++target)
+    {
+        SymbolNumber sym = target->first;
+        SymbolNumber code = target->second;
+        if (!lexicon->has_transitions(i + 1, sym))
+        {
+            continue;
+        }
+        // swapping the last two input symbols needs the row from before
+        // the last symbol of the path
+        bool swappable = !UNIFORM && matrix->has_swaps() && depth > 0 &&
+            edit_path.back() != code;
+        Weight insertion = edit_cost<UNIFORM>(
+            matrix->edit(ConfusionMatrix::EPSILON, code));
+        closest = infinity;
+        if (depth < distance)
+        {
+            for (uint32_t k = UNIFORM ? 0 : 1; k <= top; ++k)
+            {
+                next_row[k] = row[UNIFORM ? 0 : k - 1] + insertion;
+            }
+            closest = next_row[top];
+        }
+        for (uint32_t j = std::max<uint32_t>(first, 1); j <= next_last; ++j)
+        {
+            SymbolNumber from = edit_input[j - 1];
+            // a capital is kept as its small letter too
+            bool keep = (from == code ||
+                         (FOLD && edit_folded[j - 1] == code));
+            Weight substitution = keep ? 0.0 : edit_cost<UNIFORM>(
+                FOLD ? folded_edit(j - 1, code) : matrix->edit(from, code));
+            Weight deletion = edit_cost<UNIFORM>(
+                FOLD ? folded_edit(j - 1, ConfusionMatrix::EPSILON) :
+                matrix->edit(from, ConfusionMatrix::EPSILON));
+            const Weight* diagonal = row + (j - 1) * stride;
+            const Weight* above = row + j * stride;
+            const Weight* left = next_row + (j - 1) * stride;
+            Weight* cell = next_row + j * stride;
+            if (UNIFORM)
+            {
+                Weight best = std::min(diagonal[0] + substitution,
+                                       above[0] + insertion);
+                best = std::min(best, left[0] + deletion);
+                cell[0] = (best <= distance) ? best : infinity;
+                closest = std::min(closest, cell[0]);
+                continue;
+            }
+            const Weight* swap = 0;
+            Weight swap_weight = 0.0;
+            if (swappable && j > 1 && edit_path.back() == from &&
+                edit_input[j - 2] == code)
+            {
+                swap = &edit_rows[(depth - 1) * width + (j - 2) * stride];
+                swap_weight = matrix->swap(code, from);
+            }
+            cell[0] = keep ? diagonal[0] : infinity;
+            for (uint32_t k = 1; k <= distance; ++k)
+            {
+                Weight best = keep ? diagonal[k] :
+                    diagonal[k - 1] + substitution;
+                best = std::min(best, above[k - 1] + insertion);
+                best = std::min(best, left[k - 1] + deletion);
+                if (swap != 0)
+                {
+                    best = std::min(best, swap[k - 1] + swap_weight);
+                }
+                cell[k] = best;
+            }
+            closest = std::min(closest, cell[distance]);
+        }
+        if (UNIFORM)
+        {
+            closest *= edit_unit;
+        }
+        if (weight + closest > limit)
+        {
+            continue;
+        }
+        TransitionTableIndex next = lexicon->next(i, sym);
+        STransition i_s = lexicon->take_non_epsilons(next, sym);
+        next_node.string.push_back(sym);
+        edit_path.push_back(code);
+        while (i_s.symbol != NO_SYMBOL)
+        {
+            ++arcs_scanned;
+            COUNT_STATISTIC(arcs_scanned++);
+            if (weight + i_s.weight + closest <= limit)
+            {
+                COUNT_STATISTIC(nodes_pushed++);
+                if (search.analyses != 0)
+                {
+                    next_node.analysis.push_back(i_s.symbol);
+                }
+                edit_distance_lookup<UNIFORM, FOLD>(i_s.index, depth + 1,
+                                                    weight + i_s.weight,
+                                                    search);
+                if (search.analyses != 0)
+                {
+                    next_node.analysis.pop_back();
+                }
+            }
+            ++next;
+            i_s = lexicon->take_non_epsilons(next, sym);
+        }
+        edit_path.pop_back();
+        next_node.string.pop_back();
+    }
+}
+
+void Speller::use_delete_index(const SymmetricDeleteIndex& index)
+{
+    delete_index = &index;
+}
+
+std::map<std::string, Weight>
+Speller::search_delete_index(size_t nbest, Weight beam)
+{
+    std::map<std::string, Weight> corrections;
+    SymbolVector query;
+    for (uint32_t i = 0; i < input.size(); ++i)
+    {
+        query.push_back(alphabet_translator[input[i]]);
+    }
+    std::vector<uint32_t> words;
+    delete_index->lookup(query, words);
+    if (matrix != 0)
+    {
+        encode_edit_input();
+    }
+    uint64_t nodes_expanded = 0;
+    SymbolVector string;
+    for (std::vector<uint32_t>::iterator it = words.begin();
+         it != words.end(); ++it)
+    {
+        if (is_over_budget(nodes_expanded))
+        {
+            partial = true;
+            break;
+        }
+        ++nodes_expanded;
+        COUNT_STATISTIC(pop(words.end() - it));
+        uint32_t length = 0;
+        const SymbolNumber* word = delete_index->word(*it, length);
+        Weight weight = delete_index->word_weight(*it);
+        if (weight <= limit)
+        {
+            weight += (matrix != 0) ? matrix_weight(word, length) :
+                error_model_weight(word, length, limit - weight);
+        }
+        if (weight > limit)
+        {
+            COUNT_STATISTIC(pruned++);
+            continue;
+        }
+        COUNT_STATISTIC(finals++);
+        string.assign(word, word + length);
+        corrections[stringify(lexicon->get_key_table(), string)] = weight;
+        best_suggestion = std::min(best_suggestion, weight);
+        if (nbest > 0)
+        {
+            nbest_queue.push(weight);
+        }
+        adjust_weight_limits(nbest, beam);
+    }
+    return corrections;
+}
+
+Weight Speller::error_model_weight(const SymbolNumber* word, uint32_t length,
+                                   Weight bound)
+{
+    const Weight infinity = std::numeric_limits<Weight>::infinity();
+    if (mutator == NULL)
+    {
+        // without an error model only the input itself is a correction
+        bool same = (length == input.size());
+        for (uint32_t i = 0; same && i < length; ++i)
+        {
+            same = (alphabet_translator[input[i]] == word[i]);
+        }
+        return same ? 0.0 : infinity;
+    }
+    // Dijkstra over states of the error model with the number of input
+    // and word symbols read so far; reaching a final state with both read
+    // in full takes the final weight and a last step to NO_TABLE_INDEX
+    typedef std::pair<TransitionTableIndex, std::pair<uint32_t, uint32_t> >
+        EditState;
+    typedef std::pair<Weight, EditState> WeightedState;
+    std::priority_queue<WeightedState, std::vector<WeightedState>,
+                        std::greater<WeightedState> > queue;
+    std::map<EditState, Weight> reached;
+    auto relax = [&](TransitionTableIndex state, uint32_t i, uint32_t j,
+                     Weight weight)
+    {
+        EditState node(state, std::make_pair(i, j));
+        std::map<EditState, Weight>::iterator it = reached.find(node);
+        if (weight <= bound && (it == reached.end() || it->second > weight))
+        {
+            reached[node] = weight;
+            queue.push(WeightedState(weight, node));
+        }
+    };
+    // an arc writing @c output, none if 0, must write the next word symbol
+    auto follow = [&](const STransition& i_s, uint32_t i, uint32_t j,
+                      Weight weight)
+    {
+        ++arcs_scanned;
+        COUNT_STATISTIC(arcs_scanned++);
+        if (i_s.symbol == 0)
+        {
+            relax(i_s.index, i, j, weight + i_s.weight);
+        }
+        else if (j < length && alphabet_translator[i_s.symbol] == word[j])
+        {
+            relax(i_s.index, i, j + 1, weight + i_s.weight);
+        }
+    };
+    relax(0, 0, 0, 0.0);
+    while (!queue.empty())
+    {
+        WeightedState top = queue.top();
+        queue.pop();
+        TransitionTableIndex state = top.second.first;
+        uint32_t i = top.second.second.first;
+        uint32_t j = top.second.second.second;
+        if (state == NO_TABLE_INDEX)
+        {
+            return top.first;
+        }
+        if (reached[top.second] < top.first)
+        {
+            continue;
+        }
+        if (i == input.size() && j == length && mutator->is_final(state))
+        {
+            relax(NO_TABLE_INDEX, i, j,
+                  top.first + mutator->final_weight(state));
+        }
+        if (mutator->has_transitions(state + 1, 0))
+        {
+            TransitionTableIndex next = mutator->next(state, 0);
+            STransition i_s = mutator->take_epsilons(next);
+            while (i_s.symbol != NO_SYMBOL)
+            {
+                follow(i_s, i, j, top.first);
+                ++next;
+                i_s = mutator->take_epsilons(next);
+            }
+        }
+        if (i == input.size())
+        {
+            continue;
+        }
+        SymbolNumber arcs[2] = { input[i], NO_SYMBOL };
+        if (!mutator->has_transitions(state + 1, input[i]))
+        {
+            arcs[0] = NO_SYMBOL;
+            if (input[i] >= mutator->get_alphabet()->get_orig_symbol_count())
+            {
+                // unknown or identity may apply to new symbols
+                arcs[0] = mutator->get_identity();
+                arcs[1] = mutator->get_unknown();
+            }
+        }
+        for (uint32_t a = 0; a < 2; ++a)
+        {
+            if (!mutator->has_transitions(state + 1, arcs[a]))
+            {
+                continue;
+            }
+            TransitionTableIndex next = mutator->next(state, arcs[a]);
+            STransition i_s = mutator->take_non_epsilons(next, arcs[a]);
+            while (i_s.symbol != NO_SYMBOL)
+            {
+                follow(i_s, i + 1, j, top.first);
+                ++next;
+                i_s = mutator->take_non_epsilons(next, arcs[a]);
+            }
+        }
+    }
+    return infinity;
+}
+
+// The same rows as edit_distance_lookup() builds along a lexicon path,
+// here along one word.
+Weight Speller::matrix_weight(const SymbolNumber* word, uint32_t length)
+{
+    const Weight infinity = std::numeric_limits<Weight>::infinity();
+    uint32_t distance = matrix->get_distance();
+    uint32_t stride = distance + 1;
+    uint32_t width = (input.size() + 1) * stride;
+    KeyTable* keys = lexicon->get_key_table();
+    SymbolVector codes;
+    for (uint32_t d = 0; d < length; ++d)
+    {
+        codes.push_back(matrix->find(keys->at(word[d])));
+        if (codes.back() == ConfusionMatrix::UNKNOWN)
+        {
+            // the search never writes symbols the matrix doesn't know
+            return infinity;
+        }
+    }
+    std::vector<Weight> rows((length + 1) * width, infinity);
+    for (uint32_t k = 0; k < stride; ++k)
+    {
+        rows[k] = 0.0;
+    }
+    for (uint32_t j = 1; j <= input.size() && j <= distance; ++j)
+    {
+        Weight deletion = matrix->edit(edit_input[j - 1],
+                                       ConfusionMatrix::EPSILON);
+        for (uint32_t k = 1; k <= distance; ++k)
+        {
+            rows[j * stride + k] = rows[(j - 1) * stride + k - 1] + deletion;
+        }
+    }
+    for (uint32_t d = 1; d <= length; ++d)
+    {
+        SymbolNumber code = codes[d - 1];
+        const Weight* row = &rows[(d - 1) * width];
+        Weight* next_row = &rows[d * width];
+        Weight insertion = matrix->edit(ConfusionMatrix::EPSILON, code);
+        for (uint32_t k = 1; k <= distance; ++k)
+        {
+            next_row[k] = row[k - 1] + insertion;
+        }
+        bool swappable = matrix->has_swaps() && d > 1 && codes[d - 2] != code;
+        for (uint32_t j = 1; j <= input.size(); ++j)
         {
-            consume_input();
+            SymbolNumber from = edit_input[j - 1];
+            Weight substitution = (from == code) ? 0.0 :
+                matrix->edit(from, code);
+            Weight deletion = matrix->edit(from, ConfusionMatrix::EPSILON);
+            const Weight* diagonal = row + (j - 1) * stride;
+            const Weight* above = row + j * stride;
+            const Weight* left = next_row + (j - 1) * stride;
+            Weight* cell = next_row + j * stride;
+            const Weight* swap = 0;
+            Weight swap_weight = 0.0;
+            if (swappable && j > 1 && codes[d - 2] == from &&
+                edit_input[j - 2] == code)
+            {
+                swap = &rows[(d - 2) * width + (j - 2) * stride];
+                swap_weight = matrix->swap(code, from);
+            }
+            cell[0] = (from == code) ? diagonal[0] : infinity;
+            for (uint32_t k = 1; k <= distance; ++k)
+            {
+                Weight best = (from == code) ? diagonal[k] :
+                    diagonal[k - 1] + substitution;
+                best = std::min(best, above[k - 1] + insertion);
+                best = std::min(best, left[k - 1] + deletion);
+                if (swap != 0)
+                {
+                    best = std::min(best, swap[k - 1] + swap_weight);
+                }
+                cell[k] = best;
+            }
         }
     }
-
-    return corrections;
+    return rows[length * width + input.size() * stride + distance];
 }
 
 #if USE_CACHE
@@ -1144,9 +3188,14 @@ CorrectionQueue Speller::handle_input_size_lt_1(SymbolNumber first_input, size_t
 #endif // if USE_CACHE
 
 CorrectionQueue Speller::correct(int8_t* line, size_t nbest,
-                                 Weight maxweight, Weight beam)
+                                 Weight maxweight, Weight beam,
+                                 SearchStatistics* stats)
 {
     mode = Correct;
+    statistics = stats;
+    partial = false;
+    arcs_scanned = 0;
+    search_start = std::chrono::steady_clock::now();
 
     // if input initialization fails, return empty correction queue
     if (!init_input(line))
@@ -1155,11 +3204,35 @@ CorrectionQueue Speller::correct(int8_t* line, size_t nbest,
     }
     nbest_queue = WeightQueue(nbest);
 
+    // the index has no case variants of its words
+    if (delete_index != 0 && lower_case.empty())
+    {
+        set_limiting_behaviour(nbest, maxweight, beam);
+        return queue_corrections(search_delete_index(nbest, beam),
+                                 nbest, beam);
+    }
+
+    if (matrix != 0)
+    {
+        // edit weights need no error model automaton or cache, only a row
+        // of weights for each symbol on the lexicon path
+        set_limiting_behaviour(nbest, maxweight, beam);
+        return queue_corrections(search_edit_distance(nbest, beam),
+                                 nbest, beam);
+    }
+
     #if USE_CACHE
     SymbolNumber first_input = (input.size() == 0) ? 0 : input[0];
     if (cache[first_input].empty)
     {
-        build_cache(first_input);
+        if (open_alphabet)
+        {
+            build_cache<true>(first_input);
+        }
+        else
+        {
+            build_cache<false>(first_input);
+        }
     }
     #endif
 
@@ -1172,20 +3245,107 @@ CorrectionQueue Speller::correct(int8_t* line, size_t nbest,
     }
     #endif
 
-    // The queue for our suggestions
-    CorrectionQueue correction_queue;
+    // Without other limits an n-best search can first be bounded by a
+    // maximum weight, doubled until it is above the n-th correction; the
+    // kernel and its strict limit stay the same, so the corrections do too
+    Weight bound = (limiting == Nbest) ? deepening_weight : 0.0;
+    // the limit set_limiting_behaviour() gave, e.g. a maximum weight
+    Weight given_limit = limit;
+    std::map<std::string, Weight> corrections;
+    for (uint32_t round = 0; ; ++round)
+    {
+        bool last = (bound <= 0.0 || round == DEEPENING_ROUNDS);
+        limit = last ? given_limit : bound;
+        best_suggestion = std::numeric_limits<Weight>::max();
+        nbest_queue = WeightQueue(nbest);
+        weight_limited = false;
+        #if USE_CACHE
+        node_queue.assign(cache[first_input].nodes.begin(), cache[first_input].nodes.end());
+        #else
+        TreeNode start_node(FlagDiacriticState(get_state_size(), 0));
+        node_queue.assign(1, start_node);
+        #endif
+        COUNT_STATISTIC(nodes_pushed += node_queue.size());
+
+        corrections = search_corrections(nbest, beam);
+        // a round that cut nothing off has searched everything
+        if (last || partial || !weight_limited ||
+            (nbest_queue.size() >= nbest && nbest_queue.get_highest() < bound))
+        {
+            break;
+        }
+        bound *= 2.0;
+    }
+
+    return queue_corrections(corrections, nbest, beam);
+}
+
+void Speller::set_deepening(Weight initial_weight)
+{
+    deepening_weight = initial_weight;
+}
 
+void Speller::set_case_folding(bool fold)
+{
+    lower_case.clear();
     #if USE_CACHE
-    node_queue.assign(cache[first_input].nodes.begin(), cache[first_input].nodes.end());
-    #else
-    TreeNode start_node(FlagDiacriticState(get_state_size(), 0));
-    node_queue.assign(1, start_node);
+    // the cached nodes depend on the case variants read
+    cache.assign(cache.size(), CacheContainer());
     #endif
+    if (!fold)
+    {
+        return;
+    }
+    KeyTable* keys = (mutator != NULL ? mutator : lexicon)->get_key_table();
+    SymbolNumber count = keys->size();
+    lower_case.assign(count, NO_SYMBOL);
+    for (SymbolNumber k = 1; k < count; ++k)
+    {
+        add_case_variant(k);
+    }
+}
 
-    std::map<std::string, Weight> corrections = generate_correction_map(nbest, beam);
+void Speller::add_case_variant(SymbolNumber symbol)
+{
+    if (symbol >= lower_case.size())
+    {
+        lower_case.resize(symbol + 1, NO_SYMBOL);
+    }
+    Transducer* reader = (mutator != NULL ? mutator : lexicon);
+    std::string string = reader->get_key_table()->at(symbol);
+    // only single characters have a case, not flags or other multichar
+    // symbols
+    if (string.empty() ||
+        nByte_utf8(static_cast<uint8_t>(string[0])) != (int32_t) string.size())
+    {
+        return;
+    }
+    std::string lower = utf8_to_lower(string);
+    if (lower == string || !lexicon->get_alphabet()->has_string(lower))
+    {
+        return;
+    }
+    SymbolNumber variant;
+    if (reader->get_alphabet()->has_string(lower))
+    {
+        variant = reader->get_alphabet()->get_string_to_symbol()->
+            operator[](lower);
+    }
+    else
+    {
+        // only the lexicon has it
+        variant = add_input_symbol(lower);
+    }
+    lower_case[symbol] = variant;
+}
 
+CorrectionQueue
+Speller::queue_corrections(const std::map<std::string, Weight>& corrections,
+                           size_t nbest, Weight beam)
+{
+    CorrectionQueue correction_queue;
     adjust_weight_limits(nbest, beam);
-    for (std::map<std::string, Weight>::iterator it = corrections.begin();
+    for (std::map<std::string, Weight>::const_iterator it = corrections.begin();
          it != corrections.end(); ++it)
     {
         if (it->second <= limit)
@@ -1197,6 +3357,80 @@ CorrectionQueue Speller::correct(int8_t* line, size_t nbest,
     return correction_queue;
 }
 
+AnalysisCorrectionQueue Speller::correct_analyse(int8_t* line, size_t nbest,
+                                                 Weight maxweight, Weight beam,
+                                                 SearchStatistics* stats)
+{
+    mode = CorrectAnalyse;
+    statistics = stats;
+    partial = false;
+    arcs_scanned = 0;
+    search_start = std::chrono::steady_clock::now();
+
+    // if input initialization fails, return empty queue
+    if (!init_input(line))
+    {
+        return AnalysisCorrectionQueue();
+    }
+    nbest_queue = WeightQueue(nbest);
+    set_limiting_behaviour(nbest, maxweight, beam);
+
+    std::map<StringPair, Weight> analyses;
+    if (matrix != 0)
+    {
+        search_edit_distance(nbest, beam, &analyses);
+    }
+    else
+    {
+        // The cache holds no analyses, so this always searches from the start
+        TreeNode start_node(FlagDiacriticState(get_state_size(), 0));
+        node_queue.assign(1, start_node);
+        COUNT_STATISTIC(nodes_pushed++);
+        search_corrections(nbest, beam, &analyses);
+    }
+
+    adjust_weight_limits(nbest, beam);
+    AnalysisCorrectionQueue analysis_correction_queue;
+    for (std::map<StringPair, Weight>::iterator it = analyses.begin();
+         it != analyses.end(); ++it)
+    {
+        if (it->second <= limit)
+        {
+            analysis_correction_queue.push(StringPairWeightPair(it->first,
+                                                                it->second));
+        }
+    }
+
+    return analysis_correction_queue;
+}
+
+void Speller::set_budget(uint64_t nodes, uint64_t arcs, double seconds)
+{
+    max_nodes = nodes;
+    max_arcs = arcs;
+    max_seconds = seconds;
+}
+
+bool Speller::is_over_budget(uint64_t nodes_expanded)
+{
+    if (max_nodes > 0 && nodes_expanded >= max_nodes)
+    {
+        return true;
+    }
+    if (max_arcs > 0 && arcs_scanned >= max_arcs)
+    {
+        return true;
+    }
+    // reading the clock for every node would cost more than the node
+    if (max_seconds > 0.0 && (nodes_expanded & 0xff) == 0)
+    {
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - search_start;
+        return elapsed.count() >= max_seconds;
+    }
+    return false;
+}
+
 void Speller::set_limiting_behaviour(size_t nbest, Weight maxweight, Weight beam)
 {
     int8_t limiting_ = 0;
@@ -1270,32 +3504,292 @@ void Speller::adjust_weight_limits(size_t nbest, Weight beam)
     }
 }
 
-bool Speller::check(int8_t* line)
+bool Speller::check(int8_t* line, SearchStatistics* stats)
 {
     mode = Check;
+    statistics = stats;
     if (!init_input(line))
     {
         return false;
     }
+    return check_input();
+}
+
+bool Speller::check(const char* begin, const char* end,
+                    SearchStatistics* stats)
+{
+    mode = Check;
+    statistics = stats;
+    // the input is only read, never written through
+    if (!init_input(reinterpret_cast<int8_t*>(const_cast<char*>(begin)),
+                    reinterpret_cast<const int8_t*>(end)))
+    {
+        return false;
+    }
+    return check_input();
+}
+
+bool Speller::check(const char16_t* begin, const char16_t* end,
+                    SearchStatistics* stats)
+{
+    mode = Check;
+    statistics = stats;
+    if (!init_code_units(begin, end))
+    {
+        return false;
+    }
+    return check_input();
+}
+
+bool Speller::check(const char32_t* begin, const char32_t* end,
+                    SearchStatistics* stats)
+{
+    mode = Check;
+    statistics = stats;
+    if (!init_code_units(begin, end))
+    {
+        return false;
+    }
+    return check_input();
+}
+
+bool Speller::check_input(void)
+{
+    bool accepted;
+    if (deterministic_lexicon && walk_deterministic(accepted))
+    {
+        return accepted;
+    }
     TreeNode start_node(FlagDiacriticState(get_state_size(), 0));
     node_queue.assign(1, start_node);
+    COUNT_STATISTIC(nodes_pushed++);
     limit = std::numeric_limits<Weight>::max();
+    return open_alphabet ? check_nodes<true>() : check_nodes<false>();
+}
 
+template <bool OPEN>
+bool Speller::check_nodes(void)
+{
     while (node_queue.size() > 0)
     {
+        COUNT_STATISTIC(pop(node_queue.size()));
         next_node = node_queue.back();
         node_queue.pop_back();
         if (next_node.input_state == input.size() &&
             lexicon->is_final(next_node.lexicon_state))
         {
+            COUNT_STATISTIC(finals++);
             return true;
         }
-        lexicon_epsilons();
-        lexicon_consume();
+        lexicon_epsilons<Check, false, OPEN>();
+        lexicon_consume<Check, false, OPEN>();
     }
     return false;
 }
 
+bool Speller::walk_deterministic(bool& accepted)
+{
+    // at most one arc per input symbol and no epsilons: no choices to make
+    TransitionTableIndex i = 0;
+    for (SymbolVector::const_iterator it = input.begin();
+         it != input.end(); ++it)
+    {
+        if (!lower_case.empty() && lower_case[*it] != NO_SYMBOL)
+        {
+            // a capital has two ways to go
+            return false;
+        }
+        SymbolNumber sym = alphabet_translator[*it];
+        COUNT_STATISTIC(arcs_scanned++);
+        if (!lexicon->has_transitions(i + 1, sym))
+        {
+            if (sym >= lexicon->get_alphabet()->get_orig_symbol_count() &&
+                (lexicon->get_unknown() != NO_SYMBOL ||
+                 lexicon->get_identity() != NO_SYMBOL))
+            {
+                // unknown and identity arcs may both apply
+                return false;
+            }
+            accepted = false;
+            return true;
+        }
+        i = lexicon->take_non_epsilons(lexicon->next(i, sym), sym).index;
+    }
+    accepted = lexicon->is_final(i);
+    if (accepted)
+    {
+        COUNT_STATISTIC(finals++);
+    }
+    return true;
+}
+
+Hyphenator::Hyphenator(Transducer* hyphenator_ptr) :
+    hyphenator(hyphenator_ptr),
+    input(),
+    output(),
+    flag_state(hyphenator_ptr->get_state_size(), 0),
+    results(),
+    deterministic(
+        hyphenator_ptr->get_header()->probe_flag(Input_deterministic) &&
+        !hyphenator_ptr->get_header()->probe_flag(
+            Has_input_epsilon_transitions) &&
+        hyphenator_ptr->get_state_size() == 0)
+{
+}
+
+HyphenationQueue Hyphenator::hyphenate(int8_t* line)
+{
+    HyphenationQueue hyphenations;
+    results.clear();
+    output.clear();
+    if (!hyphenator->initialize_input_vector(input,
+                                             hyphenator->get_encoder(),
+                                             line))
+    {
+        return hyphenations;
+    }
+    if (deterministic)
+    {
+        walk_deterministic();
+    }
+    else
+    {
+        std::fill(flag_state.begin(), flag_state.end(), 0);
+        lookup(0, 0, 0.0);
+    }
+    for (StringWeightMap::const_iterator it = results.begin();
+         it != results.end(); ++it)
+    {
+        hyphenations.push(StringWeightPair(it->first, it->second));
+    }
+    return hyphenations;
+}
+
+bool Hyphenator::walk_deterministic(void)
+{
+    // at most one arc per input symbol and no epsilons: no choices to make
+    TransitionTableIndex i = 0;
+    Weight weight = 0.0;
+    for (SymbolVector::const_iterator it = input.begin();
+         it != input.end(); ++it)
+    {
+        if (!hyphenator->has_transitions(i + 1, *it))
+        {
+            return false;
+        }
+        STransition i_s = hyphenator->take_non_epsilons(
+            hyphenator->next(i, *it), *it);
+        if (i_s.symbol != 0)
+        {
+            output.push_back(i_s.symbol);
+        }
+        weight += i_s.weight;
+        i = i_s.index;
+    }
+    if (!hyphenator->is_final(i))
+    {
+        return false;
+    }
+    record(i, weight);
+    return true;
+}
+
+void Hyphenator::lookup(TransitionTableIndex i, uint32_t input_state,
+                        Weight weight)
+{
+    // Reaching a state again without reading input means an epsilon loop,
+    // which would otherwise be followed forever. The path only moves
+    // forward in the input, so the states at this position are at its end.
+    for (std::vector<std::pair<TransitionTableIndex, uint32_t> >::
+             reverse_iterator it = path.rbegin();
+         it != path.rend() && it->second == input_state; ++it)
+    {
+        if (it->first == i)
+        {
+            return;
+        }
+    }
+    path.push_back(std::make_pair(i, input_state));
+    if (input_state == input.size() && hyphenator->is_final(i))
+    {
+        record(i, weight);
+    }
+    TransitionTableIndex next;
+    if (hyphenator->has_epsilons_or_flags(i + 1))
+    {
+        next = hyphenator->next(i, 0);
+        STransition i_s = hyphenator->take_epsilons_and_flags(next);
+        while (i_s.symbol != NO_SYMBOL)
+        {
+            SymbolNumber input_sym = hyphenator->transitions.input_symbol(next);
+            if (input_sym == 0)
+            {
+                if (i_s.symbol != 0)
+                {
+                    output.push_back(i_s.symbol);
+                }
+                lookup(i_s.index, input_state, weight + i_s.weight);
+                if (i_s.symbol != 0)
+                {
+                    output.pop_back();
+                }
+            }
+            else
+            {
+                // only the one feature of the flag can change, so only
+                // that needs restoring
+                FlagDiacriticOperation op =
+                    hyphenator->get_operations()->operator[](input_sym);
+                ValueNumber old_value = flag_state[op.Feature()];
+                if (try_compatible_with(flag_state, op))
+                {
+                    lookup(i_s.index, input_state, weight + i_s.weight);
+                }
+                flag_state[op.Feature()] = old_value;
+            }
+            ++next;
+            i_s = hyphenator->take_epsilons_and_flags(next);
+        }
+    }
+    if (input_state < input.size() &&
+        hyphenator->has_transitions(i + 1, input[input_state]))
+    {
+        next = hyphenator->next(i, input[input_state]);
+        STransition i_s = hyphenator->take_non_epsilons(next,
+                                                        input[input_state]);
+        while (i_s.symbol != NO_SYMBOL)
+        {
+            if (i_s.symbol != 0)
+            {
+                output.push_back(i_s.symbol);
+            }
+            lookup(i_s.index, input_state + 1, weight + i_s.weight);
+            if (i_s.symbol != 0)
+            {
+                output.pop_back();
+            }
+            ++next;
+            i_s = hyphenator->take_non_epsilons(next, input[input_state]);
+        }
+    }
+    path.pop_back();
+}
+
+void Hyphenator::record(TransitionTableIndex i, Weight weight)
+{
+    weight += hyphenator->final_weight(i);
+    std::string hyphenation = stringify(hyphenator->get_key_table(), output);
+    StringWeightMap::iterator it = results.find(hyphenation);
+    if (it == results.end())
+    {
+        results[hyphenation] = weight;
+    }
+    else if (it->second > weight)
+    {
+        it->second = weight;
+    }
+}
+
 std::string stringify(KeyTable* key_table,
                       SymbolVector & symbol_vector)
 {
@@ -1339,59 +3833,44 @@ void Speller::build_alphabet_translator(void)
     }
 }
 
-bool Speller::init_input(int8_t* line)
+bool Speller::init_input(int8_t* line, const int8_t* end)
 {
     // Initialize the symbol vector to the tokenization given by encoder.
     // In the case of tokenization failure, valid utf-8 characters
     // are tokenized as unknown and tokenization is reattempted from
     // such a character onwards. The empty string is tokenized as an
-    // empty vector; there is no end marker.
+    // empty vector; there is no end marker. With an end, the input stops
+    // there, and symbols the encoder matches across it are split up.
     input.clear();
     SymbolNumber k = NO_SYMBOL;
     int8_t** inpointer = &line;
     int8_t* oldpointer;
+    Encoder* encoder = (mutator != NULL ? mutator : lexicon)->get_encoder();
 
-    while (**inpointer != '\0')
+    while ((end == 0 || *inpointer < end) && **inpointer != '\0')
     {
         oldpointer = *inpointer;
-        k = mutator->get_encoder()->find_key(inpointer);
+        k = encoder->find_key(inpointer);
+        if (end != 0 && *inpointer > end)
+        {
+            k = NO_SYMBOL;
+        }
         if (k == NO_SYMBOL)   // no tokenization from alphabet
         {
             int32_t bytes_to_tokenize = nByte_utf8(static_cast<uint8_t>(*oldpointer));
-            if (bytes_to_tokenize == 0)
+            if (bytes_to_tokenize == 0 ||
+                (end != 0 && oldpointer + bytes_to_tokenize > end))
             {
                 return false; // can't parse utf-8 character, admit failure
             }
             else
             {
-                char new_symbol[5]; // max size plus NUL
-                memcpy(new_symbol, oldpointer, bytes_to_tokenize);
-                new_symbol[bytes_to_tokenize] = '\0';
-                std::string new_symbol_string(new_symbol);
+                std::string new_symbol_string(
+                    reinterpret_cast<const char*>(oldpointer),
+                    bytes_to_tokenize);
                 oldpointer += bytes_to_tokenize;
                 *inpointer = oldpointer;
-                #if USE_CACHE
-                cache.push_back(CacheContainer());
-                #endif
-                if (!lexicon->get_alphabet()->has_string(new_symbol_string))
-                {
-                    lexicon->get_alphabet()->add_symbol(new_symbol_string);
-                }
-                SymbolNumber k_lexicon = lexicon->get_alphabet()->get_string_to_symbol()
-                                         ->operator[](new_symbol_string);
-                lexicon->get_encoder()->read_input_symbol(new_symbol, k_lexicon);
-                if (!mutator->get_alphabet()->has_string(new_symbol_string))
-                {
-                    mutator->get_alphabet()->add_symbol(new_symbol_string);
-                }
-                k = mutator->get_alphabet()->get_string_to_symbol()->
-                    operator[](new_symbol_string);
-                mutator->get_encoder()->read_input_symbol(new_symbol, k);
-                if (k >= alphabet_translator.size())
-                {
-                    add_symbol_to_alphabet_translator(k_lexicon);
-                }
-                input.push_back(k);
+                input.push_back(add_input_symbol(new_symbol_string));
                 continue;
             }
         }
@@ -1403,11 +3882,77 @@ bool Speller::init_input(int8_t* line)
     return true;
 }
 
+template <typename C>
+bool Speller::init_code_units(const C* begin, const C* end)
+{
+    // as init_input(), with the encoder reading the code units themselves
+    input.clear();
+    Encoder* encoder = (mutator != NULL ? mutator : lexicon)->get_encoder();
+    const C* p = begin;
+    while (p < end && *p != 0)
+    {
+        const C* old = p;
+        SymbolNumber k = encoder->find_key(&p, end);
+        if (k == NO_SYMBOL)
+        {
+            p = old;
+            int32_t code = decode_code_point(&p, end);
+            if (code < 0)
+            {
+                return false;
+            }
+            uint8_t bytes[4];
+            input.push_back(add_input_symbol(
+                std::string(reinterpret_cast<const char*>(bytes),
+                            encode_utf8(code, bytes))));
+        }
+        else
+        {
+            input.push_back(k);
+        }
+    }
+    return true;
+}
+
 void Speller::add_symbol_to_alphabet_translator(SymbolNumber to_sym)
 {
     alphabet_translator.push_back(to_sym);
 }
 
+SymbolNumber Speller::add_input_symbol(std::string symbol)
+{
+    #if USE_CACHE
+    cache.push_back(CacheContainer());
+    #endif
+    if (!lexicon->get_alphabet()->has_string(symbol))
+    {
+        lexicon->get_alphabet()->add_symbol(symbol);
+    }
+    SymbolNumber k_lexicon = lexicon->get_alphabet()->get_string_to_symbol()
+                             ->operator[](symbol);
+    lexicon->get_encoder()->read_input_symbol(symbol, k_lexicon);
+    SymbolNumber k = k_lexicon;
+    if (mutator != NULL)
+    {
+        if (!mutator->get_alphabet()->has_string(symbol))
+        {
+            mutator->get_alphabet()->add_symbol(symbol);
+        }
+        k = mutator->get_alphabet()->get_string_to_symbol()->
+            operator[](symbol);
+        mutator->get_encoder()->read_input_symbol(symbol, k);
+    }
+    if (k >= alphabet_translator.size())
+    {
+        add_symbol_to_alphabet_translator(k_lexicon);
+    }
+    if (!lower_case.empty())
+    {
+        add_case_variant(k);
+    }
+    return k;
+}
+
 } // namespace hfst_ol
 
 char*
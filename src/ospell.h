@@ -24,7 +24,11 @@
 #include <cstdint>
 #include <limits>
 #include <algorithm>
+#include <chrono>
+#include <memory>
 #include "hfst-ol.h"
+#include "ConfusionMatrix.h"
+#include "SymmetricDeleteIndex.h"
 
 namespace hfst_ol {
 
@@ -35,6 +39,8 @@ struct CacheContainer;
 typedef std::pair<std::string, std::string> StringPair;
 typedef std::pair<std::string, Weight> StringWeightPair;
 typedef std::vector<StringWeightPair> StringWeightVector;
+typedef std::pair<std::u16string, Weight> U16StringWeightPair;
+typedef std::pair<std::u32string, Weight> U32StringWeightPair;
 typedef std::pair<std::pair<std::string, std::string>, Weight>
     StringPairWeightPair;
 typedef std::vector<TreeNode> TreeNodeVector;
@@ -161,14 +167,75 @@ public:
     Weight get_highest(void) const;
 };
 
+//! @brief How Transducer::from_file() maps automata into memory.
+
+//! The flags may be combined. They need Linux, elsewhere they are hints
+//! that may be ignored.
+enum MappingFlags
+{
+    MapDefault = 0, //!< map the file and let pages fault in when read
+    MapPopulate = (1u << 0), //!< fault every page in at load time
+    MapHugePages = (1u << 1), //!< copy into transparent huge page memory
+    MapRandom = (1u << 2) //!< tell the kernel index reads are random
+};
+
+//! @brief MappingFlags for a comma separated list of @a names out of
+//!        populate, hugepages and random; -1 if a name is unknown.
+int parse_mapping_flags(const std::string& names);
+
+//! @brief Bytes of a stored automaton, freed with the last Transducer
+//!        using them.
+
+//! The bytes are never written after loading, so any number of Transducer
+//! objects, also in different threads, may be read from the same storage.
+class TransducerStorage
+{
+public:
+    //! how the bytes were obtained, and so how they are released
+    enum Kind
+    {
+        Mapped, //!< by mmap()
+        Allocated //!< by new[]
+    };
+    //!
+    //! take ownership of @a len bytes at @a data
+    TransducerStorage(int8_t* data, size_t len, Kind kind);
+    ~TransducerStorage();
+    TransducerStorage(const TransducerStorage&) = delete;
+    TransducerStorage& operator=(const TransducerStorage&) = delete;
+    //!
+    //! map file @a filename into memory as @a mapping says
+    static std::shared_ptr<const TransducerStorage>
+    from_file(const std::string& filename, int mapping=MapDefault);
+    //!
+    //! the stored automaton
+    int8_t* data(void) const
+    {
+        return data_;
+    }
+    //!
+    //! its size in bytes
+    size_t size(void) const
+    {
+        return len_;
+    }
+private:
+    int8_t* data_;
+    size_t len_;
+    Kind kind_;
+};
+
+typedef std::shared_ptr<const TransducerStorage> TransducerStoragePtr;
+
 //! Internal class for Transducer processing.
 
-//! Contains low-level processing stuff.
+//! Contains low-level processing stuff. A Transducer can be moved but not
+//! copied; to share an automaton, create more Transducers from its
+//! storage, which only duplicates the alphabet.
 class Transducer
 {
 private:
-    int8_t* raw_ = nullptr;
-    size_t len_ = 0;
+    TransducerStoragePtr storage_; //!< keeps the tables alive, or null
 protected:
     TransducerHeader header; //!< header data
     TransducerAlphabet alphabet; //!< alphabet data
@@ -178,13 +245,24 @@ protected:
     static const TransitionTableIndex START_INDEX = 0; //!< position of first
 public:
     //!
-    //! read transducer from file @a f
-    static Transducer from_file(const std::string& filename);
-    static Transducer* new_from_file(const std::string& filename);
+    //! read transducer from file @a filename, mapped as @a mapping says
+    static Transducer from_file(const std::string& filename,
+                                int mapping=MapDefault);
+    static Transducer* new_from_file(const std::string& filename,
+                                     int mapping=MapDefault);
     //!
-    //! read transducer from raw data @a data
+    //! read transducer from raw data @a raw, which must outlive it
     Transducer(int8_t* raw);
-    ~Transducer();
+    //!
+    //! read transducer from @a storage and share it
+    explicit Transducer(const TransducerStoragePtr& storage);
+    Transducer(Transducer&& other);
+    Transducer& operator=(Transducer&& other);
+    Transducer(const Transducer&) = delete;
+    Transducer& operator=(const Transducer&) = delete;
+    //!
+    //! get the storage the tables are read from, null if not owned
+    TransducerStoragePtr get_storage(void) const;
     IndexTable indices; //!< index table
     TransitionTable transitions; //!< transition table
     //!
@@ -217,6 +295,9 @@ public:
     SymbolNumber get_unknown(void) const;
     SymbolNumber get_identity(void) const;
     //!
+    //! get header of automaton
+    TransducerHeader* get_header(void);
+    //!
     //! get alphabet of automaton
     TransducerAlphabet* get_alphabet(void);
     //!
@@ -250,6 +331,10 @@ public:
     //! whether state has non-epsilons or non-flags
     bool has_non_epsilons_or_flags(const TransitionTableIndex i);
     //!
+    //! hint that state @a i will soon be looked up, with @a symbol if known
+    void prefetch(const TransitionTableIndex i,
+                  const SymbolNumber symbol) const;
+    //!
     //! whether it's final
     bool is_final(const TransitionTableIndex i);
     //!
@@ -261,6 +346,9 @@ public:
     //!
     //! whether it's weighedc
     bool is_weighted(void);
+    //!
+    //! bytes taken by the index and transition tables
+    size_t get_table_size(void);
 
 };
 
@@ -271,6 +359,7 @@ struct TreeNode
 {
     //    SymbolVector input_string; //<! the current input vector
     SymbolVector string; //!< the current output vector
+    SymbolVector analysis; //!< lexicon output when correcting with analyses
     uint32_t input_state; //!< its input state
     TransitionTableIndex mutator_state; //!< state in error model
     TransitionTableIndex lexicon_state; //!< state in language model
@@ -294,10 +383,30 @@ struct TreeNode
     {
     }
 
+    //!
+    //! construct a node that also carries an analysis
+    TreeNode(SymbolVector prev_string,
+             SymbolVector prev_analysis,
+             uint32_t i,
+             TransitionTableIndex mutator,
+             TransitionTableIndex lexicon,
+             FlagDiacriticState state,
+             Weight w) :
+        string(prev_string),
+        analysis(prev_analysis),
+        input_state(i),
+        mutator_state(mutator),
+        lexicon_state(lexicon),
+        flag_state(state),
+        weight(w)
+    {
+    }
+
     //!
     //! construct empty node with a starting state for flags
     TreeNode(FlagDiacriticState start_state) : // starting state node
         string(SymbolVector()),
+        analysis(SymbolVector()),
         input_state(0),
         mutator_state(0),
         lexicon_state(0),
@@ -315,6 +424,10 @@ struct TreeNode
     TreeNode update_lexicon(SymbolNumber next_symbol,
                             TransitionTableIndex next_lexicon,
                             Weight weight);
+    TreeNode update_lexicon(SymbolNumber next_symbol,
+                            SymbolNumber analysis_symbol,
+                            TransitionTableIndex next_lexicon,
+                            Weight weight);
 
     //!
     //! traverse some node in error model
@@ -329,6 +442,13 @@ struct TreeNode
                     TransitionTableIndex next_lexicon,
                     Weight weight);
 
+    TreeNode update(SymbolNumber output_symbol,
+                    SymbolNumber analysis_symbol,
+                    uint32_t next_input,
+                    TransitionTableIndex next_mutator,
+                    TransitionTableIndex next_lexicon,
+                    Weight weight);
+
     TreeNode update(SymbolNumber output_symbol,
                     TransitionTableIndex next_mutator,
                     TransitionTableIndex next_lexicon,
@@ -339,7 +459,26 @@ struct TreeNode
 
 typedef std::vector<TreeNode> TreeNodeQueue;
 
+//! @brief apply flag diacritic @a op to @a flag_state if it is compatible.
+bool try_compatible_with(FlagDiacriticState& flag_state,
+                         FlagDiacriticOperation op);
+
 int nByte_utf8(uint8_t c);
+//! @brief @a s with each letter in lower case.
+//
+//! Only the one to one case pairs of the Latin, Greek, Cyrillic and
+//! Armenian letters are known; everything else is kept as it is.
+std::string utf8_to_lower(const std::string& s);
+//! @brief @a s with each letter in upper case, as utf8_to_lower() knows them
+std::string utf8_to_upper(const std::string& s);
+//! @brief @a s in utf-16; bytes that are no utf-8 become U+FFFD
+std::u16string utf8_to_utf16(const std::string& s);
+//! @brief @a s in utf-32; bytes that are no utf-8 become U+FFFD
+std::u32string utf8_to_utf32(const std::string& s);
+//! @brief @a s in utf-8; lone surrogates become U+FFFD
+std::string utf16_to_utf8(const std::u16string& s);
+//! @brief @a s in utf-8; units that are no characters become U+FFFD
+std::string utf32_to_utf8(const std::u32string& s);
 
 //! Exception when speller cannot map characters of error model to language
 //! model.
@@ -358,6 +497,57 @@ public:
     }
 };
 
+//! @brief Counters of the work done by Speller searches.
+
+//! Speller adds to these when given a pointer to them; callers clear them
+//! between queries as needed. The counters are only kept when built with
+//! USE_STATISTICS, otherwise they stay zero.
+struct SearchStatistics
+{
+    uint64_t nodes_pushed; //!< nodes added to the search stack
+    uint64_t nodes_popped; //!< nodes taken from the stack and expanded
+    uint64_t arcs_scanned; //!< transitions looked at in either automaton
+    uint64_t epsilon_expansions; //!< epsilon transitions followed
+    uint64_t flag_expansions; //!< compatible flag diacritics followed
+    uint64_t pruned; //!< nodes not pushed for exceeding the weight limit
+    uint64_t finals; //!< final nodes reached
+    uint64_t duplicate_finals; //!< finals with an already seen result
+    uint64_t peak_queue_size; //!< largest size of the search stack
+
+    SearchStatistics(void)
+    {
+        clear();
+    }
+
+    //!
+    //! reset all counters to zero
+    void clear(void)
+    {
+        nodes_pushed = 0;
+        nodes_popped = 0;
+        arcs_scanned = 0;
+        epsilon_expansions = 0;
+        flag_expansions = 0;
+        pruned = 0;
+        finals = 0;
+        duplicate_finals = 0;
+        peak_queue_size = 0;
+    }
+
+    //!
+    //! count a node popped from a stack of @a queue_size nodes
+    void pop(size_t queue_size)
+    {
+        ++nodes_popped;
+        if (queue_size > peak_queue_size)
+        {
+            peak_queue_size = queue_size;
+        }
+    }
+};
+
+class CorrectionSession;
+
 //! @brief Basic spell-checking automata pair unit.
 
 //! Speller consists of two automata, one for language modeling and one for
@@ -366,33 +556,38 @@ public:
 //! @see ZHfstOspeller for high level access.
 class Speller
 {
+    friend class CorrectionSession;
 protected:
-    std::map<std::string, Weight> generate_correction_map(size_t nbest, Weight beam);
+    //! @brief run the correction kernel matching the current query.
+    std::map<std::string, Weight> search_corrections(
+        size_t nbest, Weight beam,
+        std::map<StringPair, Weight>* analyses=0);
     void set_limiting_behaviour(size_t nbest, Weight maxweight, Weight beam);
-    bool is_under_weight_limit(Weight w) const;
     void adjust_weight_limits(size_t nbest, Weight beam);
-    void lexicon_consume(void);
-    //!
-    //! traverse epsilons in error model
-    void mutator_epsilons(void);
-    //! traverse along input
-    void consume_input();
-    #if USE_CACHE
-    //! @brief Construct a cache entry for @a first_sym..
-    void build_cache(SymbolNumber first_sym);
-    #endif
+    bool is_over_budget(uint64_t nodes_expanded);
+    //! @brief check input by walking a deterministic lexicon.
+    //
+    //! Returns false if the walk meets a symbol that needs a search.
+    bool walk_deterministic(bool& accepted);
     //! size of states
     SymbolNumber get_state_size(void);
     //!
     //! initialise string conversions
     void build_alphabet_translator(void);
     void add_symbol_to_alphabet_translator(SymbolNumber to_sym);
+    //! @brief add @a symbol, not in the input alphabet, to the alphabets
+    //!        and return its input symbol
+    SymbolNumber add_input_symbol(std::string symbol);
+    //! @brief set the entry of input symbol @a symbol in @c lower_case
+    void add_case_variant(SymbolNumber symbol);
     //!
-    //! initialize input string
-    bool init_input(int8_t* line);
-    //!
-    //! travers epsilons in language model
-    void lexicon_epsilons(void);
+    //! initialize input string, up to @a end if given
+    bool init_input(int8_t* line, const int8_t* end=0);
+    //! initialize input string from utf-16 or utf-32 code units
+    template <typename C>
+    bool init_code_units(const C* begin, const C* end);
+    //! @brief whether the initialised input is accepted
+    bool check_input(void);
     bool has_lexicon_epsilons(void) const
     {
         return lexicon->has_epsilons_or_flags(next_node.lexicon_state + 1);
@@ -401,16 +596,51 @@ protected:
     {
         return mutator->has_transitions(next_node.mutator_state + 1, 0);
     }
-    //!
-    //! helper functions for traversal
-    void queue_mutator_arcs(SymbolNumber input);
-    void queue_lexicon_arcs(SymbolNumber input,
-                            uint32_t mutator_state,
-                            Weight mutator_weight=0.0,
-                            int input_increment=0);
     #if USE_CACHE
     CorrectionQueue handle_input_size_lt_1(SymbolNumber first_input, size_t nbest, Weight beam);
     #endif
+    //! @brief queue the @a corrections that are within the final limit.
+    CorrectionQueue queue_corrections(
+        const std::map<std::string, Weight>& corrections,
+        size_t nbest, Weight beam);
+    //! @brief find out whether the error model is a plain edit distance.
+    //
+    //! That is a chain of states, each final with no weight, where every
+    //! symbol maps to itself for free and every substitution, insertion
+    //! and deletion of those symbols leads to the next state with one
+    //! common weight. Such a model is searched as a ConfusionMatrix.
+    void recognise_edit_distance(void);
+    //! @brief search corrections with @a confusion_matrix for error model
+    void use_matrix(const ConfusionMatrix& confusion_matrix);
+    //! @brief search the lexicon for strings within the edits of
+    //!        @c matrix from the input, without an error model automaton.
+    std::map<std::string, Weight> search_edit_distance(
+        size_t nbest, Weight beam,
+        std::map<StringPair, Weight>* analyses=0);
+    //! @brief set @c edit_input to the input as symbols of @c matrix
+    void encode_edit_input(void);
+    //! @brief weight of editing input @a j into @a to, as its small
+    //!        letter if that is cheaper
+    Weight folded_edit(uint32_t j, SymbolNumber to) const
+    {
+        Weight weight = matrix->edit(edit_input[j], to);
+        if (edit_folded[j] != NO_SYMBOL)
+        {
+            weight = std::min(weight, matrix->edit(edit_folded[j], to));
+        }
+        return weight;
+    }
+    //! @brief look the words near the input up in @c delete_index and
+    //!        weight them with the error model.
+    std::map<std::string, Weight> search_delete_index(size_t nbest,
+                                                      Weight beam);
+    //! @brief least weight of the error model rewriting the input as the
+    //!        @a length lexicon symbols of @a word, infinite if it can't
+    //!        or if it weighs more than @a bound.
+    Weight error_model_weight(const SymbolNumber* word, uint32_t length,
+                              Weight bound);
+    //! @brief the same with the edits of @c matrix
+    Weight matrix_weight(const SymbolNumber* word, uint32_t length);
 public:
     Transducer* mutator; //!< error model
     Transducer* lexicon; //!< language model
@@ -422,6 +652,49 @@ public:
     WeightQueue nbest_queue; //!< queue to keep track of current n best results
     SymbolVector alphabet_translator; //!< alphabets in automata
     OperationMap* operations; //!< flags in it
+    SearchStatistics* statistics; //!< counters of current search, or 0
+    uint64_t max_nodes; //!< nodes a correction may expand, 0 for no limit
+    uint64_t max_arcs; //!< arcs a correction may scan, 0 for no limit
+    double max_seconds; //!< time a correction may take, 0 for no limit
+    uint64_t arcs_scanned; //!< arcs scanned by the current correction
+    bool partial; //!< whether the last correction ran out of budget
+    //! when the current correction started
+    std::chrono::steady_clock::time_point search_start;
+    //! whether check() can walk the lexicon without searching: it is
+    //! input deterministic, without input epsilons and without flags
+    bool deterministic_lexicon;
+    //! whether either automaton has unknown or identity arcs
+    bool open_alphabet;
+    //! error model as edit weights, or 0 if it is searched as an automaton
+    const ConfusionMatrix* matrix;
+    //! the plain edit distance the error model automaton turned out to be
+    std::shared_ptr<ConfusionMatrix> recognised_matrix;
+    //! lexicon symbols @c matrix can write, with their numbers in it
+    std::vector<std::pair<SymbolNumber, SymbolNumber> > edit_targets;
+    //! weight of each edit if all edits of @c matrix weigh the same
+    Weight edit_unit;
+    SymbolVector edit_input; //!< input as symbols of @c matrix
+    //! lower case of @c edit_input as symbols of @c matrix, or NO_SYMBOL
+    SymbolVector edit_folded;
+    SymbolVector edit_path; //!< the same for the current lexicon path
+    //! least weights of editing each input prefix into the lexicon path
+    //! with each number of edits, one row per symbol on the path
+    std::vector<Weight> edit_rows;
+    //! words of the lexicon to look corrections up in, or 0 to search
+    const SymmetricDeleteIndex* delete_index;
+    //! first maximum weight of n-best corrections without other limits,
+    //! or 0 to search them unbounded
+    Weight deepening_weight;
+    //! times the maximum weight is doubled before searching unbounded
+    static const uint32_t DEEPENING_ROUNDS = 4;
+    //! whether the weight limit has cut off part of the current search
+    bool weight_limited;
+    //! least weight to a final state from each lexicon state reachable
+    //! from the start, in state order; empty if not built
+    std::vector<std::pair<TransitionTableIndex, Weight> > completion_table;
+    //! the input symbol of the lower case of each input symbol, or
+    //! NO_SYMBOL if it has none; empty if case is not folded
+    SymbolVector lower_case;
 
     #if USE_CACHE
     //!< A cache for the result of first symbols
@@ -441,28 +714,231 @@ public:
         MaxWeightNbestBeam = MaxWeight | Nbest | Beam
     } limiting;
     //! what mode we're in
-    enum Mode { Check, Correct, Lookup } mode;
+    enum Mode { Check, Correct, CorrectAnalyse, Lookup } mode;
+
+protected:
+    // The search kernels are instantiated for each @c MODE, for @c STRICT
+    // weight limits (n-best only, where ties are pruned) and for @c OPEN
+    // alphabets with unknown or identity arcs.
+    template <Mode MODE, bool STRICT, bool OPEN>
+    std::map<std::string, Weight> generate_correction_map(
+        size_t nbest, Weight beam,
+        std::map<StringPair, Weight>* analyses);
+    template <Mode MODE, bool STRICT>
+    bool is_under_weight_limit(Weight w);
+    template <Mode MODE, bool STRICT, bool OPEN>
+    void lexicon_consume(void);
+    //! @brief follow the lexicon arcs reading @a input for the next input
+    template <Mode MODE, bool STRICT, bool OPEN>
+    void lexicon_consume_symbol(SymbolNumber input);
+    //!
+    //! traverse epsilons in error model
+    template <Mode MODE, bool STRICT, bool OPEN>
+    void mutator_epsilons(void);
+    //! traverse along input
+    template <Mode MODE, bool STRICT, bool OPEN>
+    void consume_input();
+    //! @brief follow the error model arcs reading @a input for the next
+    //!        input
+    template <Mode MODE, bool STRICT, bool OPEN>
+    void consume_input_symbol(SymbolNumber input);
+    //!
+    //! travers epsilons in language model
+    template <Mode MODE, bool STRICT, bool OPEN>
+    void lexicon_epsilons(void);
+    //!
+    //! helper functions for traversal
+    template <Mode MODE, bool STRICT, bool OPEN>
+    void queue_mutator_arcs(SymbolNumber input);
+    template <Mode MODE, bool STRICT, bool OPEN>
+    void queue_lexicon_arcs(SymbolNumber input,
+                            uint32_t mutator_state,
+                            Weight mutator_weight=0.0,
+                            int input_increment=0);
+    //! @brief prefetch the rows the last queued node will look up
+    template <Mode MODE>
+    void prefetch_queued(void) const;
+    template <bool OPEN>
+    bool check_nodes(void);
+    template <bool OPEN>
+    void analyse_nodes(std::map<std::string, Weight>& outputs);
+    //! @brief what an edit distance search has found so far
+    struct EditSearch
+    {
+        std::map<std::string, Weight> corrections;
+        std::map<StringPair, Weight>* analyses; //!< or 0 if not wanted
+        size_t nbest;
+        Weight beam;
+        uint64_t nodes_expanded;
+    };
+    //! @brief extend the lexicon path of @a depth symbols at state @a i.
+    template <bool UNIFORM, bool FOLD>
+    void edit_distance_lookup(TransitionTableIndex i, uint32_t depth,
+                              Weight weight, EditSearch& search);
+    //! @brief follow the epsilons from the nodes of @a layer, all at one
+    //!        input position, adding the nodes reached to it.
+    //
+    //! Returns false if the search ran out of budget first.
+    template <bool OPEN>
+    bool close_layer(TreeNodeVector& layer, uint64_t& nodes_expanded);
+    //! @brief add to @a layers the nodes at each input position after the
+    //!        last one, each layer closed over epsilons.
+    //
+    //! Out of budget, it sets @c partial and keeps the whole layers.
+    template <bool OPEN>
+    void extend_layers(std::vector<TreeNodeVector>& layers);
+    //! @brief the corrections ending in the nodes of @a layer
+    std::map<std::string, Weight> layer_corrections(TreeNodeVector& layer,
+                                                    size_t nbest,
+                                                    Weight beam);
+    //! @brief the nodes where the input ends, walking it through the
+    //!        lexicon alone.
+    //
+    //! Returns false if the walk ran out of budget first.
+    template <bool OPEN>
+    bool consume_prefix(TreeNodeVector& ends, uint64_t& nodes_expanded);
+    //! @brief queue the nodes the lexicon arcs of @c next_node lead to,
+    //!        adding the input symbols of the arcs to their strings and
+    //!        @a symbol_weight to their weights.
+    void queue_completion_arcs(Weight symbol_weight);
+    //! @brief the @a nbest lightest words reached from the nodes queued,
+    //!        each @a prefix and the string of its path.
+    CorrectionQueue complete_nodes(const std::string& prefix, size_t nbest,
+                                   Weight symbol_weight,
+                                   uint64_t nodes_expanded);
+    //! @brief least weight from lexicon state @a i to a final state, as
+    //!        @c completion_table has it, or 0 if it is not built.
+    Weight completion_estimate(TransitionTableIndex i) const;
+    #if USE_CACHE
+    //! @brief Construct a cache entry for @a first_sym..
+    template <bool OPEN>
+    void build_cache(SymbolNumber first_sym);
+    #endif
+
+public:
 
     //!
     //! Create a speller object from error model and language automata.
     Speller(Transducer* mutator_ptr, Transducer* lexicon_ptr);
+    //!
+    //! Create a speller object from edit weights and language automaton;
+    //! @a confusion_matrix must outlive the speller.
+    Speller(const ConfusionMatrix& confusion_matrix, Transducer* lexicon_ptr);
+
+    //! @brief look corrections up in @a index, built from the lexicon,
+    //!        instead of searching the lexicon.
+    //
+    //! Words further from the input than the index distance are not
+    //! found, the others get the weight the error model gives them.
+    //! @a index must outlive the speller.
+    void use_delete_index(const SymmetricDeleteIndex& index);
+
+    //! @brief search the error model as edit weights instead of as an
+    //!        automaton if it is a plain edit distance, or again as the
+    //!        automaton.
+    //
+    //! Both give the same corrections with the same weights, except that
+    //! with a limit on their number each may give other corrections tied
+    //! with the last one. A speller made from edit weights always searches
+    //! them. Returns whether edit weights are searched.
+    bool use_edit_distance(bool edit_distance);
 
     //! @brief Check if the given string is accepted by the speller
-    bool check(int8_t* line);
+    //
+    //! If @a stats is given, the work done is added to it.
+    bool check(int8_t* line, SearchStatistics* stats=0);
+    //! @brief Check the string from @a begin up to @a end, which need not
+    //!        be followed by a NUL
+    //
+    //! The encoder may still look ahead past @a end while it tries its
+    //! longest symbols, so the text there must be readable.
+    bool check(const char* begin, const char* end,
+               SearchStatistics* stats=0);
+    //! @brief Check the utf-16 code units from @a begin up to @a end
+    //
+    //! The encoder reads the code units as they are, without making a
+    //! utf-8 string of them.
+    bool check(const char16_t* begin, const char16_t* end,
+               SearchStatistics* stats=0);
+    //! @brief Check the utf-32 code units from @a begin up to @a end
+    bool check(const char32_t* begin, const char32_t* end,
+               SearchStatistics* stats=0);
     //! @brief suggest corrections for given string @a line.
     //
     //! The number of corrections given and stored at any given time
     //! is limited by @a nbest if ≥ 0.
     CorrectionQueue correct(int8_t* line, size_t nbest=0,
                             Weight maxweight=-1.0,
-                            Weight beam=-1.0);
+                            Weight beam=-1.0,
+                            SearchStatistics* stats=0);
+
+    //! @brief suggest corrections for @a line with their analyses.
+    //
+    //! Like correct(), but keeps the output tape of a two-tape language
+    //! model, so each correction comes with its analyses from the same
+    //! search. The weight of each pair is the weight of its path.
+    AnalysisCorrectionQueue correct_analyse(int8_t* line, size_t nbest=0,
+                                            Weight maxweight=-1.0,
+                                            Weight beam=-1.0,
+                                            SearchStatistics* stats=0);
 
     //! @brief analyse given string @a line.
     //
     //! If language model is two-tape, give a list of analyses for string.
     //! If not, this should return queue of one result @a line if the
     //! string is in language model and 0 results if it isn't.
-    AnalysisQueue analyse(int8_t* line);
+    AnalysisQueue analyse(int8_t* line, SearchStatistics* stats=0);
+
+    //! @brief complete the prefix @a line into words of the lexicon.
+    //
+    //! Gives the @a nbest lightest words starting with @a line, or all of
+    //! them if @a nbest is 0, none weighing more than @a maxweight if it
+    //! is ≥ 0. The words are searched best first from the end of the
+    //! prefix; build_completion_table() lets the search head straight for
+    //! the lightest. The budget of set_budget() applies.
+    CorrectionQueue complete(int8_t* line, size_t nbest,
+                             Weight maxweight=-1.0,
+                             SearchStatistics* stats=0);
+    //! @brief complete corrections of the prefix @a line into words of
+    //!        the lexicon.
+    //
+    //! The error model rewrites @a line into the start of a word as in
+    //! correct(), and the word is completed as in complete() with
+    //! @a symbol_weight added for each symbol completed, so close
+    //! corrections and short completions come first. Gives complete()
+    //! without an error model automaton.
+    CorrectionQueue correct_prefix(int8_t* line, size_t nbest,
+                                   Weight maxweight=-1.0,
+                                   Weight symbol_weight=0.0,
+                                   SearchStatistics* stats=0);
+    //! @brief fill @c completion_table for complete().
+    //
+    //! Flags are not followed, so the weights are lower bounds. A lexicon
+    //! with negative weights gets no table, as it would not be one.
+    void build_completion_table(void);
+
+    //! @brief search n-best corrections without a maximum weight or beam
+    //!        up to @a initial_weight first, doubling it until the n-th
+    //!        correction weighs less, and unbounded in the end.
+    //
+    //! The corrections are the same as without; weights must not be
+    //! negative. Zero turns this off.
+    void set_deepening(Weight initial_weight);
+
+    //! @brief whether a capital in the input may also be read as its
+    //!        small letter, so that one search covers the word form in
+    //!        lower case, capitalised and in capitals.
+    //
+    //! Reading the small letter costs nothing. The delete index is not
+    //! used while case is folded.
+    void set_case_folding(bool fold);
+
+    //! @brief bound the work of each correction.
+    //
+    //! When @a nodes nodes have been expanded, @a arcs arcs scanned or
+    //! @a seconds seconds have passed, correction stops and returns the
+    //! best results found so far, setting @c partial. Zero means no limit.
+    void set_budget(uint64_t nodes, uint64_t arcs, double seconds);
 
     #if USE_CACHE
     //! @brief Clear the cache;
@@ -470,6 +946,78 @@ public:
     #endif
 };
 
+//! @brief Corrections of a word as it is typed.
+
+//! The search keeps the nodes it reached at each input position, so when
+//! the next call only adds symbols to the end of the previous word, or
+//! takes some off, the search continues from the last position the two
+//! have in common instead of from the start. Only the maximum weight
+//! prunes the kept nodes; the n-best and beam limits are applied to the
+//! corrections, which include all ties with the n-th. Spellers without
+//! an error model automaton are searched from the start every time.
+class CorrectionSession
+{
+public:
+    //!
+    //! start a session correcting with @a speller, which must outlive it
+    explicit CorrectionSession(Speller* speller=0);
+
+    //! @brief suggest corrections for @a line like Speller::correct()
+    //
+    //! A different @a maxweight than in the previous call starts over.
+    CorrectionQueue correct(int8_t* line, size_t nbest=0,
+                            Weight maxweight=-1.0,
+                            Weight beam=-1.0,
+                            SearchStatistics* stats=0);
+    //!
+    //! forget the kept search
+    void reset(void);
+    //!
+    //! number of input symbols whose search is kept
+    size_t depth(void) const;
+
+private:
+    Speller* speller_;
+    SymbolVector input_; //!< input of the previous call
+    //! nodes at each input position, with epsilons followed
+    std::vector<TreeNodeVector> layers_;
+    Weight maxweight_; //!< the maximum weight the layers were pruned at
+};
+
+//! @brief Single-tape lookup for hyphenating automata.
+
+//! A hyphenator maps word forms to hyphenated word forms. Lookup follows the
+//! automaton depth-first keeping one output tape that is truncated on
+//! backtracking, so no search nodes are built per transition. When the
+//! header says the automaton is input-deterministic without input epsilons,
+//! the input is walked straight through without backtracking at all.
+class Hyphenator
+{
+protected:
+    void lookup(TransitionTableIndex i, uint32_t input_state, Weight weight);
+    void record(TransitionTableIndex i, Weight weight);
+    bool walk_deterministic(void);
+public:
+    Transducer* hyphenator; //!< hyphenating automaton
+    SymbolVector input; //!< current input
+    SymbolVector output; //!< current output tape
+    FlagDiacriticState flag_state; //!< flags along current path
+    StringWeightMap results; //!< hyphenations found for current input
+    bool deterministic; //!< whether the straight walk can be used
+    //! states and input positions on the current path, to cut epsilon loops
+    std::vector<std::pair<TransitionTableIndex, uint32_t> > path;
+
+    //!
+    //! Create a hyphenator from a hyphenating automaton.
+    Hyphenator(Transducer* hyphenator_ptr);
+
+    //! @brief hyphenate given string @a line.
+    //
+    //! Gives all hyphenations of @a line, or none if the automaton does
+    //! not accept it.
+    HyphenationQueue hyphenate(int8_t* line);
+};
+
 #if USE_CACHE
 struct CacheContainer
 {
@@ -0,0 +1,470 @@
+// Copyright 2010 University of Helsinki
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#ifndef WINDOWS
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "server.h"
+
+using hfst_ol::ZHfstOspeller;
+using hfst_ol::StringWeightPair;
+
+//! largest request accepted, to keep a bad client from exhausting memory
+static const uint32_t MAX_FRAME = 16 * 1024 * 1024;
+//! requests waiting for a worker before readers stop reading
+static const size_t MAX_PENDING = 1024;
+//! requests of one client not yet answered on its socket before its
+//! reader stops reading, so a client that doesn't read can't take over
+static const uint64_t MAX_OUTSTANDING = 64;
+//! wait before accepting again when out of descriptors or buffers
+static const std::chrono::milliseconds ACCEPT_BACKOFF(100);
+
+//! @brief read exactly @a len bytes, false on end of file or error
+static bool
+read_all(int fd, char* buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t got = read(fd, buf, len);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            return false;
+        }
+        buf += got;
+        len -= got;
+    }
+    return true;
+}
+
+//! @brief write exactly @a len bytes, false on error
+static bool
+write_all(int fd, const char* buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t put = write(fd, buf, len);
+        if (put < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (put <= 0)
+        {
+            return false;
+        }
+        buf += put;
+        len -= put;
+    }
+    return true;
+}
+
+//! @brief a client, kept alive until its last pending request is answered
+//!
+//! Its reader thread reads requests and its writer thread writes the
+//! responses in order; workers only hand responses over, so a client that
+//! doesn't read blocks nobody but its own writer.
+struct Connection
+{
+    int fd;
+    std::mutex mutex; //!< guards the fields below
+    std::condition_variable answered; //!< next response ready or reader done
+    std::condition_variable sent; //!< a response was written
+    uint64_t next_to_send;
+    uint64_t outstanding; //!< requests read and not yet written back
+    std::map<uint64_t, std::string> ready; //!< answered out of order
+    bool reading;
+
+    explicit Connection(int client) :
+        fd(client),
+        next_to_send(0),
+        outstanding(0),
+        reading(true)
+    {
+    }
+
+    ~Connection()
+    {
+        close(fd);
+    }
+
+    //! @brief hand @a response to request @a sequence to the writer
+    void complete(uint64_t sequence, std::string& response)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready[sequence].swap(response);
+        if (sequence == next_to_send)
+        {
+            answered.notify_one();
+        }
+    }
+};
+
+//! @brief one request waiting for a worker
+struct Job
+{
+    std::shared_ptr<Connection> connection;
+    uint64_t sequence;
+    std::string request;
+};
+
+//! @brief bounded queue of requests shared by readers and workers
+class JobQueue
+{
+public:
+    void push(Job& job)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return jobs_.size() < MAX_PENDING; });
+        jobs_.push_back(Job());
+        jobs_.back().connection.swap(job.connection);
+        jobs_.back().sequence = job.sequence;
+        jobs_.back().request.swap(job.request);
+        not_empty_.notify_one();
+    }
+
+    void pop(Job& job)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return !jobs_.empty(); });
+        job.connection.swap(jobs_.front().connection);
+        job.sequence = jobs_.front().sequence;
+        job.request.swap(jobs_.front().request);
+        jobs_.pop_front();
+        not_full_.notify_one();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<Job> jobs_;
+};
+
+static void
+append_results(std::string& out, const std::vector<StringWeightPair>& results)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%lu\n", (unsigned long) results.size());
+    out += buf;
+    for (std::vector<StringWeightPair>::const_iterator it = results.begin();
+         it != results.end();
+         ++it)
+    {
+        snprintf(buf, sizeof(buf), "\t%f\n", it->second);
+        out += it->first;
+        out += buf;
+    }
+}
+
+//! @brief append the block for @a len bytes of @a word to @a out
+static void
+answer_word(ZHfstOspeller& speller, char op, const char* word, size_t len,
+            std::string& out)
+{
+    std::string wordform(word, len);
+    switch (op)
+    {
+    case 'c':
+        out += speller.spell(wordform) ? "1\n" : "0\n";
+        break;
+    case 's':
+        append_results(out, speller.suggest(wordform));
+        break;
+    case 'a':
+        append_results(out, speller.analyse(wordform));
+        break;
+    }
+}
+
+static void
+answer(ZHfstOspeller& speller, const std::string& request, std::string& out)
+{
+    if (request.empty() || strchr("csaCSA", request[0]) == 0)
+    {
+        out = "!unknown operation\n";
+        return;
+    }
+    char op = request[0];
+    out.assign(1, op);
+    if (op == 'c' || op == 's' || op == 'a')
+    {
+        answer_word(speller, op, request.data() + 1, request.size() - 1, out);
+        return;
+    }
+    op = op - 'A' + 'a';
+    const char* word = request.data() + 1;
+    const char* end = request.data() + request.size();
+    while (word < end)
+    {
+        const char* eol = (const char*) memchr(word, '\n', end - word);
+        if (eol == 0)
+        {
+            eol = end;
+        }
+        answer_word(speller, op, word, eol - word, out);
+        word = eol + 1;
+    }
+}
+
+static void
+work(std::shared_ptr<ZHfstOspeller> speller, JobQueue* jobs)
+{
+    Job job;
+    std::string response;
+    while (true)
+    {
+        jobs->pop(job);
+        answer(*speller, job.request, response);
+        job.connection->complete(job.sequence, response);
+        // let the connection close as soon as its last job is done
+        job.connection.reset();
+    }
+}
+
+static void
+write_responses(std::shared_ptr<Connection> connection)
+{
+    std::string response;
+    bool broken = false;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(connection->mutex);
+            connection->answered.wait(lock, [&connection] {
+                return connection->ready.count(connection->next_to_send) > 0 ||
+                    (!connection->reading && connection->outstanding == 0);
+            });
+            std::map<uint64_t, std::string>::iterator next =
+                connection->ready.find(connection->next_to_send);
+            if (next == connection->ready.end())
+            {
+                break;
+            }
+            response.swap(next->second);
+            connection->ready.erase(next);
+            ++connection->next_to_send;
+        }
+        if (!broken)
+        {
+            uint32_t len = htonl((uint32_t) response.size());
+            broken = !write_all(connection->fd, (const char*) &len,
+                                sizeof(len)) ||
+                !write_all(connection->fd, response.data(), response.size());
+            if (broken)
+            {
+                // stop the reader; the rest of the responses are dropped
+                shutdown(connection->fd, SHUT_RDWR);
+            }
+        }
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        --connection->outstanding;
+        connection->sent.notify_one();
+    }
+}
+
+static void
+read_requests(std::shared_ptr<Connection> connection, JobQueue* jobs)
+{
+    uint64_t sequence = 0;
+    while (true)
+    {
+        {
+            // leave the rest in the socket until the client reads some
+            std::unique_lock<std::mutex> lock(connection->mutex);
+            connection->sent.wait(lock, [&connection] {
+                return connection->outstanding < MAX_OUTSTANDING;
+            });
+        }
+        uint32_t len = 0;
+        if (!read_all(connection->fd, (char*) &len, sizeof(len)))
+        {
+            break;
+        }
+        len = ntohl(len);
+        if (len > MAX_FRAME)
+        {
+            fprintf(stderr, "dropping client sending %lu byte request\n",
+                    (unsigned long) len);
+            break;
+        }
+        Job job;
+        job.request.resize(len);
+        if (len > 0 && !read_all(connection->fd, &job.request[0], len))
+        {
+            break;
+        }
+        job.connection = connection;
+        job.sequence = sequence++;
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            ++connection->outstanding;
+        }
+        jobs->push(job);
+    }
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    connection->reading = false;
+    connection->answered.notify_one();
+}
+
+//! @brief remove a socket left behind by a server that is gone
+//!
+//! Nothing but a socket nobody listens on is removed, so that a mistyped
+//! path can't delete a file or take the socket of a running server.
+static bool
+remove_stale_socket(const std::string& socket_path,
+                    const struct sockaddr_un& address)
+{
+    struct stat status;
+    if (lstat(socket_path.c_str(), &status) < 0)
+    {
+        if (errno == ENOENT)
+        {
+            return true;
+        }
+        perror(socket_path.c_str());
+        return false;
+    }
+    if (!S_ISSOCK(status.st_mode))
+    {
+        fprintf(stderr, "%s exists and is not a socket\n",
+                socket_path.c_str());
+        return false;
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0)
+    {
+        perror("socket");
+        return false;
+    }
+    int connected = connect(probe, (const struct sockaddr*) &address,
+                            sizeof(address));
+    int connect_errno = errno;
+    close(probe);
+    if (connected == 0)
+    {
+        fprintf(stderr, "a server is already listening on %s\n",
+                socket_path.c_str());
+        return false;
+    }
+    if (connect_errno != ECONNREFUSED)
+    {
+        errno = connect_errno;
+        perror(socket_path.c_str());
+        return false;
+    }
+    if (unlink(socket_path.c_str()) < 0 && errno != ENOENT)
+    {
+        perror(socket_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+int
+run_spell_server(const std::string& socket_path,
+                 std::vector<std::shared_ptr<ZHfstOspeller> >& spellers)
+{
+    struct sockaddr_un address;
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "socket path %s is too long\n", socket_path.c_str());
+        return EXIT_FAILURE;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        perror("socket");
+        return EXIT_FAILURE;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path.c_str());
+    // a stale socket from an earlier server would make bind fail
+    if (!remove_stale_socket(socket_path, address))
+    {
+        close(listener);
+        return EXIT_FAILURE;
+    }
+    if (bind(listener, (struct sockaddr*) &address, sizeof(address)) < 0 ||
+        listen(listener, SOMAXCONN) < 0)
+    {
+        perror(socket_path.c_str());
+        close(listener);
+        return EXIT_FAILURE;
+    }
+    // a client going away must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    // outlives the detached threads, which run until the process exits
+    JobQueue* jobs = new JobQueue;
+    for (std::vector<std::shared_ptr<ZHfstOspeller> >::iterator speller =
+             spellers.begin();
+         speller != spellers.end();
+         ++speller)
+    {
+        std::thread(work, *speller, jobs).detach();
+    }
+    while (true)
+    {
+        int client = accept(listener, 0, 0);
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            // running out of descriptors or memory passes as clients close
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+                errno == ENOMEM)
+            {
+                perror("accept");
+                std::this_thread::sleep_for(ACCEPT_BACKOFF);
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        std::shared_ptr<Connection> connection(new Connection(client));
+        std::thread(write_responses, connection).detach();
+        std::thread(read_requests, connection, jobs).detach();
+    }
+    close(listener);
+    return EXIT_FAILURE;
+}
+
+#endif // WINDOWS
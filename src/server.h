@@ -0,0 +1,55 @@
+/* -*- Mode: C++ -*- */
+// Copyright 2010 University of Helsinki
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+//! @file server.h
+//!
+//! @brief Unix domain socket spell server of the hfst-ospell tool.
+//!
+//! Every request and response is a frame: a 32-bit big-endian payload
+//! length followed by the payload. A request payload is an operation byte
+//! followed by UTF-8 text:
+//!
+//!   - @c c, @c s, @c a: check, suggest or analyse the one word that follows
+//!   - @c C, @c S, @c A: the same for each of the newline separated words
+//!
+//! A response payload starts with the operation byte of its request and
+//! has one block per word. A block is a line with the number of results
+//! followed by that many result lines; check gives @c 1 or @c 0 and no
+//! result lines, suggest and analyse give lines of string, tab, weight.
+//! A request that cannot be parsed is answered with operation byte @c !
+//! and a message. Clients may send many requests without waiting; the
+//! responses on each connection come in request order. A client that lets
+//! responses pile up unread is not read from until it catches up.
+
+#ifndef HFST_OSPELL_SERVER_H_
+#define HFST_OSPELL_SERVER_H_ 1
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ZHfstOspeller.h"
+
+//! @brief serve requests on a Unix domain socket at @a socket_path.
+//!
+//! Each speller in @a spellers is used by one worker thread. They may read
+//! the same automata, as spellers from ZHfstOspellerRegistry::acquire()
+//! do, but each keeps its own search state. Returns only if the socket
+//! cannot be set up.
+int run_spell_server(
+    const std::string& socket_path,
+    std::vector<std::shared_ptr<hfst_ol::ZHfstOspeller> >& spellers);
+
+#endif // HFST_OSPELL_SERVER_H_
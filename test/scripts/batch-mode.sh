@@ -0,0 +1,30 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell ; then
+    # more than a block of input, so a line is carried over to the next
+    cat $srcdir/test.strings > batch-mode.strings
+    for i in `seq 15` ; do
+        cat batch-mode.strings batch-mode.strings > batch-mode.double
+        mv batch-mode.double batch-mode.strings
+    done
+    if ! ./hfst-ospell -S speller_edit1.zhfst \
+            < batch-mode.strings > batch-mode.expected ; then
+        exit 1
+    fi
+    if ! ./hfst-ospell -S -B -t 4 speller_edit1.zhfst \
+            < batch-mode.strings > batch-mode.out ; then
+        exit 1
+    fi
+    if ! cmp -s batch-mode.expected batch-mode.out ; then
+        exit 1
+    fi
+    if printf 'olu\r\n' | ./hfst-ospell -B speller_edit1.zhfst \
+            > /dev/null 2>&1 ; then
+        exit 1
+    fi
+    rm -f batch-mode.strings batch-mode.expected batch-mode.out
+else
+    echo ./hfst-ospell not built
+    exit 77
+fi
+
@@ -0,0 +1,24 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell-bench ; then
+    if ! ./hfst-ospell-bench -M check -M suggest -t 2 speller_edit1.zhfst \
+            < $srcdir/test.strings > bench.out ; then
+        exit 1
+    fi
+    # one run per mode and thread count, over every word
+    if ! grep -q '"words": 5,' bench.out ; then
+        exit 1
+    fi
+    if test `grep -c '"words_per_sec"' bench.out` != 4 ; then
+        exit 1
+    fi
+    if ./hfst-ospell-bench -M spell speller_edit1.zhfst \
+            < $srcdir/test.strings > /dev/null 2>&1 ; then
+        exit 1
+    fi
+    rm -f bench.out
+else
+    echo ./hfst-ospell-bench not built
+    exit 77
+fi
+
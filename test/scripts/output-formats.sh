@@ -0,0 +1,35 @@
+#!/bin/bash
+
+if test -x ./hfst-ospell ; then
+    # one record per word, in input order
+    if ! cat $srcdir/test.strings | ./hfst-ospell -S -f tsv speller_edit1.zhfst \
+            > output-formats.out ; then
+        exit 1
+    fi
+    if test `wc -l < output-formats.out` != 5 ; then
+        exit 1
+    fi
+    if ! grep -q "^olu	0	olut	1$" output-formats.out ; then
+        exit 1
+    fi
+    if ! cat $srcdir/test.strings | ./hfst-ospell -S -f json speller_edit1.zhfst \
+            > output-formats.out ; then
+        exit 1
+    fi
+    if ! grep -qF '{"word":"olu","correct":false,"suggestions":[["olut",1]]}' \
+            output-formats.out ; then
+        exit 1
+    fi
+    if ! grep -qF '{"word":"olut","correct":true,"suggestions":[]}' \
+            output-formats.out ; then
+        exit 1
+    fi
+    if echo olu | ./hfst-ospell -f xml speller_edit1.zhfst > /dev/null 2>&1 ; then
+        exit 1
+    fi
+    rm -f output-formats.out
+else
+    echo ./hfst-ospell not built
+    exit 77
+fi
+
@@ -0,0 +1,80 @@
+#!/bin/bash
+
+# send requests without waiting and expect the responses in order
+query_server() {
+    python3 - <<'EOF'
+import socket, struct, sys
+client = socket.socket(socket.AF_UNIX)
+client.connect("server.sock")
+requests = [b"colut", b"solu", b"Solu\nvesi", b"x"]
+expected = [b"c1\n", b"s1\nolut\t1.000000\n", b"S1\nolut\t1.000000\n0\n",
+            b"!unknown operation\n"]
+for request in requests:
+    client.sendall(struct.pack(">I", len(request)) + request)
+def receive(size):
+    data = b""
+    while len(data) < size:
+        more = client.recv(size - len(data))
+        if not more:
+            sys.exit(1)
+        data += more
+    return data
+for response in expected:
+    size, = struct.unpack(">I", receive(4))
+    if receive(size) != response:
+        sys.exit(1)
+EOF
+}
+
+wait_for_server() {
+    for i in `seq 50` ; do
+        if test -S server.sock && query_server ; then
+            return 0
+        fi
+        sleep 0.1
+    done
+    return 1
+}
+
+if test -x ./hfst-ospell ; then
+    if ! python3 -c "" > /dev/null 2>&1 ; then
+        echo python3 not found
+        exit 77
+    fi
+    rm -f server.sock server.file
+    ./hfst-ospell -u server.sock -t 2 speller_edit1.zhfst &
+    server=$!
+    status=0
+    if ! wait_for_server ; then
+        status=1
+    fi
+    # a socket a server listens on is not taken over
+    timeout 5 ./hfst-ospell -u server.sock speller_edit1.zhfst > /dev/null 2>&1
+    if test $? != 1 ; then
+        status=1
+    fi
+    kill $server
+    wait $server 2> /dev/null
+    # a socket left behind is
+    if test $status = 0 ; then
+        ./hfst-ospell -u server.sock speller_edit1.zhfst &
+        server=$!
+        if ! wait_for_server ; then
+            status=1
+        fi
+        kill $server
+        wait $server 2> /dev/null
+    fi
+    # and other files are not removed
+    touch server.file
+    timeout 5 ./hfst-ospell -u server.file speller_edit1.zhfst > /dev/null 2>&1
+    if test $? != 1 || ! test -f server.file ; then
+        status=1
+    fi
+    rm -f server.sock server.file
+    exit $status
+else
+    echo ./hfst-ospell not built
+    exit 77
+fi
+
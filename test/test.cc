@@ -1,7 +1,51 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#include <sys/stat.h>
+#include <utime.h>
+
 #include "../src/ZHfstOspeller.h"
+#include "../src/ZHfstOspellerRegistry.h"
+#include "../src/ConfusionMatrix.h"
+#include "../src/SymmetricDeleteIndex.h"
+#include "../src/TextTokenizer.h"
+
+//! copy file @a from over @a to
+static void
+copy_file(const char* from, const char* to)
+{
+    FILE* in = fopen(from, "rb");
+    FILE* out = fopen(to, "wb");
+    REQUIRE(in != 0);
+    REQUIRE(out != 0);
+    char buffer[4096];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), in)) > 0)
+    {
+        fwrite(buffer, 1, got, out);
+    }
+    fclose(in);
+    fclose(out);
+}
+
+//! corrections of @a word by @a speller, best first
+static std::vector<hfst_ol::StringWeightPair>
+corrections(hfst_ol::Speller& speller, std::string word, size_t nbest=0)
+{
+    hfst_ol::CorrectionQueue queue =
+        speller.correct(reinterpret_cast<int8_t*>(&word[0]), nbest);
+    std::vector<hfst_ol::StringWeightPair> results;
+    while (!queue.empty())
+    {
+        results.push_back(queue.top());
+        queue.pop();
+    }
+    return results;
+}
 
 TEST_CASE("ZHfstOspeller functions", "[ZHfstOspeller]") {
     hfst_ol::ZHfstOspeller sp;
@@ -10,6 +54,101 @@ TEST_CASE("ZHfstOspeller functions", "[ZHfstOspeller]") {
 	    auto vec = sp.suggest("test");
 	    REQUIRE(vec.size() == 0);
     }
+
+    SECTION("Suggest in a session with no spellers should be empty") {
+	    hfst_ol::CorrectionSession session = sp.start_session();
+	    auto vec = sp.suggest(session, "test");
+	    REQUIRE(vec.size() == 0);
+	    REQUIRE(session.depth() == 0);
+    }
+
+    SECTION("Complete with no spellers should be empty") {
+	    sp.set_completion_table(true);
+	    auto vec = sp.complete("te", 5);
+	    REQUIRE(vec.size() == 0);
+	    vec = sp.suggest_completions("te", 5, 0.5);
+	    REQUIRE(vec.size() == 0);
+    }
+
+    SECTION("Hyphenate with no hyphenator should be empty") {
+	    auto vec = sp.hyphenate("test");
+	    REQUIRE(vec.size() == 0);
+    }
+
+    SECTION("Statistics with no spellers should be cleared") {
+	    hfst_ol::SearchStatistics stats;
+	    stats.nodes_popped = 1;
+	    sp.suggest("test", &stats);
+	    REQUIRE(stats.nodes_popped == 0);
+    }
+}
+
+TEST_CASE("ZHfstOspellerRegistry functions", "[ZHfstOspellerRegistry]") {
+    hfst_ol::ZHfstOspellerRegistry registry(1024);
+
+    SECTION("Missing archive should throw and load nothing") {
+	    REQUIRE_THROWS_AS(registry.acquire("no-such-speller.zhfst"),
+	                      hfst_ol::ZHfstZipReadingError);
+	    REQUIRE(registry.size() == 0);
+	    REQUIRE(registry.memory_used() == 0);
+    }
+}
+
+TEST_CASE("ConfusionMatrix functions", "[ConfusionMatrix]") {
+    hfst_ol::ConfusionMatrix matrix(2);
+
+    SECTION("Missing file should throw") {
+	    REQUIRE_THROWS_AS(hfst_ol::ConfusionMatrix::from_file("no-such-matrix.txt"),
+	                      hfst_ol::ConfusionMatrixReadError);
+    }
+
+    SECTION("New symbols can only be kept") {
+	    hfst_ol::SymbolNumber a = matrix.add_symbol("a");
+	    hfst_ol::SymbolNumber b = matrix.add_symbol("b");
+	    REQUIRE(matrix.find("c") == hfst_ol::ConfusionMatrix::UNKNOWN);
+	    REQUIRE(matrix.edit(a, a) == 0.0);
+	    REQUIRE(matrix.edit(a, b) == std::numeric_limits<hfst_ol::Weight>::infinity());
+	    matrix.set_edit(a, b, 0.5);
+	    REQUIRE(matrix.edit(a, b) == 0.5);
+	    REQUIRE(matrix.has_swaps() == false);
+    }
+}
+
+TEST_CASE("Case mapping functions", "[case]") {
+    SECTION("Letters change case, other characters stay") {
+	    REQUIRE(hfst_ol::utf8_to_lower("HELSINKI-2") == "helsinki-2");
+	    REQUIRE(hfst_ol::utf8_to_upper("\xc3\xa5\xc5\x8b\xd0\xb4") == "\xc3\x85\xc5\x8a\xd0\x94");
+	    REQUIRE(hfst_ol::utf8_to_lower("\xc3\x97\xc4\xb0") == "\xc3\x97\xc4\xb0");
+    }
+}
+
+TEST_CASE("Code unit conversion functions", "[utf16]") {
+    SECTION("Characters beyond the BMP take surrogate pairs in UTF-16") {
+	    std::string word = "\xc3\x85" "bo\xf0\x9f\x98\x80";
+	    REQUIRE(hfst_ol::utf8_to_utf16(word) == u"\u00c5bo\U0001f600");
+	    REQUIRE(hfst_ol::utf8_to_utf32(word).size() == 4);
+	    REQUIRE(hfst_ol::utf16_to_utf8(hfst_ol::utf8_to_utf16(word)) == word);
+	    REQUIRE(hfst_ol::utf16_to_utf8(u"a\xd800") == "a\xef\xbf\xbd");
+    }
+}
+
+TEST_CASE("TextTokenizer functions", "[TextTokenizer]") {
+    hfst_ol::KeyTable symbols;
+    symbols.push_back("@_EPSILON_SYMBOL_@");
+    symbols.push_back("'");
+    hfst_ol::TextTokenizer tokenizer(symbols);
+    std::string text = "'Tis 42 don't, (\xc3\x85" "bo)";
+    std::vector<hfst_ol::TextSpan> words;
+
+    SECTION("Words are split at spaces and unknown punctuation") {
+	    tokenizer.split(text.data(), text.size(), words);
+	    REQUIRE(words.size() == 3);
+	    REQUIRE(text.substr(words[0].offset, words[0].length) == "'Tis");
+	    REQUIRE(text.substr(words[1].offset, words[1].length) == "don't");
+	    REQUIRE(text.substr(words[2].offset, words[2].length) == "\xc3\x85" "bo");
+	    hfst_ol::TextSpan trimmed = tokenizer.trim(text.data(), words[0]);
+	    REQUIRE(text.substr(trimmed.offset, trimmed.length) == "Tis");
+    }
 }
 
 TEST_CASE("Basic speller", "[speller_basic.zhfst]") {
@@ -26,20 +165,609 @@ TEST_CASE("Basic speller", "[speller_basic.zhfst]") {
     }
 }
 
+TEST_CASE("Case folding", "[speller_basic.zhfst]") {
+    hfst_ol::ZHfstOspeller sp;
+    INFO("Path: " << sp.read_zhfst("speller_basic.zhfst"));
+
+    SECTION("Capitalised words and words in capitals are accepted") {
+	    REQUIRE(sp.spell("Olut") == false);
+	    sp.set_case_folding(true);
+	    REQUIRE(sp.spell("olut") == true);
+	    REQUIRE(sp.spell("Olut") == true);
+	    REQUIRE(sp.spell("OLUT") == true);
+	    REQUIRE(sp.spell("Olu") == false);
+    }
+
+    SECTION("Suggestions are given in the case of the input") {
+	    sp.set_case_folding(true);
+	    auto vec = sp.suggest("Vesi");
+	    REQUIRE(vec.size() == 1);
+	    REQUIRE(vec[0].first == "Olut");
+	    vec = sp.suggest("VESI");
+	    REQUIRE(vec.size() == 1);
+	    REQUIRE(vec[0].first == "OLUT");
+    }
+}
+
+TEST_CASE("Case folding with edits", "[speller_edit1.zhfst]") {
+    hfst_ol::ZHfstOspeller sp;
+    INFO("Path: " << sp.read_zhfst("speller_edit1.zhfst"));
+    sp.set_case_folding(true);
+
+    SECTION("Corrections keep the case of the input") {
+	    auto vec = sp.suggest("Olu");
+	    REQUIRE(vec.size() == 1);
+	    REQUIRE(vec[0].first == "Olut");
+	    REQUIRE(vec[0].second == Approx(1.0));
+	    vec = sp.suggest("OLU");
+	    REQUIRE(vec.size() == 1);
+	    REQUIRE(vec[0].first == "OLUT");
+	    REQUIRE(sp.suggest("olu")[0].first == "olut");
+    }
+}
+
+TEST_CASE("Registry spellers", "[speller_basic.zhfst]") {
+    hfst_ol::ZHfstOspellerRegistry registry;
+
+    SECTION("Each acquire gets its own speller over one archive") {
+	    auto a = registry.acquire("speller_basic.zhfst");
+	    auto b = registry.acquire("speller_basic.zhfst");
+	    REQUIRE(a.get() != b.get());
+	    REQUIRE(registry.size() == 1);
+	    REQUIRE(a->spell("olut") == true);
+	    REQUIRE(b->spell("vesi") == false);
+	    REQUIRE(a->suggest("vesi") == b->suggest("vesi"));
+	    a.reset();
+	    registry.unload_idle();
+	    REQUIRE(registry.size() == 1);
+	    b.reset();
+	    registry.unload_idle();
+	    REQUIRE(registry.size() == 0);
+    }
+
+    SECTION("An archive changed on disk is read again") {
+	    copy_file("speller_basic.zhfst", "registry_reload.zhfst");
+	    auto before = registry.acquire("registry_reload.zhfst");
+	    REQUIRE(before->suggest("olu").size() == 0);
+	    // edit distance corrects olu; a second earlier so the change shows
+	    copy_file("speller_edit1.zhfst", "registry_reload.zhfst");
+	    struct stat status;
+	    REQUIRE(stat("registry_reload.zhfst", &status) == 0);
+	    struct utimbuf times;
+	    times.actime = status.st_atime;
+	    times.modtime = status.st_mtime - 1;
+	    REQUIRE(utime("registry_reload.zhfst", &times) == 0);
+	    auto after = registry.acquire("registry_reload.zhfst");
+	    REQUIRE(registry.size() == 1);
+	    REQUIRE(after->suggest("olu").size() == 1);
+	    REQUIRE(before->suggest("olu").size() == 0);
+	    REQUIRE(registry.memory_used() == after->automata_size());
+	    std::remove("registry_reload.zhfst");
+    }
+
+    SECTION("Idle archives are unloaded to keep within the budget") {
+	    registry.set_memory_budget(1);
+	    auto basic = registry.acquire("speller_basic.zhfst");
+	    auto edit1 = registry.acquire("speller_edit1.zhfst");
+	    REQUIRE(registry.size() == 2);
+	    basic.reset();
+	    auto analyser = registry.acquire("speller_analyser.zhfst");
+	    REQUIRE(registry.size() == 2);
+	    REQUIRE(registry.memory_used() ==
+	            edit1->automata_size() + analyser->automata_size());
+	    edit1.reset();
+	    registry.set_memory_budget(analyser->automata_size());
+	    REQUIRE(registry.size() == 1);
+	    REQUIRE(analyser->spell("olut"));
+    }
+}
+
+TEST_CASE("Spellers over shared storage", "[acceptor.basic.hfst]") {
+    auto lexicon = hfst_ol::TransducerStorage::from_file("acceptor.basic.hfst");
+    auto errmodel = hfst_ol::TransducerStorage::from_file("errmodel.edit1.hfst");
+    hfst_ol::Transducer lexicon1(lexicon), errmodel1(errmodel);
+    hfst_ol::Transducer lexicon2(lexicon), errmodel2(errmodel);
+    hfst_ol::Speller one(&errmodel1, &lexicon1);
+    hfst_ol::Speller two(&errmodel2, &lexicon2);
+
+    SECTION("A symbol one speller adds is not seen by the other") {
+	    size_t symbols = lexicon2.get_key_table()->size();
+	    REQUIRE(corrections(one, "ol\xc3\xbct").size() > 0);
+	    REQUIRE(lexicon1.get_key_table()->size() > symbols);
+	    REQUIRE(lexicon2.get_key_table()->size() == symbols);
+	    const char* words[] = {"olut", "olu", "vesi", "ol\xc3\xbct", "\xc3\xbc"};
+	    for (const char* word : words) {
+		    std::string w(word);
+		    REQUIRE(one.check(w.data(), w.data() + w.size()) ==
+		            two.check(w.data(), w.data() + w.size()));
+		    REQUIRE(corrections(one, w) == corrections(two, w));
+	    }
+	    REQUIRE(lexicon1.get_key_table()->size() ==
+	            lexicon2.get_key_table()->size());
+    }
+
+    SECTION("An injected speller is not shared") {
+	    hfst_ol::ZHfstOspeller injected;
+	    injected.inject_speller(new hfst_ol::Speller(&errmodel2, &lexicon2));
+	    REQUIRE(injected.spell("olut"));
+	    REQUIRE_THROWS_AS(injected.share(), hfst_ol::ZHfstException);
+	    hfst_ol::ZHfstOspeller empty;
+	    std::unique_ptr<hfst_ol::ZHfstOspeller> shared(empty.share());
+	    REQUIRE(!shared->spell("olut"));
+    }
+}
+
+TEST_CASE("Deterministic lexicons", "[acceptor.compound.hfst]") {
+    const char* files[] = {"acceptor.basic.hfst", "acceptor.compound.hfst"};
+    const char* words[] = {"olut", "olu", "oluta", "", "ol\xc3\xbct",
+                           "olut-olut", "olut-", "-olut", "vesi"};
+
+    SECTION("Walking the lexicon accepts what the search accepts") {
+	    for (const char* file : files) {
+		    INFO("lexicon: " << file);
+		    hfst_ol::Transducer lexicon(
+		        hfst_ol::TransducerStorage::from_file(file));
+		    hfst_ol::Transducer searched_lexicon(lexicon.get_storage());
+		    hfst_ol::Speller walked(0, &lexicon);
+		    hfst_ol::Speller searched(0, &searched_lexicon);
+		    REQUIRE(walked.deterministic_lexicon);
+		    searched.deterministic_lexicon = false;
+		    for (const char* word : words) {
+			    INFO("word: " << word);
+			    std::string w(word);
+			    REQUIRE(walked.check(w.data(), w.data() + w.size()) ==
+			            searched.check(w.data(), w.data() + w.size()));
+		    }
+		    std::string w("olut");
+		    REQUIRE(walked.check(w.data(), w.data() + w.size()));
+	    }
+    }
+
+    SECTION("An analyser with epsilons is searched") {
+	    hfst_ol::Transducer analyser(
+	        hfst_ol::TransducerStorage::from_file("analyser.default.hfst"));
+	    hfst_ol::Speller speller(0, &analyser);
+	    REQUIRE(!speller.deterministic_lexicon);
+    }
+}
+
+TEST_CASE("Search kernels", "[errmodel.plain.hfst]") {
+    hfst_ol::Transducer lexicon(
+        hfst_ol::TransducerStorage::from_file("acceptor.basic.hfst"));
+    hfst_ol::Transducer errmodel(
+        hfst_ol::TransducerStorage::from_file("errmodel.plain.hfst"));
+    hfst_ol::Transducer open_lexicon(lexicon.get_storage());
+    hfst_ol::Transducer open_errmodel(errmodel.get_storage());
+    hfst_ol::Speller closed(&errmodel, &lexicon);
+    hfst_ol::Speller open(&open_errmodel, &open_lexicon);
+    const char* words[] = {"olu", "olt", "oolut", "tlut", "olut", "lout",
+                           "ol\xc3\xbc"};
+
+    SECTION("A closed alphabet is searched as an open one would be") {
+	    REQUIRE(!closed.open_alphabet);
+	    open.open_alphabet = true;
+	    for (const char* word : words) {
+		    INFO("word: " << word);
+		    REQUIRE(corrections(closed, word) == corrections(open, word));
+		    REQUIRE(corrections(closed, word, 1) == corrections(open, word, 1));
+	    }
+	    hfst_ol::Transducer edit1(
+	        hfst_ol::TransducerStorage::from_file("errmodel.edit1.hfst"));
+	    hfst_ol::Transducer edit1_lexicon(lexicon.get_storage());
+	    REQUIRE(hfst_ol::Speller(&edit1, &edit1_lexicon).open_alphabet);
+    }
+
+    SECTION("The strict n-best limit finds what a loose limit finds") {
+	    for (const char* word : words) {
+		    INFO("word: " << word);
+		    std::string strict(word), loose(word);
+		    hfst_ol::CorrectionQueue nbest =
+		        closed.correct(reinterpret_cast<int8_t*>(&strict[0]), 1);
+		    hfst_ol::CorrectionQueue limited =
+		        closed.correct(reinterpret_cast<int8_t*>(&loose[0]), 1, 100.0);
+		    REQUIRE(nbest.size() == limited.size());
+		    if (nbest.size() > 0) {
+			    REQUIRE(nbest.top() == limited.top());
+		    }
+	    }
+    }
+
+    SECTION("A weight limit of a correction does not limit a check") {
+	    std::string word("olu");
+	    REQUIRE(closed.correct(reinterpret_cast<int8_t*>(&word[0]),
+	                           0, 0.5).size() == 0);
+	    std::string w("olut");
+	    REQUIRE(closed.check(w.data(), w.data() + w.size()));
+	    REQUIRE(corrections(closed, "olu").size() == 1);
+    }
+}
+
+TEST_CASE("Prefetch hints", "[errmodel.edit1.hfst]") {
+    hfst_ol::Transducer errmodel(
+        hfst_ol::TransducerStorage::from_file("errmodel.edit1.hfst"));
+    hfst_ol::TransitionTableIndex index_count =
+        errmodel.get_header()->index_table_size();
+    hfst_ol::TransitionTableIndex transition_count =
+        errmodel.get_header()->target_table_size();
+
+    SECTION("Hints point at the rows the tables read") {
+	    for (hfst_ol::TransitionTableIndex i = 0; i < index_count; ++i) {
+		    hfst_ol::SymbolNumber symbol;
+		    memcpy(&symbol, errmodel.indices.address(i), sizeof(symbol));
+		    REQUIRE(symbol == errmodel.indices.input_symbol(i));
+	    }
+	    for (hfst_ol::TransitionTableIndex i = 0; i < transition_count; ++i) {
+		    hfst_ol::SymbolNumber symbols[2];
+		    memcpy(symbols, errmodel.transitions.address(i), sizeof(symbols));
+		    REQUIRE(symbols[0] == errmodel.transitions.input_symbol(i));
+		    REQUIRE(symbols[1] == errmodel.transitions.output_symbol(i));
+	    }
+    }
+
+    SECTION("Hints for every state change nothing") {
+	    for (hfst_ol::TransitionTableIndex i = 0; i < index_count; ++i) {
+		    errmodel.prefetch(i, hfst_ol::NO_SYMBOL);
+		    errmodel.prefetch(i, 1);
+	    }
+	    for (hfst_ol::TransitionTableIndex i = 0; i < transition_count; ++i) {
+		    errmodel.prefetch(hfst_ol::TARGET_TABLE + i, hfst_ol::NO_SYMBOL);
+	    }
+	    hfst_ol::Transducer lexicon(
+	        hfst_ol::TransducerStorage::from_file("acceptor.basic.hfst"));
+	    hfst_ol::Speller speller(&errmodel, &lexicon);
+	    auto vec = corrections(speller, "olu");
+	    REQUIRE(vec.size() == 1);
+	    REQUIRE(vec[0].first == "olut");
+    }
+}
+
+TEST_CASE("Mapping options", "[acceptor.basic.hfst]") {
+    SECTION("Options are read from a comma separated list") {
+	    REQUIRE(hfst_ol::parse_mapping_flags("") == hfst_ol::MapDefault);
+	    REQUIRE(hfst_ol::parse_mapping_flags("populate,random") ==
+	            (hfst_ol::MapPopulate | hfst_ol::MapRandom));
+	    REQUIRE(hfst_ol::parse_mapping_flags("hugepages") ==
+	            hfst_ol::MapHugePages);
+	    REQUIRE(hfst_ol::parse_mapping_flags("populate,huge") == -1);
+    }
+
+    SECTION("Automata mapped in any way give the same corrections") {
+	    int mappings[] = {hfst_ol::MapDefault, hfst_ol::MapPopulate,
+	                      hfst_ol::MapHugePages, hfst_ol::MapRandom,
+	                      hfst_ol::MapPopulate | hfst_ol::MapHugePages |
+	                      hfst_ol::MapRandom};
+	    for (int mapping : mappings) {
+		    INFO("mapping: " << mapping);
+		    hfst_ol::ZHfstOspeller sp("acceptor.basic.hfst",
+		                              "errmodel.edit1.hfst", mapping);
+		    REQUIRE(sp.spell("olut"));
+		    REQUIRE(!sp.spell("olu"));
+		    auto vec = sp.suggest("olu");
+		    REQUIRE(vec.size() == 1);
+		    REQUIRE(vec[0].first == "olut");
+		    REQUIRE(vec[0].second == Approx(1.0));
+	    }
+    }
+}
+
+TEST_CASE("Symmetric delete index", "[acceptor.basic.hfst]") {
+    hfst_ol::Transducer lexicon(
+        hfst_ol::TransducerStorage::from_file("acceptor.basic.hfst"));
+    hfst_ol::Transducer errmodel(
+        hfst_ol::TransducerStorage::from_file("errmodel.edit1.hfst"));
+
+    SECTION("A mapped index finds what the lexicon search finds") {
+	    hfst_ol::SymmetricDeleteIndex::build(lexicon, 2).write("test.sdi");
+	    hfst_ol::SymmetricDeleteIndex index =
+	        hfst_ol::SymmetricDeleteIndex::from_file("test.sdi", lexicon, 2);
+	    std::remove("test.sdi");
+	    REQUIRE(index.word_count() == 1);
+	    REQUIRE(index.get_distance() == 2);
+	    hfst_ol::Transducer indexed_lexicon(lexicon.get_storage());
+	    hfst_ol::Transducer indexed_errmodel(errmodel.get_storage());
+	    hfst_ol::Speller searched(&errmodel, &lexicon);
+	    hfst_ol::Speller indexed(&indexed_errmodel, &indexed_lexicon);
+	    indexed.use_delete_index(index);
+	    const char* words[] = {"olut", "olu", "olvt", "lut", "oluut", "vesi"};
+	    for (const char* word : words) {
+		    INFO("word: " << word);
+		    REQUIRE(corrections(indexed, word) == corrections(searched, word));
+	    }
+	    REQUIRE(corrections(indexed, "olu").size() == 1);
+    }
+
+    SECTION("Cyclic lexicons are refused") {
+	    REQUIRE_THROWS_AS(hfst_ol::SymmetricDeleteIndex::build(errmodel),
+	                      hfst_ol::SymmetricDeleteIndexError);
+    }
+
+    SECTION("An index of another lexicon is refused") {
+	    hfst_ol::SymmetricDeleteIndex::build(lexicon, 1).write("test.sdi");
+	    hfst_ol::Transducer analyser(
+	        hfst_ol::TransducerStorage::from_file("analyser.default.hfst"));
+	    REQUIRE_THROWS_AS(
+	        hfst_ol::SymmetricDeleteIndex::from_file("test.sdi", analyser, 1),
+	        hfst_ol::SymmetricDeleteIndexError);
+	    std::remove("test.sdi");
+    }
+
+    SECTION("An index for fewer edits than asked for is refused") {
+	    hfst_ol::SymmetricDeleteIndex::build(lexicon, 1).write("test.sdi");
+	    REQUIRE_THROWS_AS(
+	        hfst_ol::SymmetricDeleteIndex::from_file("test.sdi", lexicon, 2),
+	        hfst_ol::SymmetricDeleteIndexError);
+	    REQUIRE(hfst_ol::SymmetricDeleteIndex::from_file("test.sdi", lexicon, 1)
+	            .get_distance() == 1);
+	    std::remove("test.sdi");
+    }
+
+    SECTION("An index with a bucket past the postings is refused") {
+	    hfst_ol::SymmetricDeleteIndex::build(lexicon, 1).write("test.sdi");
+	    // the buckets follow the 48 byte header: a hash, then the first
+	    // posting and the number of them
+	    FILE* file = fopen("test.sdi", "r+b");
+	    REQUIRE(file != 0);
+	    uint64_t bucket_count = 0;
+	    fseek(file, 24, SEEK_SET);
+	    REQUIRE(fread(&bucket_count, sizeof(bucket_count), 1, file) == 1);
+	    for (uint64_t slot = 0; slot < bucket_count; ++slot) {
+		    uint32_t first_and_count[2];
+		    fseek(file, 48 + slot * 16 + 8, SEEK_SET);
+		    REQUIRE(fread(first_and_count, sizeof(uint32_t), 2, file) == 2);
+		    if (first_and_count[1] != 0) {
+			    first_and_count[0] = 1000;
+			    fseek(file, 48 + slot * 16 + 8, SEEK_SET);
+			    fwrite(first_and_count, sizeof(uint32_t), 2, file);
+			    break;
+		    }
+	    }
+	    fclose(file);
+	    REQUIRE_THROWS_AS(
+	        hfst_ol::SymmetricDeleteIndex::from_file("test.sdi", lexicon, 1),
+	        hfst_ol::SymmetricDeleteIndexError);
+	    std::remove("test.sdi");
+    }
+}
+
+TEST_CASE("Iterative deepening", "[acceptor.basic.hfst]") {
+    hfst_ol::Transducer lexicon(
+        hfst_ol::TransducerStorage::from_file("acceptor.basic.hfst"));
+    hfst_ol::Transducer errmodel(
+        hfst_ol::TransducerStorage::from_file("errmodel.edit1.hfst"));
+    hfst_ol::Transducer deepened_lexicon(lexicon.get_storage());
+    hfst_ol::Transducer deepened_errmodel(errmodel.get_storage());
+    hfst_ol::Speller plain(&errmodel, &lexicon);
+    hfst_ol::Speller deepened(&deepened_errmodel, &deepened_lexicon);
+    // olut is an edit, weight 1, away from olu: several doublings of this
+    deepened.set_deepening(0.25);
+
+    SECTION("The n-best corrections are the same as without") {
+	    auto expected = corrections(plain, "olu", 1);
+	    REQUIRE(expected.size() == 1);
+	    REQUIRE(expected[0].first == "olut");
+	    REQUIRE(corrections(deepened, "olu", 1) == expected);
+	    REQUIRE(corrections(deepened, "olvt", 1) == corrections(plain, "olvt", 1));
+    }
+
+    SECTION("Fewer corrections than asked for are all found") {
+	    REQUIRE(corrections(deepened, "olu", 5) == corrections(plain, "olu", 5));
+	    REQUIRE(corrections(deepened, "olu", 5).size() == 1);
+	    REQUIRE(corrections(deepened, "vesi", 5).size() == 0);
+    }
+
+    SECTION("A maximum weight is kept when there is nothing to deepen") {
+	    std::string word("olu");
+	    REQUIRE(deepened.correct(reinterpret_cast<int8_t*>(&word[0]),
+	                             0, 0.5).size() == 0);
+	    REQUIRE(deepened.correct(reinterpret_cast<int8_t*>(&word[0]),
+	                             5, 0.5).size() == 0);
+	    REQUIRE(deepened.correct(reinterpret_cast<int8_t*>(&word[0]),
+	                             0, 1.0).size() == 1);
+    }
+}
+
+TEST_CASE("Plain edit distance", "[errmodel.plain.hfst]") {
+    hfst_ol::Transducer lexicon(
+        hfst_ol::TransducerStorage::from_file("acceptor.basic.hfst"));
+    hfst_ol::Transducer errmodel(
+        hfst_ol::TransducerStorage::from_file("errmodel.plain.hfst"));
+    hfst_ol::Speller speller(&errmodel, &lexicon);
+
+    SECTION("Edit weights give what the automaton gives, when asked for") {
+	    const char* words[] = {"olu", "olt", "oolut", "tlut", "olut", "lout"};
+	    std::vector<std::vector<hfst_ol::StringWeightPair> > automaton;
+	    for (const char* word : words) {
+		    automaton.push_back(corrections(speller, word));
+	    }
+	    REQUIRE(automaton[0].size() == 1);
+	    REQUIRE(automaton[0][0].first == "olut");
+	    REQUIRE(automaton[0][0].second == Approx(1.0));
+	    REQUIRE(automaton[5].size() == 0);
+	    REQUIRE(speller.use_edit_distance(true));
+	    for (size_t i = 0; i < automaton.size(); ++i) {
+		    REQUIRE(corrections(speller, words[i]) == automaton[i]);
+	    }
+	    REQUIRE(!speller.use_edit_distance(false));
+	    REQUIRE(corrections(speller, "olu") == automaton[0]);
+    }
+
+    SECTION("An error model with unknown symbols is searched as automaton") {
+	    hfst_ol::Transducer open_errmodel(
+	        hfst_ol::TransducerStorage::from_file("errmodel.edit1.hfst"));
+	    hfst_ol::Transducer open_lexicon(lexicon.get_storage());
+	    hfst_ol::Speller open(&open_errmodel, &open_lexicon);
+	    REQUIRE(!open.use_edit_distance(true));
+    }
+}
+
+TEST_CASE("Correction sessions", "[speller_edit1.zhfst]") {
+    hfst_ol::ZHfstOspeller sp;
+    INFO("Path: " << sp.read_zhfst("speller_edit1.zhfst"));
+
+    SECTION("Typing and backspacing suggests what suggest() does") {
+	    hfst_ol::CorrectionSession session = sp.start_session();
+	    const char* typed[] = {"o", "ol", "olu", "oluu", "olu", "ol", "olv", "olvt"};
+	    for (const char* word : typed) {
+		    INFO("typed: " << word);
+		    REQUIRE(sp.suggest(session, word) == sp.suggest(word));
+	    }
+	    auto vec = sp.suggest(session, "olu");
+	    REQUIRE(vec.size() == 1);
+	    REQUIRE(vec[0].first == "olut");
+	    REQUIRE(vec[0].second == Approx(1.0));
+    }
+}
+
+TEST_CASE("Completions", "[speller_analyser.zhfst]") {
+    hfst_ol::ZHfstOspeller sp;
+    INFO("Path: " << sp.read_zhfst("speller_analyser.zhfst"));
+
+    SECTION("Words are completed lightest first") {
+	    auto vec = sp.complete("ol", 0);
+	    REQUIRE(vec.size() == 2);
+	    REQUIRE(vec[0].first == "olu");
+	    REQUIRE(vec[1].first == "olut");
+	    REQUIRE(vec[1].second == Approx(0.0));
+	    REQUIRE(sp.complete("ol", 1).size() == 1);
+	    REQUIRE(sp.complete("x", 0).size() == 0);
+	    sp.set_completion_table(true);
+	    REQUIRE(sp.complete("ol", 0) == vec);
+    }
+}
+
+TEST_CASE("Completions of corrections", "[speller_analyser.zhfst]") {
+    hfst_ol::ZHfstOspeller sp;
+    INFO("Path: " << sp.read_zhfst("speller_analyser.zhfst"));
+
+    SECTION("Each symbol completed adds its weight") {
+	    auto vec = sp.suggest_completions("ol", 5, 0.5);
+	    REQUIRE(vec.size() == 2);
+	    REQUIRE(vec[0].first == "olu");
+	    REQUIRE(vec[0].second == Approx(0.5));
+	    REQUIRE(vec[1].first == "olut");
+	    REQUIRE(vec[1].second == Approx(1.0));
+    }
+
+    SECTION("A prefix with a typo is corrected and completed") {
+	    auto vec = sp.suggest_completions("ul", 5, 0.5);
+	    REQUIRE(vec.size() == 2);
+	    REQUIRE(vec[0].first == "olu");
+	    REQUIRE(vec[0].second == Approx(1.5));
+	    REQUIRE(vec[1].first == "olut");
+	    REQUIRE(vec[1].second == Approx(2.0));
+    }
+}
+
+TEST_CASE("Hyphenation", "[hyphenator.default.hfst]") {
+    hfst_ol::Transducer automaton(
+        hfst_ol::TransducerStorage::from_file("hyphenator.default.hfst"));
+    hfst_ol::Hyphenator hyphenator(&automaton);
+
+    // the hyphen is on an epsilon arc that loops back, to be taken once
+    SECTION("Accepted words are hyphenated, others are not") {
+	    std::string word = "olut";
+	    hfst_ol::HyphenationQueue queue =
+	        hyphenator.hyphenate(reinterpret_cast<int8_t*>(&word[0]));
+	    REQUIRE(queue.size() == 1);
+	    REQUIRE(queue.top().first == "o-lut");
+	    word = "vesi";
+	    queue = hyphenator.hyphenate(reinterpret_cast<int8_t*>(&word[0]));
+	    REQUIRE(queue.size() == 0);
+    }
+}
+
 TEST_CASE("Speller analyse", "[speller_analyser.zhfst]") {
     hfst_ol::ZHfstOspeller sp;
     INFO("Path: " << sp.read_zhfst("speller_analyser.zhfst"));
 
     SECTION("Test strings") {
         REQUIRE(sp.analyse("olut").size() == 1);
-        REQUIRE(sp.analyse("vesi").size() == 0);
+        REQUIRE(sp.analyse("vesi").size() == 1);
         REQUIRE(sp.analyse("sivolutesi").size() == 0);
-        REQUIRE(sp.analyse("olu").size() == 0);
+        REQUIRE(sp.analyse("olu").size() == 1);
         REQUIRE(sp.analyse("ßþ”×\\").size() == 0);
         REQUIRE(sp.analyse("").size() == 0);
     }
 }
 
+TEST_CASE("Checking running text", "[speller_compound.zhfst]") {
+    hfst_ol::ZHfstOspeller sp;
+    INFO("Path: " << sp.read_zhfst("speller_compound.zhfst"));
+
+    SECTION("Misspelt words are given as spans of the text") {
+	    // the hyphen is a symbol of the speller, so it stays in words
+	    std::string text = "olut vesi, -olut- (olu) olu-olut olut-olut. -olu";
+	    auto spans = sp.check_text(text);
+	    REQUIRE(spans.size() == 4);
+	    REQUIRE(spans[0].offset == 5);
+	    REQUIRE(spans[0].length == 4);
+	    REQUIRE(spans[1].offset == 19);
+	    REQUIRE(spans[1].length == 3);
+	    REQUIRE(spans[2].offset == 24);
+	    REQUIRE(spans[2].length == 8);
+	    // -olu is retried without its hyphen and given trimmed
+	    REQUIRE(spans[3].offset == 45);
+	    REQUIRE(spans[3].length == 3);
+	    REQUIRE(sp.check_text("olut, -olut- olut-olut").size() == 0);
+    }
+}
+
+TEST_CASE("Corrections with analyses", "[speller_analyser.zhfst]") {
+    hfst_ol::ZHfstOspeller sp;
+    INFO("Path: " << sp.read_zhfst("speller_analyser.zhfst"));
+
+    SECTION("Each correction comes with its analysis") {
+	    auto vec = sp.suggest_analyses("olu");
+	    REQUIRE(vec.size() == 2);
+	    REQUIRE(vec[0].first.first == "olu");
+	    REQUIRE(vec[0].first.second == "olu+Use/-Spell");
+	    REQUIRE(vec[0].second == Approx(0.0));
+	    REQUIRE(vec[1].first.first == "olut");
+	    REQUIRE(vec[1].first.second == "olut+N");
+	    REQUIRE(vec[1].second == Approx(1.0));
+    }
+}
+
+TEST_CASE("Search limits", "[speller_analyser.zhfst]") {
+    hfst_ol::ZHfstOspeller sp;
+    INFO("Path: " << sp.read_zhfst("speller_analyser.zhfst"));
+
+    SECTION("A node limit gives partial suggestions") {
+	    REQUIRE(sp.suggest("olvt").size() == 1);
+	    REQUIRE(sp.suggestions_partial() == false);
+	    sp.set_node_limit(2);
+	    sp.suggest("olvt");
+	    REQUIRE(sp.suggestions_partial() == true);
+	    sp.set_node_limit(0);
+	    REQUIRE(sp.suggest("olvt").size() == 1);
+	    REQUIRE(sp.suggestions_partial() == false);
+    }
+}
+
+#if HAVE_LIBXML || HAVE_TINYXML2
+// the cascade is read from the types in index.xml
+TEST_CASE("Cascade of error models", "[speller_cascade.zhfst]") {
+    hfst_ol::ZHfstOspeller sp;
+    INFO("Path: " << sp.read_zhfst("speller_cascade.zhfst"));
+
+    SECTION("A tier with enough corrections ends the search") {
+	    auto vec = sp.suggest("vesi");
+	    REQUIRE(vec.size() == 1);
+	    REQUIRE(vec[0].first == "olut");
+	    REQUIRE(vec[0].second == Approx(0.0));
+    }
+
+    SECTION("Too few corrections fall through to the default model") {
+	    auto vec = sp.suggest("olu");
+	    REQUIRE(vec.size() == 1);
+	    REQUIRE(vec[0].first == "olut");
+	    REQUIRE(vec[0].second == Approx(1.0));
+	    sp.set_cascade_minimum(2);
+	    REQUIRE(sp.suggest("vesi").size() == 0);
+    }
+}
+#endif
+
 TEST_CASE("Bad error model", "[bad_errormodel.zhfst]") {
 
 }